@@ -1,6 +1,8 @@
 #include "lib_syscall.h"
 #include "malloc.h"
 
+int syscall_mode = SYSCALL_MODE_UNKNOWN;      // 各进程第一次系统调用时检测
+
 void msleep(int ms) {
 	if (ms <= 0) {
 		return;
@@ -9,9 +11,12 @@ void msleep(int ms) {
 	sys_call(&args);
 }
 
+/**
+ * 进程号由内核写在共享页中, 直接读取即可
+ */
 int getpid() {
-	syscall_args_t args = {SYS_getpid, 0, 0, 0, 0};
-	return sys_call(&args);
+	vdso_data_t *vdso = (vdso_data_t *) VDSO_DATA_ADDR;
+	return ((vdso_getpid_t) vdso->entry[VDSO_FN_getpid])();
 }
 
 void print_msg(const char *fmt, int arg) {
@@ -24,6 +29,15 @@ int fork() {
 	return sys_call(&args);
 }
 
+/**
+ * 直接从 ELF 文件创建子进程, 相当于 fork 后马上 execve
+ * fd_map 为空时继承所有打开的文件, 否则依次指定子进程的标准输入、输出、错误
+ */
+int spawn(const char *path, char *const argv[], const int *fd_map) {
+	syscall_args_t args = {SYS_spawn, (uint32_t) path, (uint32_t) argv, (uint32_t) fd_map, 0};
+	return sys_call(&args);
+}
+
 int execve(const char *path, char *const argv[], char *const envp[]) {
 	syscall_args_t args = {SYS_execve, (uint32_t) path, (uint32_t) argv, (uint32_t) envp, 0};
 	return sys_call(&args);
@@ -34,6 +48,43 @@ void yield() {
 	sys_call(&args);
 }
 
+/**
+ * 内核支持的时钟直接读共享页, 结果与系统调用一致; 其它时钟交给内核处理
+ */
+int clock_gettime(clockid_t clock_id, struct timespec *tp) {
+	vdso_data_t *vdso = (vdso_data_t *) VDSO_DATA_ADDR;
+	uint32_t sec, nsec, ticks;
+
+	switch (clock_id) {
+		case CLOCK_MONOTONIC:
+		case CLOCK_MONOTONIC_RAW:
+		case CLOCK_BOOTTIME:
+			((vdso_clock_t) vdso->entry[VDSO_FN_clock])(&sec, &nsec);
+			break;
+		case CLOCK_MONOTONIC_COARSE:
+			ticks = ((vdso_ticks_t) vdso->entry[VDSO_FN_ticks])();
+			sec = ticks / (1000 / OS_TICKS_MS);
+			nsec = (ticks % (1000 / OS_TICKS_MS)) * OS_TICKS_MS * 1000000;
+			break;
+		default: {
+			syscall_args_t args = {SYS_clock_gettime, (int) clock_id, (int) tp, 0, 0};
+			return sys_call(&args);
+		}
+	}
+
+	if (tp == (struct timespec *) 0) {
+		return -1;
+	}
+	tp->tv_sec = sec;
+	tp->tv_nsec = nsec;
+	return 0;
+}
+
+int nanosleep(const struct timespec *rqtp, struct timespec *rmtp) {
+	syscall_args_t args = {SYS_nanosleep, (int) rqtp, (int) rmtp, 0, 0};
+	return sys_call(&args);
+}
+
 void _exit(int status) {
 	syscall_args_t args;
 	args.id = SYS_exit;
@@ -49,6 +100,15 @@ int wait(int *status) {
 	return sys_call(&args);
 }
 
+int waitpid(int pid, int *status, int options) {
+	syscall_args_t args;
+	args.id = SYS_waitpid;
+	args.arg0 = pid;
+	args.arg1 = (int) status;
+	args.arg2 = options;
+	return sys_call(&args);
+}
+
 int open(const char *name, int flags, ...) {
 	// 不考虑支持太多参数
 	syscall_args_t args;
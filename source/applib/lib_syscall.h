@@ -3,6 +3,7 @@
 
 #include "comm/types.h"
 #include "core/syscall.h"
+#include "core/vdso.h"
 #include "os_cfg.h"
 #include <sys/stat.h>
 
@@ -16,7 +17,53 @@ typedef struct _syscall_args_t {
 
 #define SYS_sleep 0
 
+#define SYSCALL_MODE_UNKNOWN    0       // 尚未检测
+#define SYSCALL_MODE_SYSENTER   1       // 使用 sysenter 快速进入
+#define SYSCALL_MODE_GATE       (-1)    // 不支持 sysenter, 使用调用门
+
+extern int syscall_mode;
+
+/**
+ * 检测 CPU 是否支持 sysenter/sysexit
+ */
+static inline int syscall_detect_mode(void) {
+	uint32_t eax, ebx, ecx, edx;
+	__asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+	return (edx & (1 << 11)) ? SYSCALL_MODE_SYSENTER : SYSCALL_MODE_GATE;
+}
+
+/**
+ * 经 sysenter 进入内核, 前三个参数放在寄存器中, 第四个参数压在栈顶
+ * ecx、edx 被用来传递栈和返回地址, 返回时内核已弹出第四个参数
+ */
+static inline int sys_call_sysenter(syscall_args_t *args) {
+	int ret, ecx, edx;
+	int arg3 = args->arg3;
+	__asm__ __volatile__(
+			"push %[arg3]\n\t"
+			"mov %%esp, %%ecx\n\t"
+			"mov $1f, %%edx\n\t"
+			"sysenter\n\t"
+			"1:"
+			:"=a"(ret), "=&c"(ecx), "=&d"(edx)
+			:"a"(args->id),
+	"b"(args->arg0),
+	"S"(args->arg1),
+	"D"(args->arg2),
+	[arg3]"m"(arg3)
+			:"memory"
+	);
+	return ret;
+}
+
 static inline int sys_call(syscall_args_t *args) {
+	if (syscall_mode == SYSCALL_MODE_UNKNOWN) {
+		syscall_mode = syscall_detect_mode();
+	}
+	if (syscall_mode == SYSCALL_MODE_SYSENTER) {
+		return sys_call_sysenter(args);
+	}
+
 	uint32_t addr[] = {0, SELECTOR_SYSCALL | 0};
 	int ret;
 	__asm__ __volatile__(
@@ -41,8 +88,12 @@ void msleep(int ms);
 int getpid();
 void print_msg(const char *fmt, int arg);
 int fork();
+int vfork();
+int spawn(const char *path, char *const argv[], const int *fd_map);
 int execve(const char *path, char *const argv[], char *const envp[]);
 void yield();
+int clock_gettime(clockid_t clock_id, struct timespec *tp);
+int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
 
 // 文件操作
 int open(const char *name, int flags, ...);
@@ -60,6 +111,7 @@ int dup(int fd);
 
 void _exit(int status);
 int wait(int *status);
+int waitpid(int pid, int *status, int options);
 
 struct dirent {
 	int index;
@@ -18,9 +18,18 @@ typedef struct _boot_info_t {
 		uint32_t size;
 	} ram_region_cfg[BOOT_RAM_REGION_MAX];
 	int ram_region_count;
+
+	// 引导程序加载的内存盘映像, 大小为 0 表示没有
+	uint32_t ramdisk_start;
+	uint32_t ramdisk_size;
 } boot_info_t;
 
 #define SECTOR_SIZE        512            // 磁盘扇区大小
 #define SYS_KERNEL_LOAD_ADDR        (1024*1024)        // 内核加载的起始地址
 
+// 内存盘映像在磁盘上的位置, 扇区数为 0 时不加载
+#define RAMDISK_IMAGE_SECTOR        10240
+#define RAMDISK_IMAGE_SECTORS       0
+#define RAMDISK_LOAD_ADDR           (32*1024*1024)     // 映像加载的物理地址, 内核不会将其分配出去
+
 #endif // OS_BOOT_INFO_H
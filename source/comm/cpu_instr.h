@@ -26,6 +26,38 @@ static inline void outw(uint16_t port, uint16_t data) {
 	__asm__ __volatile__("out %[v], %[p]" : : [p]"d" (port), [v]"a" (data));
 }
 
+static inline uint32_t inl(uint16_t port) {
+	uint32_t rv;
+	__asm__ __volatile__("inl %[p], %[v]" : [v]"=a"(rv) : [p]"d"(port));
+	return rv;
+}
+
+static inline void outl(uint16_t port, uint32_t data) {
+	__asm__ __volatile__("outl %[v], %[p]" : : [p]"d"(port), [v]"a"(data));
+}
+
+/**
+ * 从端口连续读取 count 个字到 buf, 由 CPU 完成循环, 比逐个 inw 快
+ */
+static inline void insw(uint16_t port, void *buf, uint32_t count) {
+	__asm__ __volatile__("cld; rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void *buf, uint32_t count) {
+	__asm__ __volatile__("cld; rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+/**
+ * 以 32 位为单位连续读写, 要求设备的端口支持 32 位访问
+ */
+static inline void insl(uint16_t port, void *buf, uint32_t count) {
+	__asm__ __volatile__("cld; rep insl" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsl(uint16_t port, const void *buf, uint32_t count) {
+	__asm__ __volatile__("cld; rep outsl" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
 static inline void cli() {
 	__asm__ __volatile__("cli");
 }
@@ -115,6 +147,12 @@ static inline void write_tr(uint16_t tss_selector) {
 	__asm__ __volatile__("ltr %%ax"::"a"(tss_selector));
 }
 
+static inline uint16_t read_tr(void) {
+	uint16_t tss_selector;
+	__asm__ __volatile__("str %%ax":"=a"(tss_selector));
+	return tss_selector;
+}
+
 static inline uint32_t read_eflags() {
 	uint32_t eflags;
 	__asm__ __volatile__("pushf\n\tpop %%eax":"=a"(eflags));
@@ -125,4 +163,47 @@ static inline void write_eflags(uint32_t eflags) {
 	__asm__ __volatile__("push %%eax\n\tpopf"::"a"(eflags));
 }
 
+/**
+ * 原子地将 v 加到 *addr 上, 返回相加前的值
+ */
+static inline uint32_t atomic_xadd(volatile uint32_t *addr, uint32_t v) {
+	__asm__ __volatile__("lock xaddl %[v], %[m]" : [v]"+r"(v), [m]"+m"(*addr) : : "memory");
+	return v;
+}
+
+static inline void cpu_pause(void) {
+	__asm__ __volatile__("pause" : : : "memory");
+}
+
+static inline void barrier(void) {
+	__asm__ __volatile__("" : : : "memory");
+}
+
+/**
+ * 完整的内存屏障, 之前的写在之后的读之前对其它处理器和设备可见
+ */
+static inline void mb(void) {
+	__asm__ __volatile__("lock; addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+	__asm__ __volatile__("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf));
+}
+
+static inline uint64_t read_msr(uint32_t msr) {
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+static inline void write_msr(uint32_t msr, uint64_t v) {
+	__asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t) v), "d"((uint32_t) (v >> 32)));
+}
+
+static inline uint64_t rdtsc(void) {
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
 #endif
@@ -22,5 +22,15 @@ typedef unsigned short uint16_t;
 typedef unsigned long uint32_t;
 #endif
 
+#ifndef _UINT64_T_DECLARED
+#define _UINT64_T_DECLARED
+typedef unsigned long long uint64_t;
+#endif
+
+#ifndef _INT32_T_DECLARED
+#define _INT32_T_DECLARED
+typedef long int32_t;
+#endif
+
 #endif
 
@@ -0,0 +1,60 @@
+/**
+ * 进程凭证
+ */
+#include "core/cred.h"
+#include "ipc/spinlock.h"
+#include "tools/klib.h"
+
+static cred_t cred_pool[CRED_POOL_SIZE];
+static list_t free_list;
+static spinlock_t cred_lock = SPINLOCK_INIT("cred");   // 保护空闲链表和引用计数
+static cred_t *root_cred;
+
+void cred_init(void) {
+	list_init(&free_list);
+	for (int i = 0; i < CRED_POOL_SIZE; i++) {
+		list_push_back(&free_list, &cred_pool[i].node);
+	}
+
+	root_cred = cred_alloc(CRED_ROOT_ID, CRED_ROOT_ID);
+}
+
+/**
+ * 超级用户的凭证, 内核任务和第一个进程使用
+ */
+cred_t *cred_root(void) {
+	return root_cred;
+}
+
+/**
+ * 创建新的凭证, 引用计数为 1
+ */
+cred_t *cred_alloc(int uid, int gid) {
+	spin_lock(&cred_lock);
+	list_node_t *node = list_pop_front(&free_list);
+	spin_unlock(&cred_lock);
+	if (node == (list_node_t *) 0) {
+		return (cred_t *) 0;
+	}
+
+	cred_t *cred = list_node_parent(node, cred_t, node);
+	cred->ref = 1;
+	cred->uid = cred->euid = uid;
+	cred->gid = cred->egid = gid;
+	return cred;
+}
+
+cred_t *cred_get(cred_t *cred) {
+	spin_lock(&cred_lock);
+	cred->ref++;
+	spin_unlock(&cred_lock);
+	return cred;
+}
+
+void cred_put(cred_t *cred) {
+	spin_lock(&cred_lock);
+	if (--cred->ref == 0) {
+		list_push_back(&free_list, &cred->node);
+	}
+	spin_unlock(&cred_lock);
+}
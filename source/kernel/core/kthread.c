@@ -0,0 +1,111 @@
+/**
+ * 内核线程
+ * 线程使用 tss_init 分配的内核栈页运行, 页表直接使用内核页表
+ * 线程函数返回后进入僵尸状态, 由 init 进程回收
+ */
+#include "core/kthread.h"
+#include "core/task.h"
+#include "ipc/spinlock.h"
+#include "tools/log.h"
+
+static spinlock_t kthread_lock = SPINLOCK_INIT("kthread");
+
+/**
+ * 内核线程入口, 参数由 kthread_create 预先写在栈上
+ */
+static void kthread_entry(kthread_fn_t fn, void *arg) {
+	int status = fn(arg);
+	kthread_exit(status);
+}
+
+/**
+ * 分配并初始化内核线程, 由调用者启动
+ */
+static task_t *kthread_alloc(kthread_fn_t fn, void *arg, const char *name) {
+	task_t *task = alloc_task();
+	if (task == (task_t *) 0) {
+		log_printf("kthread: no free task for %s", name);
+		return (task_t *) 0;
+	}
+
+	int err = task_init(task, name, TASK_FLAG_SYSTEM, (uint32_t) kthread_entry, 0, 0);
+	if (err < 0) {
+		free_task(task);
+		return (task_t *) 0;
+	}
+
+	// 内核态运行时不发生特权级切换, esp0 对应的页直接作为线程栈
+	// 栈顶依次为: 伪返回地址、fn、arg, 与 cdecl 调用约定一致
+	uint32_t *stack = (uint32_t *) task->tss.esp0;
+	*(--stack) = (uint32_t) arg;
+	*(--stack) = (uint32_t) fn;
+	*(--stack) = 0;
+	task->tss.esp = (uint32_t) stack;
+	return task;
+}
+
+/**
+ * 创建内核线程, 创建后即可被调度运行
+ */
+task_t *kthread_create(kthread_fn_t fn, void *arg, const char *name) {
+	task_t *task = kthread_alloc(fn, arg, name);
+	if (task) {
+		task_start(task);
+	}
+	return task;
+}
+
+/**
+ * 创建只在指定 CPU 上运行的内核线程
+ */
+task_t *kthread_create_on(kthread_fn_t fn, void *arg, const char *name, int cpu) {
+	task_t *task = kthread_alloc(fn, arg, name);
+	if (task) {
+		task_start_on(task, cpu);
+	}
+	return task;
+}
+
+/**
+ * 当前内核线程休眠, 直到被 kthread_wakeup 唤醒
+ * 如果在休眠前已经有唤醒请求, 则直接返回, 不会丢失唤醒
+ */
+void kthread_park(void) {
+	irq_state_t state = spin_lock_irqsave(&kthread_lock);
+
+	task_t *current = task_current();
+	if (!current->wakeup_pending) {
+		task_set_block(current);
+		current->state = TASK_PARKED;
+		spin_unlock(&kthread_lock);
+
+		task_dispatch();
+		spin_lock(&kthread_lock);
+	}
+	current->wakeup_pending = 0;
+
+	spin_unlock_irqrestore(&kthread_lock, state);
+}
+
+/**
+ * 唤醒内核线程, 可以在中断处理中调用
+ */
+void kthread_wakeup(task_t *task) {
+	irq_state_t state = spin_lock_irqsave(&kthread_lock);
+
+	if (task->state == TASK_PARKED) {
+		task_set_ready(task);
+	} else {
+		task->wakeup_pending = 1;
+	}
+
+	spin_unlock_irqrestore(&kthread_lock, state);
+}
+
+/**
+ * 内核线程退出, 挂到 init 进程下等待回收
+ */
+void kthread_exit(int status) {
+	task_add_child(task_first_task(), task_current());
+	sys_exit(status);
+}
@@ -4,7 +4,9 @@
 #include "tools/klib.h"
 #include "tools/log.h"
 #include "core/memory.h"
+#include "core/vdso.h"
 #include "cpu/mmu.h"
+#include "ipc/spinlock.h"
 #include "dev/console.h"
 
 static addr_alloc_t paddr_alloc;        // 物理地址分配结构
@@ -147,6 +149,9 @@ void create_kernel_table(void) {
 			{s_text,                     e_text,                        s_text, 0},                         // 内核代码区
 			{s_data,                     (void *) (MEM_EBDA_START - 1), s_data,                     PTE_W},     // 内核数据区
 			{(void *) CONSOLE_DISP_ADDR, (void *) CONSOLE_DISP_END,     (void *) CONSOLE_DISP_ADDR, PTE_W}, // 显存区
+			// EBDA 及 BIOS ROM 只读映射，用于查找 MP/ACPI 表
+			{(void *) MEM_EBDA_START,    (void *) (MEM_EBDA_END - 1),    (void *) MEM_EBDA_START,    0},
+			{(void *) MEM_BIOS_START,    (void *) (MEM_BIOS_END - 1),   (void *) MEM_BIOS_START,    0},
 			// 扩展存储空间一一映射，方便直接操作
 			{(void *) MEM_EXT_START,     (void *) MEM_EXT_END,          (void *) MEM_EXT_START,     PTE_W},
 	};
@@ -166,6 +171,38 @@ void create_kernel_table(void) {
 
 		memory_create_map(kernel_page_dir, vstart, (uint32_t) map->pstart, page_count, map->perm);
 	}
+
+	// 预先建好设备映射窗口的页表，之后创建的映射对所有进程可见
+	for (uint32_t vaddr = MEM_MMIO_START; vaddr < MEM_MMIO_END; vaddr += MEM_PAGE_SIZE * PTE_CNT) {
+		find_pte(kernel_page_dir, vaddr, 1);
+	}
+}
+
+/**
+ * @brief 将设备寄存器所在的物理地址映射到内核空间，返回对应的虚拟地址
+ * 映射区域只增不减，不支持释放
+ */
+uint32_t memory_map_mmio(uint32_t paddr, uint32_t size) {
+	static uint32_t mmio_next = MEM_MMIO_START;
+	static spinlock_t mmio_lock = SPINLOCK_INIT("mmio");
+
+	uint32_t pstart = down2(paddr, MEM_PAGE_SIZE);
+	int page_count = (up2(paddr + size, MEM_PAGE_SIZE) - pstart) / MEM_PAGE_SIZE;
+	spin_lock(&mmio_lock);
+	if (mmio_next + page_count * MEM_PAGE_SIZE > MEM_MMIO_END) {
+		spin_unlock(&mmio_lock);
+		log_printf("mmio window exhausted");
+		return 0;
+	}
+	uint32_t vstart = mmio_next;
+	mmio_next += page_count * MEM_PAGE_SIZE;
+	spin_unlock(&mmio_lock);
+
+	int err = memory_create_map(kernel_page_dir, vstart, pstart, page_count, PTE_W | PTE_PCD | PTE_PWT);
+	if (err < 0) {
+		return 0;
+	}
+	return vstart + (paddr - pstart);
 }
 
 /**
@@ -186,6 +223,11 @@ uint32_t memory_create_uvm(void) {
 		page_dir[i].v = kernel_page_dir[i].v;
 	}
 
+	if (vdso_map((uint32_t) page_dir) < 0) {
+		memory_destroy_uvm((uint32_t) page_dir);
+		return 0;
+	}
+
 	return (uint32_t) page_dir;
 }
 
@@ -215,6 +257,19 @@ void memory_init(boot_info_t *boot_info) {
 	addr_alloc_init(&paddr_alloc, mem_free, MEM_EXT_START, mem_up1MB_free, MEM_PAGE_SIZE);
 	mem_free += bitmap_byte_count(paddr_alloc.size / MEM_PAGE_SIZE);
 
+	// 引导程序加载的内存盘映像由内存盘直接使用
+	if (boot_info->ramdisk_size) {
+		uint32_t start = boot_info->ramdisk_start;
+		uint32_t end = up2(start + boot_info->ramdisk_size, MEM_PAGE_SIZE);
+		if ((start >= MEM_EXT_START) && (end <= MEM_EXT_START + mem_up1MB_free)) {
+			bitmap_set_bit(&paddr_alloc.bitmap, (start - MEM_EXT_START) / MEM_PAGE_SIZE,
+			               (end - start) / MEM_PAGE_SIZE, 1);
+		} else {
+			log_printf("ramdisk image out of memory range, ignored\n");
+			boot_info->ramdisk_size = 0;
+		}
+	}
+
 	// 到这里，mem_free应该比EBDA地址要小
 	ASSERT(mem_free < (uint8_t *) MEM_EBDA_START);
 
@@ -264,6 +319,13 @@ int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size,
 	return 0;
 }
 
+/**
+ * @brief 内核页目录表, 内核线程直接使用
+ */
+uint32_t memory_kernel_page_dir(void) {
+	return (uint32_t) kernel_page_dir;
+}
+
 /**
  * @brief 分配一页内存
  */
@@ -271,6 +333,13 @@ uint32_t memory_alloc_page() {
 	return addr_alloc_page(&paddr_alloc, 1);
 }
 
+/**
+ * @brief 分配物理连续的多页内存, 供设备 DMA 使用
+ */
+uint32_t memory_alloc_pages(int count) {
+	return addr_alloc_page(&paddr_alloc, count);
+}
+
 static pde_t *curr_page_dir() {
 	return (pde_t *) (task_current()->tss.cr3);
 }
@@ -289,7 +358,11 @@ void memory_free_page(uint32_t addr) {
 	}
 }
 
-int memory_copy_uvm(uint32_t page_dir) {
+/**
+ * @brief 复制进程的地址空间, 失败时返回 0
+ * 共享页由 memory_create_uvm 重新映射, 不复制
+ */
+uint32_t memory_copy_uvm(uint32_t page_dir) {
 	uint32_t new_page_dir = memory_create_uvm();
 	if (new_page_dir == 0) {
 		goto copy_uvm_failed;
@@ -298,7 +371,7 @@ int memory_copy_uvm(uint32_t page_dir) {
 	uint32_t user_pde_start = pde_index(MEMORY_TASK_BASE);
 	pde_t *pde = (pde_t *) page_dir + user_pde_start;
 	for (int i = user_pde_start; i < PDE_CNT; i++, pde++) {
-		if (!pde->present) {
+		if (!pde->present || (i == pde_index(VDSO_BASE))) {
 			continue;
 		}
 		pte_t *pte = (pte_t *) pde_paddr(pde);
@@ -325,7 +398,7 @@ copy_uvm_failed:
 	if (new_page_dir != 0) {
 		memory_destroy_uvm(new_page_dir);
 	}
-	return -1;
+	return 0;
 }
 
 void memory_destroy_uvm(uint32_t page_dir) {
@@ -335,6 +408,10 @@ void memory_destroy_uvm(uint32_t page_dir) {
 		if (!pde->present) {
 			continue;
 		}
+		if (i == pde_index(VDSO_BASE)) {
+			vdso_unmap(page_dir);
+			continue;
+		}
 		pte_t *pte = (pte_t *) pde_paddr(pde);
 		for (int j = 0; j < PTE_CNT; ++j, pte++) {
 			if (!pte->present) {
@@ -361,6 +438,27 @@ uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr) {
 	return pte_paddr(pte) + (vaddr & (MEM_PAGE_SIZE - 1));
 }
 
+/**
+ * 设备 DMA 用: 缓冲区地址转换为物理地址, 内核空间为一一映射, 进程空间查当前进程的页表
+ * 页不存在时返回 0
+ */
+uint32_t memory_buf_paddr(uint32_t vaddr) {
+	if (vaddr < MEMORY_TASK_BASE) {
+		return vaddr;
+	}
+
+	task_t *task = task_current();
+	if (task == (task_t *) 0) {
+		return 0;
+	}
+
+	pte_t *pte = find_pte((pde_t *) task->tss.cr3, vaddr, 0);
+	if ((pte == (pte_t *) 0) || !pte->present) {
+		return 0;
+	}
+	return pte_paddr(pte) + (vaddr & (MEM_PAGE_SIZE - 1));
+}
+
 /**
  * @brief 在不同的进程空间中拷贝字符串
  * page_dir为目标页表，当前仍为老页表
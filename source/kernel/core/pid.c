@@ -0,0 +1,109 @@
+/**
+ * 进程号分配与查找
+ * 用位图分配进程号, 从上次分配的位置往后找, 到头后回绕, 避免进程号被立即复用
+ * 用哈希表完成进程号到任务的映射, 按 pid 查找为 O(1)
+ */
+#include "core/pid.h"
+#include "tools/bitmap.h"
+#include "tools/list.h"
+#include "ipc/spinlock.h"
+
+static uint8_t pid_bits[PID_MAX / 8];       // 进程号位图
+static bitmap_t pid_bitmap;
+static int last_pid;                        // 上次分配的进程号
+static list_t pid_hash[PID_HASH_SIZE];      // 进程号哈希表
+static spinlock_t pid_lock;                 // 不在中断中使用, 无需关中断
+
+static inline list_t *pid_bucket(int pid) {
+	return pid_hash + (pid & (PID_HASH_SIZE - 1));
+}
+
+/**
+ * 初始化进程号分配器
+ */
+void pid_init(void) {
+	spinlock_init(&pid_lock, "pid");
+	bitmap_init(&pid_bitmap, pid_bits, PID_MAX, 0);
+
+	// 0 号保留不分配
+	bitmap_set_bit(&pid_bitmap, 0, PID_FIRST, 1);
+	last_pid = PID_FIRST - 1;
+
+	for (int i = 0; i < PID_HASH_SIZE; i++) {
+		list_init(pid_hash + i);
+	}
+}
+
+/**
+ * 分配一个进程号，失败返回 -1
+ */
+int pid_alloc(void) {
+	spin_lock(&pid_lock);
+
+	int pid = bitmap_find_next(&pid_bitmap, 0, last_pid + 1);
+	if (pid < 0) {
+		// 回绕到开头继续查找
+		pid = bitmap_find_next(&pid_bitmap, 0, PID_FIRST);
+	}
+
+	if (pid >= 0) {
+		bitmap_set_bit(&pid_bitmap, pid, 1, 1);
+		last_pid = pid;
+	}
+
+	spin_unlock(&pid_lock);
+	return pid;
+}
+
+/**
+ * 释放进程号
+ */
+void pid_free(int pid) {
+	if (pid < PID_FIRST || pid >= PID_MAX) {
+		return;
+	}
+
+	spin_lock(&pid_lock);
+	bitmap_set_bit(&pid_bitmap, pid, 1, 0);
+	spin_unlock(&pid_lock);
+}
+
+/**
+ * 将任务加入进程号哈希表
+ */
+void pid_hash_add(task_t *task) {
+	spin_lock(&pid_lock);
+	list_push_back(pid_bucket(task->pid), &task->pid_node);
+	spin_unlock(&pid_lock);
+}
+
+/**
+ * 将任务从进程号哈希表中移除
+ */
+void pid_hash_del(task_t *task) {
+	spin_lock(&pid_lock);
+	list_ease(pid_bucket(task->pid), &task->pid_node);
+	spin_unlock(&pid_lock);
+}
+
+/**
+ * 根据进程号查找任务，找不到返回 0
+ */
+task_t *pid_find_task(int pid) {
+	if (pid < PID_FIRST || pid >= PID_MAX) {
+		return (task_t *) 0;
+	}
+
+	spin_lock(&pid_lock);
+	list_node_t *node = list_first(pid_bucket(pid));
+	while (node) {
+		task_t *task = list_node_parent(node, task_t, pid_node);
+		if (task->pid == pid) {
+			spin_unlock(&pid_lock);
+			return task;
+		}
+		node = list_node_next(node);
+	}
+	spin_unlock(&pid_lock);
+	return (task_t *) 0;
+}
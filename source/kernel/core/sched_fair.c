@@ -0,0 +1,199 @@
+/**
+ * 公平调度类
+ * 以下函数均要求调用者已持有就绪队列的锁
+ * 每个任务按权重累计虚拟运行时间, 总是选择虚拟运行时间最小的任务运行
+ * 时间片由调度周期按权重分摊, 就绪任务越多时间片越短, 但不小于最小粒度
+ */
+#include "core/sched.h"
+#include "core/task.h"
+#include "tools/klib.h"
+
+// nice 值 -20 ~ 19 对应的权重, 相邻级别约相差 1.25 倍
+static const uint32_t nice_to_weight[] = {
+		88761, 71755, 56483, 46273, 36291,
+		29154, 23254, 18705, 14949, 11916,
+		9548, 7620, 6100, 4904, 3906,
+		3121, 2501, 1991, 1586, 1277,
+		1024, 820, 655, 526, 423,
+		335, 272, 215, 172, 137,
+		110, 87, 70, 56, 45,
+		36, 29, 23, 18, 15,
+};
+
+/**
+ * 比较虚拟运行时间, 用差值的符号判断以容忍回绕
+ */
+static inline int vruntime_before(uint32_t a, uint32_t b) {
+	return (int32_t) (a - b) < 0;
+}
+
+static int task_vruntime_less(rb_node_t *a, rb_node_t *b) {
+	task_t *ta = rb_node_parent(a, task_t, sched_node);
+	task_t *tb = rb_node_parent(b, task_t, sched_node);
+	return vruntime_before(ta->vruntime, tb->vruntime);
+}
+
+/**
+ * 将实际运行时间换算为虚拟运行时间, 权重越大增长越慢
+ */
+static uint32_t calc_delta_vruntime(uint32_t delta_us, uint32_t weight) {
+	if (weight == SCHED_NICE_0_WEIGHT) {
+		return delta_us;
+	}
+	return delta_us * SCHED_NICE_0_WEIGHT / weight;
+}
+
+static void update_min_vruntime(sched_rq_t *rq) {
+	rb_node_t *node = rb_first(&rq->tree);
+	if (node) {
+		task_t *task = rb_node_parent(node, task_t, sched_node);
+		if (vruntime_before(rq->min_vruntime, task->vruntime)) {
+			rq->min_vruntime = task->vruntime;
+		}
+	}
+}
+
+/**
+ * 调度周期: 任务较多时按最小粒度拉长, 保证每个任务都能运行到
+ */
+static uint32_t sched_period_ms(int nr_running) {
+	uint32_t period = SCHED_LATENCY_MS;
+	if (nr_running * SCHED_MIN_GRANULARITY_MS > period) {
+		period = nr_running * SCHED_MIN_GRANULARITY_MS;
+	}
+	return period;
+}
+
+static uint32_t sched_slice_ms(sched_rq_t *rq, task_t *task) {
+	int nr_running = sched_rq_count(rq);
+	uint32_t load = rq->load_weight;
+	if (!task->on_rq) {
+		nr_running++;
+		load += task->weight;
+	}
+
+	return sched_period_ms(nr_running) * task->weight / load;
+}
+
+void sched_rq_init(sched_rq_t *rq) {
+	spinlock_init(&rq->lock, "rq");
+	rb_tree_init(&rq->tree);
+	rq->min_vruntime = 0;
+	rq->load_weight = 0;
+}
+
+/**
+ * 任务进入就绪队列
+ * 长时间睡眠的任务最多只补偿半个调度周期, 避免醒来后长期独占 CPU
+ */
+void sched_fair_enqueue(sched_rq_t *rq, task_t *task) {
+	if (task->on_rq) {
+		return;
+	}
+
+	uint32_t min_vruntime = rq->min_vruntime - SCHED_LATENCY_MS * 1000 / 2;
+	if (vruntime_before(task->vruntime, min_vruntime)) {
+		task->vruntime = min_vruntime;
+	}
+
+	rb_insert(&rq->tree, &task->sched_node, task_vruntime_less);
+	rq->load_weight += task->weight;
+	task->on_rq = 1;
+	update_min_vruntime(rq);
+}
+
+void sched_fair_dequeue(sched_rq_t *rq, task_t *task) {
+	if (!task->on_rq) {
+		return;
+	}
+
+	rb_erase(&rq->tree, &task->sched_node);
+	rq->load_weight -= task->weight;
+	task->on_rq = 0;
+	update_min_vruntime(rq);
+}
+
+task_t *sched_fair_pick_next(sched_rq_t *rq) {
+	rb_node_t *node = rb_first(&rq->tree);
+	return rb_node_parent(node, task_t, sched_node);
+}
+
+/**
+ * 新任务从队列当前最小值之后开始, 并预先记上一个时间片
+ * 防止不断 fork 的任务抢占已有任务的运行时间
+ */
+void sched_fair_task_new(sched_rq_t *rq, task_t *task) {
+	uint32_t slice_us = sched_slice_ms(rq, task) * 1000;
+	task->vruntime = rq->min_vruntime + calc_delta_vruntime(slice_us, task->weight);
+	sched_fair_enqueue(rq, task);
+}
+
+/**
+ * 时钟节拍到来时累计当前任务的运行时间
+ * 返回非 0 表示需要重新调度
+ */
+int sched_fair_task_tick(sched_rq_t *rq, task_t *task) {
+	uint32_t delta = calc_delta_vruntime(OS_TICKS_MS * 1000, task->weight);
+	if (task->on_rq) {
+		rb_erase(&rq->tree, &task->sched_node);
+		task->vruntime += delta;
+		rb_insert(&rq->tree, &task->sched_node, task_vruntime_less);
+		update_min_vruntime(rq);
+	} else {
+		task->vruntime += delta;
+	}
+
+	if (--task->slice_ticks <= 0) {
+		return 1;
+	}
+
+	// 时间片未用完, 但别的任务已经落后足够多时也让出
+	task_t *first = sched_fair_pick_next(rq);
+	if (first && first != task) {
+		return (int32_t) (task->vruntime - first->vruntime) > SCHED_WAKEUP_GRANULARITY_US;
+	}
+	return 0;
+}
+
+/**
+ * 主动让出: 排到队列中所有任务之后
+ */
+void sched_fair_yield(sched_rq_t *rq, task_t *task) {
+	rb_node_t *last = rb_last(&rq->tree);
+	if (!task->on_rq || last == &task->sched_node) {
+		return;
+	}
+
+	rb_erase(&rq->tree, &task->sched_node);
+	task->vruntime = rb_node_parent(last, task_t, sched_node)->vruntime;
+	rb_insert(&rq->tree, &task->sched_node, task_vruntime_less);
+	update_min_vruntime(rq);
+}
+
+/**
+ * 被唤醒的任务是否应当抢占当前任务
+ * 领先不足唤醒粒度时不抢占, 避免频繁唤醒带来无谓的切换
+ */
+int sched_fair_wakeup_preempt(sched_rq_t *rq, task_t *curr, task_t *task) {
+	return (int32_t) (curr->vruntime - task->vruntime) > SCHED_WAKEUP_GRANULARITY_US;
+}
+
+/**
+ * 任务被选中运行时可用的时钟节拍数
+ */
+int sched_fair_slice(sched_rq_t *rq, task_t *task) {
+	int ticks = sched_slice_ms(rq, task) / OS_TICKS_MS;
+	return ticks > 0 ? ticks : 1;
+}
+
+/**
+ * 设置任务权重, 须在任务不在就绪队列中时调用
+ */
+void sched_set_nice(task_t *task, int nice) {
+	if (nice < SCHED_NICE_MIN) {
+		nice = SCHED_NICE_MIN;
+	} else if (nice > SCHED_NICE_MAX) {
+		nice = SCHED_NICE_MAX;
+	}
+	task->weight = nice_to_weight[nice - SCHED_NICE_MIN];
+}
@@ -0,0 +1,132 @@
+/**
+ * 中断下半部
+ *
+ * 待处理的软中断记录在各 CPU 自己的位图中, 只在登记它的 CPU 上执行.
+ * 每个 CPU 有自己的 ksoftirqd 处理积压的软中断.
+ * 执行期间抢占计数加 1: 嵌套的中断只登记不执行, 软中断处理函数中唤醒任务也不会立即切换,
+ * 要等处理完后由调用者统一补做调度
+ */
+#include "core/softirq.h"
+#include "core/kthread.h"
+#include "cpu/smp.h"
+#include "cpu/irq.h"
+#include "comm/cpu_instr.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static softirq_handler_t softirq_table[SOFTIRQ_NR];
+
+void softirq_register(int nr, softirq_handler_t handler) {
+	softirq_table[nr] = handler;
+}
+
+/**
+ * 登记软中断, 调用者已关中断
+ */
+void softirq_raise(int nr) {
+	cpu_this()->softirq_pending |= 1 << nr;
+}
+
+/**
+ * 执行当前 CPU 上登记的软中断, 调用者不能持有锁
+ */
+void softirq_do_pending(void) {
+	irq_state_t state = irq_enter_protection();
+	cpu_t *cpu = cpu_this();
+	if ((cpu->softirq_pending == 0) || (cpu->preempt_count > 0)) {
+		irq_leave_protection(state);
+		return;
+	}
+
+	cpu->preempt_count++;
+	for (int restart = 0; cpu->softirq_pending && (restart < SOFTIRQ_RESTART_MAX); restart++) {
+		uint32_t pending = cpu->softirq_pending;
+		cpu->softirq_pending = 0;
+
+		irq_enable_global();
+		for (int nr = 0; pending; nr++, pending >>= 1) {
+			if ((pending & 1) && softirq_table[nr]) {
+				softirq_table[nr]();
+			}
+		}
+		irq_disable_global();
+	}
+	cpu->preempt_count--;
+
+	// 中断过于频繁, 剩下的交给线程, 以免用户任务一直得不到运行
+	if (cpu->softirq_pending && cpu->ksoftirqd) {
+		kthread_wakeup(cpu->ksoftirqd);
+	}
+	irq_leave_protection(state);
+}
+
+static int ksoftirqd_main(void *arg) {
+	while (1) {
+		kthread_park();
+		softirq_do_pending();
+	}
+	return 0;
+}
+
+void tasklet_init(tasklet_t *tasklet, void (*func)(void *data), void *data) {
+	list_node_init(&tasklet->node);
+	tasklet->func = func;
+	tasklet->data = data;
+	tasklet->scheduled = 0;
+}
+
+/**
+ * 调度小任务在当前 CPU 上执行, 可以在中断处理中调用
+ */
+void tasklet_schedule(tasklet_t *tasklet) {
+	irq_state_t state = irq_enter_protection();
+	if (!tasklet->scheduled) {
+		tasklet->scheduled = 1;
+		list_push_back(&cpu_this()->tasklet_list, &tasklet->node);
+		softirq_raise(SOFTIRQ_TASKLET);
+	}
+	irq_leave_protection(state);
+}
+
+/**
+ * 执行本轮开始时已调度的小任务, 执行期间再调度的留到下一轮
+ */
+static void tasklet_action(void) {
+	cpu_t *cpu = cpu_this();
+
+	irq_state_t state = irq_enter_protection();
+	int count = list_count(&cpu->tasklet_list);
+	irq_leave_protection(state);
+
+	while (count-- > 0) {
+		state = irq_enter_protection();
+		tasklet_t *tasklet = list_node_parent(list_pop_front(&cpu->tasklet_list), tasklet_t, node);
+		tasklet->scheduled = 0;
+		irq_leave_protection(state);
+
+		tasklet->func(tasklet->data);
+	}
+}
+
+/**
+ * 为 CPU 创建自己的 ksoftirqd, 它只执行所在 CPU 上登记的软中断
+ */
+void softirq_cpu_init(int id) {
+	char name[TASK_NAME_SIZE];
+	kernel_sprintf(name, "ksoftirqd/%d", id);
+
+	cpu_t *cpu = cpu_get(id);
+	cpu->ksoftirqd = kthread_create_on(ksoftirqd_main, (void *) 0, name, id);
+	if (cpu->ksoftirqd == (task_t *) 0) {
+		log_printf("cpu %d: create ksoftirqd failed", id);
+	}
+}
+
+/**
+ * 在任务管理器初始化之后调用
+ */
+void softirq_init(void) {
+	list_init(&cpu_this()->tasklet_list);
+	softirq_register(SOFTIRQ_TASKLET, tasklet_action);
+	softirq_cpu_init(cpu_this()->id);
+}
@@ -4,6 +4,7 @@
 #include "tools/log.h"
 #include "fs/fs.h"
 #include "core/memory.h"
+#include "dev/time.h"
 
 void sys_print_msg(const char *fmt, int arg) {
 	log_printf(fmt, arg);
@@ -18,6 +19,11 @@ static const syscall_handler_t sys_table[] = {
 		[SYS_yield] = (syscall_handler_t) sys_yield,
 		[SYS_exit] = (syscall_handler_t) sys_exit,
 		[SYS_wait] = (syscall_handler_t) sys_wait,
+		[SYS_waitpid] = (syscall_handler_t) sys_waitpid,
+		[SYS_vfork] = (syscall_handler_t) sys_vfork,
+		[SYS_spawn] = (syscall_handler_t) sys_spawn,
+		[SYS_clock_gettime] = (syscall_handler_t) sys_clock_gettime,
+		[SYS_nanosleep] = (syscall_handler_t) sys_nanosleep,
 
 		[SYS_open] = (syscall_handler_t) sys_open,
 		[SYS_read] = (syscall_handler_t) sys_read,
@@ -1,24 +1,27 @@
 #include "core/task.h"
 #include "core/memory.h"
 #include "core/syscall.h"
+#include "core/pid.h"
+#include "core/vdso.h"
 #include "cpu/cpu.h"
 #include "cpu/irq.h"
 #include "cpu/mmu.h"
+#include "cpu/smp.h"
+#include "ipc/wait.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 #include "comm/cpu_instr.h"
 #include "comm/elf.h"
 #include "fs/fs.h"
 #include "os_cfg.h"
+#include <sys/wait.h>
 
 static task_manager_t task_manager;
 static uint32_t idle_task_stack[IDLE_TASK_STACK_SIZE];
 static task_t task_table[TASK_NR_MAX];
 static mutex_t task_table_mutex;
-static task_t *alloc_task();
-static void free_task(task_t *task);
 
-static int tss_init(task_t *task, int flag, uint32_t entry, uint32_t esp) {
+static int tss_init(task_t *task, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir) {
 	int tss_selector = gdt_alloc_desc();
 	if (tss_selector < 0) {
 		log_printf("alloc tss selector failed");
@@ -40,8 +43,8 @@ static int tss_init(task_t *task, int flag, uint32_t entry, uint32_t esp) {
 		code_sel = KERNEL_SELECTOR_CS;
 		data_sel = KERNEL_SELECTOR_DS;
 	} else {
-		code_sel = task_manager.app_code_selector | SEG_CPL3;
-		data_sel = task_manager.app_data_selector | SEG_CPL3;
+		code_sel = APP_SELECTOR_CS | SEG_CPL3;
+		data_sel = APP_SELECTOR_DS | SEG_CPL3;
 	}
 
 	task->tss.eip = entry;
@@ -54,10 +57,14 @@ static int tss_init(task_t *task, int flag, uint32_t entry, uint32_t esp) {
 	task->tss.eflags = EFLAGS_IF | EFLAGS_DEFAULT;
 	task->tss.iomap = 0;
 
-	// 页表初始化
-	uint32_t page_dir = memory_create_uvm();
-	if (page_dir == 0) {
-		goto tss_init_failed;
+	// 页表初始化, 内核任务不访问用户空间, 直接共享内核页表; 用户任务未指定页表时新建
+	if (flag & TASK_FLAG_SYSTEM) {
+		page_dir = memory_kernel_page_dir();
+	} else if (page_dir == 0) {
+		page_dir = memory_create_uvm();
+		if (page_dir == 0) {
+			goto tss_init_failed;
+		}
 	}
 	task->tss.cr3 = page_dir;
 
@@ -75,43 +82,159 @@ tss_init_failed:
 /**
  * flag 0: 用户态
  * flag 1: 内核态
+ * page_dir: 用户任务的页表, 为 0 时新建空的地址空间; 传入的页表在初始化失败时仍归调用者
  */
-int task_init(task_t *task, const char *name, int flag, uint32_t entry, uint32_t esp) {
+int task_init(task_t *task, const char *name, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir) {
 	ASSERT(task != (task_t *) (0));
 
-	tss_init(task, flag, entry, esp);
+	int pid = pid_alloc();
+	if (pid < 0) {
+		log_printf("alloc pid failed");
+		return -1;
+	}
+
+	// 内核任务不打开文件
+	fdtable_t *files = (fdtable_t *) 0;
+	if (!(flag & TASK_FLAG_SYSTEM)) {
+		files = fdtable_alloc();
+		if (files == (fdtable_t *) 0) {
+			log_printf("alloc fdtable failed");
+			pid_free(pid);
+			return -1;
+		}
+	}
+
+	if (tss_init(task, flag, entry, esp, page_dir) < 0) {
+		if (files) {
+			fdtable_free(files);
+		}
+		pid_free(pid);
+		return -1;
+	}
+
+	// 普通进程继承当前进程的凭证, 内核任务总是超级用户
+	task_t *current = task_current();
+	if ((flag & TASK_FLAG_SYSTEM) || (current == (task_t *) 0) || (current->cred == (cred_t *) 0)) {
+		task->cred = cred_get(cred_root());
+	} else {
+		task->cred = cred_get(current->cred);
+	}
+	task->files = files;
+	if (!(flag & TASK_FLAG_SYSTEM)) {
+		vdso_set_pid(task->tss.cr3, pid);
+	}
 
 	kernel_strncpy(task->name, name, TASK_NAME_SIZE);
 	task->state = TASK_CREATED;
+	task->flags = flag;
+	task->cpu = 0;
 	task->parent = (task_t *) 0;
 	task->heap_start = task->heap_end = 0;
 	task->sleep_ticks = 0;
-	task->time_ticks = TASK_TIME_SLICE_DEFAULT;
-	task->slice_ticks = TASK_TIME_SLICE_DEFAULT;
+	task->slice_ticks = 0;
+	task->vruntime = 0;
+	task->on_rq = 0;
+	sched_set_nice(task, 0);
 	task->status = 0;
+	task->wakeup_pending = 0;
+	task->wait_queue = (struct _wait_queue_t *) 0;
+	task->wait_flags = 0;
+	task->wait_result = 0;
+	task->wait_ticks = 0;
 	list_node_init(&task->run_node);
 	list_node_init(&task->wait_node);
+	list_node_init(&task->timeout_node);
+	task->vfork_parent = (task_t *) 0;
+	wait_queue_init(&task->vfork_wait, "vfork");
 	list_node_init(&task->all_node);
+	list_node_init(&task->pid_node);
+	list_node_init(&task->child_node);
+	list_init(&task->child_list);
+	list_init(&task->zombie_list);
 
-	kernel_memset(&task->file_table, 0, sizeof(task->file_table));
-
-	irq_state_t state = irq_enter_protection();
-	task->pid = (uint32_t) task;
+	task->pid = pid;
+	pid_hash_add(task);
 
+	spin_lock(&task_manager.lock);
 	list_push_back(&task_manager.task_list, &task->all_node);
-	irq_leave_protection(state);
+	spin_unlock(&task_manager.lock);
 	return 0;
 }
 
+/**
+ * 任务所在的就绪队列
+ * 任务启动时选定 CPU, 之后一直留在上面: 硬件任务切换在保存旧任务状态前就清除了 TSS 的忙标志,
+ * 其它 CPU 无法判断它是否已完全切换出去, 迁移后可能在状态保存完之前就切换进来
+ */
+static sched_rq_t *task_rq(task_t *task) {
+	return &cpu_get(task->cpu)->rq;
+}
+
+/**
+ * 为新任务选择就绪任务最少的在线 CPU, 相同时优先当前 CPU
+ */
+static int task_select_cpu(void) {
+	cpu_t *best = cpu_this();
+	for (int i = 0; i < smp_cpu_count(); i++) {
+		cpu_t *cpu = cpu_get(i);
+		if (cpu->online && (sched_rq_count(&cpu->rq) < sched_rq_count(&best->rq))) {
+			best = cpu;
+		}
+	}
+	return best->id;
+}
+
+/**
+ * 任务在所在 CPU 空闲时加入就绪队列, 需要让那个 CPU 立即调度
+ * 调用者持有就绪队列的锁, 返回的 CPU 在释放锁后用 smp_send_resched 通知
+ */
+static cpu_t *task_check_idle(task_t *task) {
+	cpu_t *cpu = cpu_get(task->cpu);
+	task_t *curr = cpu->current;
+	if (curr && (curr->flags & TASK_FLAG_IDLE)) {
+		cpu->need_resched = 1;
+		return cpu;
+	}
+	return (cpu_t *) 0;
+}
+
 void task_start(task_t *task) {
-	irq_state_t state = irq_enter_protection();
-	task_set_ready(task);
-	irq_leave_protection(state);
+	task_start_on(task, task_select_cpu());
+}
+
+/**
+ * 在指定 CPU 上启动任务, 任务此后一直在该 CPU 上运行
+ */
+void task_start_on(task_t *task, int cpu_id) {
+	task->cpu = cpu_id;
+	smp_bind_tss(task->tss_selector, cpu_id);
+	if (task->flags & TASK_FLAG_IDLE) {
+		return;
+	}
+
+	sched_rq_t *rq = task_rq(task);
+	irq_state_t state = spin_lock_irqsave(&rq->lock);
+	sched_fair_task_new(rq, task);
+	task->state = TASK_READY;
+	cpu_t *cpu = task_check_idle(task);
+	spin_unlock_irqrestore(&rq->lock, state);
+
+	if (cpu) {
+		smp_send_resched(cpu);
+	}
 }
 
 void task_uninit(task_t *task) {
 	ASSERT(task != (task_t *) 0);
 	ASSERT(task != &task_manager.idle_task);
+	ASSERT(!task->on_rq);
+
+	spin_lock(&task_manager.lock);
+	list_ease(&task_manager.task_list, &task->all_node);
+	spin_unlock(&task_manager.lock);
+
+	pid_hash_del(task);
+	pid_free(task->pid);
 
 	if (task->tss_selector) {
 		gdt_free_sel(task->tss_selector);
@@ -121,42 +244,47 @@ void task_uninit(task_t *task) {
 		memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
 	}
 
-	if (task->tss.cr3) {
+	if (task->tss.cr3 && (task->tss.cr3 != memory_kernel_page_dir())) {
 		memory_destroy_uvm(task->tss.cr3);
 	}
+
+	if (task->files) {
+		fdtable_free(task->files);
+	}
+
+	if (task->cred) {
+		cred_put(task->cred);
+	}
 	kernel_memset(task, 0, sizeof(task_t));
 }
 
 void task_switch_from_to(task_t *from, task_t *to) {
+	cpu_set_sysenter_stack(to->tss.esp0);
 	switch_to_tss(to->tss_selector);
 	// simple_switch(&from->stack, to->stack);
 }
 
 file_t *task_file(int fd) {
 	task_t *task = task_current();
-	if (fd < 0 || fd >= TASK_OFILE_NR) {
+	if (task->files == (fdtable_t *) 0) {
 		return (file_t *) 0;
 	}
-	return task->file_table[fd];
+	return fdtable_get(task->files, fd);
 }
 
 int task_alloc_fd(file_t *file) {
 	task_t *task = task_current();
-	for (int i = 0; i < TASK_OFILE_NR; ++i) {
-		if (task->file_table[i] == (file_t *) 0) {
-			task->file_table[i] = file;
-			return i;
-		}
+	if (task->files == (fdtable_t *) 0) {
+		return -1;
 	}
-	return -1;
+	return fdtable_alloc_fd(task->files, file);
 }
 
 void task_free_fd(int fd) {
 	task_t *task = task_current();
-	if (fd < 0 || fd >= TASK_OFILE_NR) {
-		return;
+	if (task->files) {
+		fdtable_free_fd(task->files, fd);
 	}
-	task->file_table[fd] = (file_t *) 0;
 }
 
 static void idle_task_entry() {
@@ -168,30 +296,51 @@ static void idle_task_entry() {
 void task_manager_init() {
 	kernel_memset(task_table, 0, sizeof(task_table));
 	mutex_init(&task_table_mutex);
-	int sel = gdt_alloc_desc();
-	segment_desc_set(sel, 0x00000000, 0xFFFFFFFF,
-	                 SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D
-	);
-	task_manager.app_data_selector = sel;
+	pid_init();
+	cred_init();
 
-	sel = gdt_alloc_desc();
-	segment_desc_set(sel, 0x00000000, 0xFFFFFFFF,
-	                 SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_CODE | SEG_TYPE_RW | SEG_D
-	);
-	task_manager.app_code_selector = sel;
+	list_init(&task_manager.free_list);
+	for (int i = 0; i < TASK_NR_MAX; ++i) {
+		list_push_back(&task_manager.free_list, &task_table[i].all_node);
+	}
 
-	task_manager.current = (task_t *) 0;
+	spinlock_init(&task_manager.lock, "task");
+	spinlock_init(&task_manager.sleep_lock, "sleep");
 	list_init(&task_manager.sleep_list);
-	list_init(&task_manager.ready_list);
 	list_init(&task_manager.task_list);
 
+	cpu_t *cpu = cpu_get(0);
+	cpu->current = (task_t *) 0;
+	cpu->idle_task = &task_manager.idle_task;
+	sched_rq_init(&cpu->rq);
+
 	task_init(&task_manager.idle_task, "idle",
-	          TASK_FLAG_SYSTEM,
+	          TASK_FLAG_SYSTEM | TASK_FLAG_IDLE,
 	          (uint32_t) idle_task_entry,
-	          (uint32_t) &idle_task_stack[IDLE_TASK_STACK_SIZE]);
+	          (uint32_t) &idle_task_stack[IDLE_TASK_STACK_SIZE],
+	          0);
 	task_start(&task_manager.idle_task);
 }
 
+/**
+ * 为 AP 创建空闲任务, 使用自己的内核栈页作为栈
+ */
+task_t *task_create_idle(int cpu) {
+	task_t *task = alloc_task();
+	if (task == (task_t *) 0) {
+		return (task_t *) 0;
+	}
+
+	if (task_init(task, "idle", TASK_FLAG_SYSTEM | TASK_FLAG_IDLE, (uint32_t) idle_task_entry, 0, 0) < 0) {
+		free_task(task);
+		return (task_t *) 0;
+	}
+	task->tss.esp = task->tss.esp0;
+	task->cpu = cpu;
+	smp_bind_tss(task->tss_selector, cpu);
+	return task;
+}
+
 void first_task_init() {
 	void first_task_entry();
 	extern uint8_t s_first_task[], e_first_task[];
@@ -206,10 +355,11 @@ void first_task_init() {
 	          "first task",
 	          0,
 	          first_start,
-	          alloc_size + first_start);
+	          alloc_size + first_start,
+	          0);
 	task_manager.first_task.heap_start = (uint32_t) e_first_task;
 	task_manager.first_task.heap_end = (uint32_t) e_first_task;
-	task_manager.current = &task_manager.first_task;
+	cpu_this()->current = &task_manager.first_task;
 
 	mmu_set_page_dir(task_manager.first_task.tss.cr3);
 
@@ -217,8 +367,10 @@ void first_task_init() {
 	kernel_memcpy((void *) first_start, (void *) s_first_task, copy_size);
 
 	write_tr(task_manager.first_task.tss_selector);
+	cpu_set_sysenter_stack(task_manager.first_task.tss.esp0);
 
-	task_start(&task_manager.first_task);
+	// 已经作为当前任务在 BSP 上运行, 不能再挑选其它 CPU
+	task_start_on(&task_manager.first_task, cpu_this()->id);
 }
 
 task_t *task_first_task() {
@@ -226,158 +378,308 @@ task_t *task_first_task() {
 }
 
 void task_set_ready(task_t *task) {
-	if (task == &task_manager.idle_task) {
+	if (task->flags & TASK_FLAG_IDLE) {
 		return;
 	}
-	list_push_back(&task_manager.ready_list, &task->run_node);
+
+	sched_rq_t *rq = task_rq(task);
+	irq_state_t state = spin_lock_irqsave(&rq->lock);
+	sched_fair_enqueue(rq, task);
 	task->state = TASK_READY;
+	cpu_t *cpu = task_check_idle(task);
+	spin_unlock_irqrestore(&rq->lock, state);
+
+	if (cpu) {
+		smp_send_resched(cpu);
+	}
 }
 
 void task_set_block(task_t *task) {
-	if (task == &task_manager.idle_task) {
+	if (task->flags & TASK_FLAG_IDLE) {
 		return;
 	}
-	list_ease(&task_manager.ready_list, &task->run_node);
+
+	sched_rq_t *rq = task_rq(task);
+	irq_state_t state = spin_lock_irqsave(&rq->lock);
+	sched_fair_dequeue(rq, task);
+	spin_unlock_irqrestore(&rq->lock, state);
+}
+
+/**
+ * 唤醒任务, 不立即切换
+ * 只在它应当抢占所在 CPU 的当前任务时记录调度请求, 等释放锁或中断返回时再切换
+ */
+void task_wakeup(task_t *task) {
+	if (task->flags & TASK_FLAG_IDLE) {
+		return;
+	}
+
+	sched_rq_t *rq = task_rq(task);
+	irq_state_t state = spin_lock_irqsave(&rq->lock);
+	sched_fair_enqueue(rq, task);
+	task->state = TASK_READY;
+
+	cpu_t *cpu = cpu_get(task->cpu);
+	task_t *curr = cpu->current;
+	int need_resched = curr && ((curr->flags & TASK_FLAG_IDLE) || sched_fair_wakeup_preempt(rq, curr, task));
+	if (need_resched) {
+		cpu->need_resched = 1;
+	}
+	spin_unlock_irqrestore(&rq->lock, state);
+
+	if (need_resched) {
+		smp_send_resched(cpu);
+	}
+}
+
+/**
+ * 将子进程挂到父进程下
+ */
+void task_add_child(task_t *parent, task_t *child) {
+	spin_lock(&task_manager.lock);
+	child->parent = parent;
+	list_push_back(&parent->child_list, &child->child_node);
+	spin_unlock(&task_manager.lock);
 }
 
 task_t *task_current() {
-	return task_manager.current;
+	return cpu_this()->current;
 }
 
-// 返回下一个要运行的任务 (待优化)
-task_t *task_next_run() {
-	if (list_is_empty(&task_manager.ready_list)) {
-		return &task_manager.idle_task;
-	}
-	list_node_t *task_node = list_first(&task_manager.ready_list);
-	return list_node_parent(task_node, task_t, run_node);
+// 返回下一个要运行的任务: 虚拟运行时间最小的就绪任务, 调用者持有就绪队列的锁
+static task_t *task_next_run(cpu_t *cpu) {
+	task_t *task = sched_fair_pick_next(&cpu->rq);
+	return task ? task : cpu->idle_task;
 }
 
 int sys_yield() {
-	irq_state_t state = irq_enter_protection();
-
-	if (list_is_empty(&task_manager.ready_list)) {
-		return -1;
-	} else if (list_count(&task_manager.ready_list) == 1) {
+	sched_rq_t *rq = &cpu_this()->rq;
+	irq_state_t state = spin_lock_irqsave(&rq->lock);
+	if (sched_rq_count(rq) <= 1) {
+		spin_unlock_irqrestore(&rq->lock, state);
 		return 0;
 	}
-
-	task_t *current = task_current();
-	task_set_block(current);
-	task_set_ready(current);
+	sched_fair_yield(rq, task_current());
+	spin_unlock(&rq->lock);
 
 	task_dispatch();
-
 	irq_leave_protection(state);
 	return 0;
 }
 
+/**
+ * vfork 的子进程归还借用的地址空间, 让父进程继续运行
+ */
+static void vfork_release(task_t *task) {
+	task_t *parent = task->vfork_parent;
+	if (parent == (task_t *) 0) {
+		return;
+	}
+
+	vdso_set_pid(parent->tss.cr3, parent->pid);
+
+	irq_state_t state = spin_lock_irqsave(&parent->vfork_wait.lock);
+	task->vfork_parent = (task_t *) 0;
+	wake_up_locked(&parent->vfork_wait, 0);
+	spin_unlock_irqrestore(&parent->vfork_wait.lock, state);
+}
+
 void sys_exit(int status) {
 	task_t *current = task_current();
-	for (int fd = 0; fd < TASK_OFILE_NR; ++fd) {
-		file_t *file = current->file_table[fd];
-		if (file) {
+
+	// vfork 出的子进程未 execve 就退出, 换用内核页表, 避免回收时释放父进程的地址空间
+	if (current->vfork_parent) {
+		current->tss.cr3 = memory_kernel_page_dir();
+		mmu_set_page_dir(current->tss.cr3);
+		vfork_release(current);
+	}
+
+	fdtable_t *files = current->files;
+	for (int fd = 0; files && (fd < files->max_fds); ++fd) {
+		if (files->fd[fd]) {
 			sys_close(fd);
-			current->file_table[fd] = (file_t *) 0;
 		}
 	}
 
-	int move_child = 0;
+	irq_state_t state = spin_lock_irqsave(&task_manager.lock);
 
-	// 找所有的子进程，将其转交给 init 进程
-	mutex_lock(&task_table_mutex);
-	for (int i = 0; i < TASK_NR_MAX; i++) {
-		task_t *task = &task_table[i];
-		if (task->parent == current) {
-			// 有子进程，则转给init_task
-			task->parent = &task_manager.first_task;
-
-			// 如果子进程中有僵尸进程，唤醒回收资源
-			// 并不由自己回收，因为自己将要退出
-			if (task->state == TASK_ZOMBIE) {
-				move_child = 1;
-			}
-		}
+	// 将所有的子进程转交给 init 进程，只需遍历自己的子进程队列
+	task_t *init_task = &task_manager.first_task;
+	list_node_t *node;
+	while ((node = list_pop_front(&current->child_list)) != (list_node_t *) 0) {
+		task_t *child = list_node_parent(node, task_t, child_node);
+		child->parent = init_task;
+		list_push_back(&init_task->child_list, node);
 	}
-	mutex_unlock(&task_table_mutex);
 
-	irq_state_t state = irq_enter_protection();
+	// 如果子进程中有僵尸进程，唤醒 init 回收资源
+	// 并不由自己回收，因为自己将要退出
+	int move_zombie = 0;
+	while ((node = list_pop_front(&current->zombie_list)) != (list_node_t *) 0) {
+		task_t *child = list_node_parent(node, task_t, child_node);
+		child->parent = init_task;
+		list_push_back(&init_task->zombie_list, node);
+		move_zombie = 1;
+	}
 
 	task_t *parent = current->parent;
 	// 如果父进程为init进程，在下方唤醒
-	if (move_child && parent != &task_manager.first_task) {
-		if (task_manager.first_task.state == TASK_WAITTING) {
-			task_set_ready(&task_manager.first_task);
+	if (move_zombie && parent != init_task) {
+		if (init_task->state == TASK_WAITTING) {
+			task_set_ready(init_task);
 		}
 	}
 
-	if (parent->state == TASK_WAITTING) {
-		task_set_ready(parent);
+	// 从父进程的运行子进程队列移入僵尸队列，等待父进程回收
+	if (parent) {
+		list_ease(&parent->child_list, &current->child_node);
+		list_push_back(&parent->zombie_list, &current->child_node);
+		if (parent->state == TASK_WAITTING) {
+			task_set_ready(parent);
+		}
 	}
 
 	current->status = status;
 	current->state = TASK_ZOMBIE;
 	task_set_block(current);
+	spin_unlock(&task_manager.lock);
+
 	task_dispatch();
 	irq_leave_protection(state);
 }
 
+/**
+ * 回收僵尸进程的全部资源
+ * 它可能在另一个 CPU 上退出, 切换出去前一直关着中断, 等那个 CPU 响应中断后才能释放它的栈和 TSS
+ */
+static void task_reap(task_t *task) {
+	smp_sync(cpu_get(task->cpu));
+	task_uninit(task);
+	free_task(task);
+}
+
+/**
+ * 查找可回收的子进程，pid 为 -1 时取僵尸队列中的第一个
+ */
+static task_t *find_zombie(task_t *parent, int pid) {
+	if (pid == -1) {
+		list_node_t *node = list_first(&parent->zombie_list);
+		return list_node_parent(node, task_t, child_node);
+	}
+
+	task_t *task = pid_find_task(pid);
+	if (task && task->parent == parent && task->state == TASK_ZOMBIE) {
+		return task;
+	}
+	return (task_t *) 0;
+}
+
+/**
+ * 判断 pid 是否为仍在运行的子进程
+ */
+static int has_child(task_t *parent, int pid) {
+	if (pid == -1) {
+		return !list_is_empty(&parent->child_list);
+	}
+
+	task_t *task = pid_find_task(pid);
+	return task && task->parent == parent;
+}
+
 int sys_wait(int *status) {
+	return sys_waitpid(-1, status, 0);
+}
+
+/**
+ * 等待子进程退出
+ * pid 为 -1 时等待任意子进程，options 为 WNOHANG 时没有退出的子进程立即返回 0
+ */
+int sys_waitpid(int pid, int *status, int options) {
 	task_t *current = task_current();
 	while (1) {
-		mutex_lock(&task_table_mutex);
+		irq_state_t state = spin_lock_irqsave(&task_manager.lock);
 
-		for (int i = 0; i < TASK_NR_MAX; ++i) {
-			task_t *task = &task_table[i];
-			if (task->parent != current) {
-				continue;
-			}
-			if (task->state == TASK_ZOMBIE) {
-				int pid = task->pid;
-				*status = task->status;
-				memory_destroy_uvm(task->tss.cr3);
-				memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
-				kernel_memset(task, 0, sizeof(task_t));
-
-				mutex_unlock(&task_table_mutex);
-				return pid;
+		task_t *zombie = find_zombie(current, pid);
+		if (zombie) {
+			list_ease(&current->zombie_list, &zombie->child_node);
+			spin_unlock_irqrestore(&task_manager.lock, state);
+
+			int zombie_pid = zombie->pid;
+			if (status) {
+				*status = zombie->status;
 			}
+			task_reap(zombie);
+			return zombie_pid;
+		}
+
+		// 没有可等待的子进程
+		if (!has_child(current, pid)) {
+			spin_unlock_irqrestore(&task_manager.lock, state);
+			return -1;
 		}
 
-		mutex_unlock(&task_table_mutex);
+		if (options & WNOHANG) {
+			spin_unlock_irqrestore(&task_manager.lock, state);
+			return 0;
+		}
 
-		irq_state_t state = irq_enter_protection();
 		task_set_block(current);
 		current->state = TASK_WAITTING;
+		spin_unlock(&task_manager.lock);
+
 		task_dispatch();
 		irq_leave_protection(state);
 	}
 }
 
+/**
+ * 切换到下一个任务
+ * 调用前须释放所有自旋锁. 在持有锁期间被中断调用时只记录请求, 等锁释放后再切换
+ */
 void task_dispatch() {
 	irq_state_t state = irq_enter_protection();
 
-	task_t *to = task_next_run();
-	if (to == (task_t *) 0 || to == task_current()) {
+	cpu_t *cpu = cpu_this();
+	if (cpu->preempt_count > 0) {
+		// 当前任务不在就绪队列中说明它要阻塞, 持有锁阻塞是错误的
+		ASSERT(cpu->current->on_rq || (cpu->current->flags & TASK_FLAG_IDLE));
+		cpu->need_resched = 1;
+		irq_leave_protection(state);
+		return;
+	}
+
+	spin_lock(&cpu->rq.lock);
+	cpu->need_resched = 0;
+
+	task_t *to = task_next_run(cpu);
+	task_t *from = cpu->current;
+	if (to == from) {
+		// 时间片用完但仍然是最应该运行的任务, 继续运行
+		if (to->slice_ticks <= 0) {
+			to->slice_ticks = sched_fair_slice(&cpu->rq, to);
+		}
+		spin_unlock(&cpu->rq.lock);
+		irq_leave_protection(state);
 		return;
 	}
-	task_t *from = task_current();
-	task_manager.current = to;
+
+	cpu->current = to;
 	to->state = TASK_RUNNING;
+	to->slice_ticks = sched_fair_slice(&cpu->rq, to);
+
+	// 不能带着锁切换, 切换回来时由其它任务释放不了
+	spin_unlock(&cpu->rq.lock);
 	task_switch_from_to(from, to);
 
 	irq_leave_protection(state);
 }
 
-void task_time_tick() {
-	task_t *current = task_current();
-	if (--current->slice_ticks <= 0) {
-		current->slice_ticks = current->time_ticks;
-		task_set_block(current);
-		task_set_ready(current);
-		task_dispatch();
-	}
-
+/**
+ * 唤醒睡眠到期的任务, 每个节拍只在一个 CPU 上执行一次
+ * 在时钟软中断中开着中断执行, 硬件中断中不使用 sleep_lock, 不必关中断加锁
+ */
+void task_sleep_tick() {
+	spin_lock(&task_manager.sleep_lock);
 	list_node_t *node = list_first(&task_manager.sleep_list);
 	while (node) {
 		task_t *task = list_node_parent(node, task_t, run_node);
@@ -388,8 +690,34 @@ void task_time_tick() {
 		}
 		node = next;
 	}
+	spin_unlock(&task_manager.sleep_lock);
+	wait_time_tick();
 }
 
+/**
+ * 当前 CPU 的调度节拍, 各 CPU 的时钟中断中调用, 中断已关闭
+ */
+void task_time_tick() {
+	task_t *current = task_current();
+	cpu_t *cpu = cpu_this();
+	spin_lock(&cpu->rq.lock);
+	int need_resched;
+	if (current->flags & TASK_FLAG_IDLE) {
+		need_resched = sched_rq_count(&cpu->rq) > 0;
+	} else {
+		need_resched = sched_fair_task_tick(&cpu->rq, current);
+	}
+	spin_unlock(&cpu->rq.lock);
+
+	// 在中断返回前切换
+	if (need_resched) {
+		cpu->need_resched = 1;
+	}
+}
+
+/**
+ * 加入睡眠队列, 调用者持有 sleep_lock
+ */
 void task_set_sleep(task_t *task, uint32_t ticks) {
 	if (ticks == 0) {
 		return;
@@ -399,51 +727,89 @@ void task_set_sleep(task_t *task, uint32_t ticks) {
 	list_push_back(&task_manager.sleep_list, &task->run_node);
 }
 
+/**
+ * 移出睡眠队列, 调用者持有 sleep_lock
+ */
 void task_set_wakeup(task_t *task) {
 	list_ease(&task_manager.sleep_list, &task->run_node);
 }
 
-void sys_sleep(uint32_t ms) {
-	irq_state_t state = irq_enter_protection();
+/**
+ * 当前任务睡眠指定的时钟节拍数, 在第 ticks 个节拍到来时醒来
+ */
+void task_sleep_ticks(uint32_t ticks) {
+	if (ticks == 0) {
+		// 不睡眠也要让出一次 CPU, 且不能进入阻塞状态
+		sys_yield();
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&task_manager.sleep_lock);
 	task_t *current = task_current();
 	task_set_block(current);
-	task_set_sleep(current, (ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS);
+	task_set_sleep(current, ticks);
+	spin_unlock(&task_manager.sleep_lock);
+
 	task_dispatch();
 	irq_leave_protection(state);
 }
 
+void sys_sleep(uint32_t ms) {
+	task_sleep_ticks((ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS);
+}
+
 int sys_getpid() {
 	return task_current()->pid;
 }
 
 static void copy_opened_files(task_t *child) {
-	task_t *parent = task_current();
-	for (int i = 0; i < TASK_OFILE_NR; i++) {
-		file_t *file = parent->file_table[i];
-		if (file) {
+	fdtable_t *files = task_current()->files;
+	if (files == (fdtable_t *) 0) {
+		return;
+	}
+
+	for (int i = 0; i < files->max_fds; i++) {
+		file_t *file = files->fd[i];
+		if (file && (fdtable_install(child->files, i, file) >= 0)) {
 			file_inc_ref(file);
-			child->file_table[i] = file;
 		}
 	}
 }
 
-int sys_fork() {
+/**
+ * 复制当前进程, share_vm 为 1 时子进程借用父进程的地址空间
+ */
+static task_t *copy_task(int share_vm) {
 	task_t *parent = task_current();
 	task_t *child = alloc_task();
 	if (child == (task_t *) 0) {
-		goto fork_failed;
+		return (task_t *) 0;
 	}
 
+	// 地址空间复制自父进程或与其共用, 交给 task_init 直接使用, 不再新建空的
+	uint32_t page_dir = share_vm ? parent->tss.cr3 : memory_copy_uvm(parent->tss.cr3);
+	if (page_dir == 0) {
+		free_task(child);
+		return (task_t *) 0;
+	}
+
+	// task_init 同时设置共享页中的进程号: vfork 期间父进程挂起, 共用的进程号暂时换成子进程的, 归还时再恢复
 	syscall_frame_t *frame = (syscall_frame_t *) (parent->tss.esp0 - sizeof(syscall_frame_t));
 	int err = task_init(
 			child,
 			parent->name,
 			0,
 			frame->eip,
-			frame->esp + sizeof(uint32_t) * SYSCALL_PARAM_COUNT
+			frame->esp + sizeof(uint32_t) * SYSCALL_PARAM_COUNT,
+			page_dir
 	);
 	if (err < 0) {
-		goto fork_failed;
+		// task_init 失败时已释放自己分配的资源, 页表仍由这里释放
+		if (!share_vm) {
+			memory_destroy_uvm(page_dir);
+		}
+		free_task(child);
+		return (task_t *) 0;
 	}
 
 	copy_opened_files(child);
@@ -464,20 +830,45 @@ int sys_fork() {
 	tss->gs = frame->gs;
 	tss->eflags = frame->eflags;
 
-	child->parent = parent;
+	if (share_vm) {
+		child->vfork_parent = parent;
+	}
+
+	task_add_child(parent, child);
+	return child;
+}
 
-	if ((tss->cr3 = memory_copy_uvm(parent->tss.cr3)) < 0) {
-		goto fork_failed;
+int sys_fork() {
+	task_t *child = copy_task(0);
+	if (child == (task_t *) 0) {
+		return -1;
 	}
 
 	task_start(child);
 	return child->pid;
-fork_failed:
-	if (child) {
-		task_uninit(child);
-		free_task(child);
+}
+
+/**
+ * vfork: 子进程直接使用父进程的地址空间, 父进程挂起直到子进程 execve 或退出
+ * 子进程在此期间不能从调用 vfork 的函数返回, 也不能修改父进程的数据
+ */
+int sys_vfork() {
+	task_t *parent = task_current();
+	task_t *child = copy_task(1);
+	if (child == (task_t *) 0) {
+		return -1;
 	}
-	return -1;
+
+	// 子进程退出后仍是父进程的僵尸, 在父进程回收之前 child 不会被释放
+	int pid = child->pid;
+	irq_state_t state = spin_lock_irqsave(&parent->vfork_wait.lock);
+	task_start(child);
+	while (child->vfork_parent == parent) {
+		wait_queue_sleep_locked(&parent->vfork_wait, 0, WAIT_FOREVER, state);
+		state = spin_lock_irqsave(&parent->vfork_wait.lock);
+	}
+	spin_unlock_irqrestore(&parent->vfork_wait.lock, state);
+	return pid;
 }
 
 /**
@@ -667,6 +1058,7 @@ int sys_execve(char *name, char **argv, char **env) {
 	if (!new_page_dir) {
 		goto exec_failed;
 	}
+	vdso_set_pid(new_page_dir, task->pid);
 
 	// 加载elf文件到内存中。要放在开启新页表之后，这样才能对相应的内存区域写
 	uint32_t entry = load_elf_file(task, name, new_page_dir);    // 暂时置用task->name表示
@@ -710,7 +1102,12 @@ int sys_execve(char *name, char **argv, char **env) {
 
 	// 调整页表，切换成新的，同时释放掉之前的
 	// 当前使用的是内核栈，而内核栈并未映射到进程地址空间中，所以下面的释放没有问题
-	memory_destroy_uvm(old_page_dir);            // 再释放掉了原进程的内容空间
+	// vfork 出的子进程用的是父进程的地址空间, 不能释放, 归还后让父进程继续运行
+	if (task->vfork_parent) {
+		vfork_release(task);
+	} else {
+		memory_destroy_uvm(old_page_dir);            // 再释放掉了原进程的内容空间
+	}
 
 	// 当从系统调用中返回时，将切换至新进程的入口地址运行，并且进程能够获取参数
 	// 注意，如果用户栈设置不当，可能导致返回后运行出现异常。可在gdb中使用nexti单步观察运行流程
@@ -727,23 +1124,79 @@ exec_failed:    // 必要的资源释放
 	return -1;
 }
 
-static task_t *alloc_task() {
-	task_t *task = (task_t *) 0;
+/**
+ * 直接从 ELF 文件创建子进程, 省去 fork 复制地址空间又马上被 execve 丢弃的开销
+ * fd_map 为空时继承父进程所有打开的文件, 否则子进程的标准输入、输出、错误
+ * 依次取自父进程的 fd_map[0..2], 小于 0 的项不打开
+ */
+int sys_spawn(char *name, char **argv, int *fd_map) {
+	task_t *parent = task_current();
+	task_t *child = alloc_task();
+	if (child == (task_t *) 0) {
+		return -1;
+	}
 
-	mutex_lock(&task_table_mutex);
-	for (int i = 0; i < TASK_NR_MAX; ++i) {
-		task_t *t = &task_table[i];
-		if (t->name[0] == '\0') {
-			task = t;
-			break;
+	// 入口和栈要等加载完才知道, 先创建出空的地址空间
+	if (task_init(child, get_file_name(name), 0, 0, 0, 0) < 0) {
+		free_task(child);
+		return -1;
+	}
+
+	// 加载时仍在父进程的页表下, 直接写子进程页表对应的物理页
+	uint32_t page_dir = child->tss.cr3;
+	uint32_t entry = load_elf_file(child, name, page_dir);
+	if (entry == 0) {
+		goto spawn_failed;
+	}
+
+	uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;
+	int err = memory_alloc_for_page_dir(page_dir,
+	                                    MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE,
+	                                    MEM_TASK_STACK_SIZE, PTE_P | PTE_U | PTE_W);
+	if (err < 0) {
+		goto spawn_failed;
+	}
+
+	err = copy_args((char *) stack_top, page_dir, strings_count(argv), argv);
+	if (err < 0) {
+		goto spawn_failed;
+	}
+
+	// 不经过系统调用返回, 直接由 tss 进入入口, 栈顶即为参数所在位置
+	child->tss.eip = entry;
+	child->tss.esp = stack_top;
+
+	if (fd_map) {
+		for (int i = 0; i < SPAWN_FD_MAP_NR; i++) {
+			file_t *file = (fd_map[i] >= 0) ? task_file(fd_map[i]) : (file_t *) 0;
+			if (file && (fdtable_install(child->files, i, file) >= 0)) {
+				file_inc_ref(file);
+			}
 		}
+	} else {
+		copy_opened_files(child);
 	}
+
+	task_add_child(parent, child);
+	task_start(child);
+	return child->pid;
+
+spawn_failed:
+	task_uninit(child);
+	free_task(child);
+	return -1;
+}
+
+task_t *alloc_task() {
+	mutex_lock(&task_table_mutex);
+	list_node_t *node = list_pop_front(&task_manager.free_list);
 	mutex_unlock(&task_table_mutex);
-	return task;
+	return list_node_parent(node, task_t, all_node);
 }
 
-static void free_task(task_t *task) {
+void free_task(task_t *task) {
 	mutex_lock(&task_table_mutex);
 	kernel_memset(task, 0, sizeof(task_t));
+	list_push_back(&task_manager.free_list, &task->all_node);
 	mutex_unlock(&task_table_mutex);
 }
\ No newline at end of file
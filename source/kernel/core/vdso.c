@@ -0,0 +1,171 @@
+/**
+ * 映射到每个进程中的共享页
+ *
+ * 数据页位于内核数据区, 只读映射给所有进程; 代码页即内核中的 .vdso 段, 同样只读映射.
+ * 代码页中的函数在内核中链接, 在进程中的另一地址上运行, 因此只能使用相对跳转和绝对地址,
+ * 不能调用其它函数, 也不能访问内核变量
+ */
+#include "core/vdso.h"
+#include "core/memory.h"
+#include "cpu/mmu.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include "dev/time.h"
+#include "os_cfg.h"
+
+#define VDSO_TEXT           __attribute__((section(".vdso")))
+
+static uint8_t vdso_data_page[MEM_PAGE_SIZE] __attribute__((aligned(MEM_PAGE_SIZE)));
+static vdso_data_t *vdso_data = (vdso_data_t *) vdso_data_page;
+
+VDSO_TEXT static int vdso_getpid(void) {
+	return ((vdso_task_t *) VDSO_TASK_ADDR)->pid;
+}
+
+VDSO_TEXT static uint32_t vdso_ticks(void) {
+	return ((vdso_data_t *) VDSO_DATA_ADDR)->ticks;
+}
+
+/**
+ * 启动以来的时间, 与内核的 time_ns 一致
+ * 有 TSC 时在最近一个节拍的时间上加上之后经过的 TSC 周期; 64 位除法要调用 libgcc, 这里用 divl 完成
+ */
+VDSO_TEXT static void vdso_clock(uint32_t *sec, uint32_t *nsec) {
+	vdso_data_t *data = (vdso_data_t *) VDSO_DATA_ADDR;
+	uint32_t seq, tsc_lo, tsc_hi, tsc_khz;
+
+	do {
+		seq = data->seq;
+		__asm__ __volatile__("" : : : "memory");
+		*sec = data->clock_sec;
+		*nsec = data->clock_nsec;
+		tsc_lo = data->tsc_lo;
+		tsc_hi = data->tsc_hi;
+		tsc_khz = data->tsc_khz;
+		__asm__ __volatile__("" : : : "memory");
+	} while ((seq & 1) || (seq != data->seq));
+
+	if (tsc_khz == 0) {
+		return;
+	}
+
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	int64_t cycles = (int64_t) ((((uint64_t) hi << 32) | lo) - (((uint64_t) tsc_hi << 32) | tsc_lo));
+
+	// 各 CPU 的 TSC 可能略有偏差, 不能倒退; 最多推算 1 秒, 保证商不超过 32 位
+	uint64_t limit = (uint64_t) tsc_khz * 1000;
+	if (cycles < 0) {
+		cycles = 0;
+	} else if ((uint64_t) cycles > limit) {
+		cycles = (int64_t) limit;
+	}
+
+	uint64_t product = (uint64_t) cycles * NSEC_PER_MSEC;
+	uint32_t ns, rem;
+	__asm__ ("divl %[d]"
+	: "=a"(ns), "=d"(rem)
+	: "a"((uint32_t) product), "d"((uint32_t) (product >> 32)), [d]"r"(tsc_khz));
+
+	*nsec += ns;
+	if (*nsec >= NSEC_PER_SEC) {
+		*nsec -= NSEC_PER_SEC;
+		(*sec)++;
+	}
+}
+
+/**
+ * 内核中的函数地址换算为进程中的地址
+ */
+static uint32_t vdso_entry(void *fn) {
+	extern uint8_t s_vdso[];
+	return VDSO_TEXT_ADDR + ((uint32_t) fn - (uint32_t) s_vdso);
+}
+
+void vdso_init(void) {
+	kernel_memset(vdso_data_page, 0, sizeof(vdso_data_page));
+	vdso_data->entry[VDSO_FN_getpid] = vdso_entry(vdso_getpid);
+	vdso_data->entry[VDSO_FN_ticks] = vdso_entry(vdso_ticks);
+	vdso_data->entry[VDSO_FN_clock] = vdso_entry(vdso_clock);
+}
+
+/**
+ * 在新建的进程地址空间中映射共享页及一个私有数据页
+ * 返回后调用者负责在销毁地址空间时调用 vdso_unmap
+ */
+int vdso_map(uint32_t page_dir) {
+	extern uint8_t s_vdso[], e_vdso[];
+
+	int err = memory_create_map((pde_t *) page_dir, VDSO_DATA_ADDR, (uint32_t) vdso_data_page, 1, PTE_U);
+	if (err < 0) {
+		return -1;
+	}
+
+	int text_pages = (e_vdso - s_vdso) / MEM_PAGE_SIZE;
+	err = memory_create_map((pde_t *) page_dir, VDSO_TEXT_ADDR, (uint32_t) s_vdso, text_pages, PTE_U);
+	if (err < 0) {
+		return -1;
+	}
+
+	uint32_t page = memory_alloc_page();
+	if (page == 0) {
+		return -1;
+	}
+	kernel_memset((void *) page, 0, MEM_PAGE_SIZE);
+	return memory_create_map((pde_t *) page_dir, VDSO_TASK_ADDR, page, 1, PTE_U);
+}
+
+/**
+ * 释放私有数据页及页表, 共享页不释放
+ */
+void vdso_unmap(uint32_t page_dir) {
+	pde_t *pde = (pde_t *) page_dir + pde_index(VDSO_BASE);
+	if (!pde->present) {
+		return;
+	}
+
+	pte_t *pte = find_pte((pde_t *) page_dir, VDSO_TASK_ADDR, 0);
+	if (pte->present) {
+		memory_free_page(pte_paddr(pte));
+	}
+	memory_free_page(pde_paddr(pde));
+	pde->v = 0;
+}
+
+/**
+ * 设置进程看到的进程号
+ */
+void vdso_set_pid(uint32_t page_dir, int pid) {
+	uint32_t paddr = memory_get_paddr(page_dir, VDSO_TASK_ADDR);
+	if (paddr) {
+		((vdso_task_t *) paddr)->pid = pid;
+	}
+}
+
+/**
+ * 校准 TSC 后调用, 此时时钟中断尚未开始
+ */
+void vdso_set_tsc(uint32_t khz) {
+	vdso_data->tsc_khz = khz;
+}
+
+/**
+ * 时钟中断中调用, 只在一个 CPU 上更新
+ * ns 为 TSC 等于 tsc 时启动以来的纳秒数, 应用据此推算节拍之间的时间
+ */
+void vdso_time_tick(uint32_t ticks, uint64_t ns, uint64_t tsc) {
+	uint32_t nsec;
+	uint32_t sec = (uint32_t) div64_32(ns, NSEC_PER_SEC, &nsec);
+
+	vdso_data->seq++;
+	barrier();
+
+	vdso_data->ticks = ticks;
+	vdso_data->clock_sec = sec;
+	vdso_data->clock_nsec = nsec;
+	vdso_data->tsc_lo = (uint32_t) tsc;
+	vdso_data->tsc_hi = (uint32_t) (tsc >> 32);
+
+	barrier();
+	vdso_data->seq++;
+}
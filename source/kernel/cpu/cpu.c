@@ -10,6 +10,7 @@
 
 static segment_desc_t gdt_table[GDT_TABLE_SIZE];
 static mutex_t mutex;
+static int sysenter_enabled;        // CPU 支持 sysenter, 已设置好入口
 
 /**
  * 设置段描述符
@@ -84,6 +85,14 @@ void init_gdt(void) {
 	                 SEG_P_PRESENT | SEG_DPL0 | SEG_S_NORMAL | SEG_TYPE_CODE
 	                 | SEG_TYPE_RW | SEG_D | SEG_G);
 
+	// 应用的代码段和数据段, sysexit 按固定位置取用, 不能动态分配
+	segment_desc_set(APP_SELECTOR_CS, 0x00000000, 0xFFFFFFFF,
+	                 SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_CODE
+	                 | SEG_TYPE_RW | SEG_D);
+	segment_desc_set(APP_SELECTOR_DS, 0x00000000, 0xFFFFFFFF,
+	                 SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_DATA
+	                 | SEG_TYPE_RW | SEG_D);
+
 	// 调用门
 	gate_desc_set(
 			(gate_desc_t *) (gdt_table + (SELECTOR_SYSCALL >> 3)),
@@ -104,6 +113,40 @@ void switch_to_tss(uint32_t tss_selector) {
 	far_jump(tss_selector, 0);
 }
 
+/**
+ * 设置 sysenter 入口, 每个 CPU 都要设置一次
+ * 进入时的栈随任务切换更新, 见 cpu_set_sysenter_stack
+ */
+void cpu_sysenter_init(void) {
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_FEAT_EDX_SEP)) {
+		return;
+	}
+
+	sysenter_enabled = 1;
+	write_msr(MSR_SYSENTER_CS, KERNEL_SELECTOR_CS);
+	write_msr(MSR_SYSENTER_ESP, 0);
+	write_msr(MSR_SYSENTER_EIP, (uint32_t) exception_handler_sysenter);
+}
+
+/**
+ * 切换任务时将 sysenter 的栈指向新任务的内核栈
+ */
+void cpu_set_sysenter_stack(uint32_t esp0) {
+	if (sysenter_enabled) {
+		write_msr(MSR_SYSENTER_ESP, esp0);
+	}
+}
+
+/**
+ * AP启动后加载与BSP共用的GDT
+ */
+void cpu_ap_init(void) {
+	lgdt((uint32_t) gdt_table, sizeof(gdt_table));
+	cpu_sysenter_init();
+}
+
 /**
  * CPU初始化
  */
@@ -111,4 +154,5 @@ void cpu_init(void) {
 	mutex_init(&mutex);
 
 	init_gdt();
+	cpu_sysenter_init();
 }
@@ -0,0 +1,95 @@
+/**
+ * IOAPIC
+ * 目前只使用第一个 IOAPIC, 外部中断全部投递给 BSP
+ */
+#include "cpu/ioapic.h"
+#include "core/memory.h"
+#include "ipc/spinlock.h"
+#include "tools/log.h"
+
+static volatile uint32_t *ioapic_base;
+static uint32_t ioapic_gsi_base;
+static int ioapic_pin_count;
+static spinlock_t ioapic_lock = SPINLOCK_INIT("ioapic");       // 索引和数据须成对访问
+
+static uint32_t ioapic_read(int reg) {
+	ioapic_base[IOAPIC_REGSEL >> 2] = reg;
+	return ioapic_base[IOAPIC_WIN >> 2];
+}
+
+static void ioapic_write(int reg, uint32_t value) {
+	ioapic_base[IOAPIC_REGSEL >> 2] = reg;
+	ioapic_base[IOAPIC_WIN >> 2] = value;
+}
+
+/**
+ * 全局中断号转换为引脚号, 不属于该 IOAPIC 时返回 -1
+ */
+static int gsi_to_pin(uint32_t gsi) {
+	if ((ioapic_base == (volatile uint32_t *) 0) || (gsi < ioapic_gsi_base)
+	    || (gsi >= ioapic_gsi_base + ioapic_pin_count)) {
+		return -1;
+	}
+	return gsi - ioapic_gsi_base;
+}
+
+/**
+ * 映射寄存器并屏蔽所有引脚
+ */
+int ioapic_init(uint32_t paddr, uint32_t gsi_base) {
+	ioapic_base = (volatile uint32_t *) memory_map_mmio(paddr, MEM_PAGE_SIZE);
+	if (ioapic_base == (volatile uint32_t *) 0) {
+		log_printf("map ioapic failed");
+		return -1;
+	}
+
+	ioapic_gsi_base = gsi_base;
+	ioapic_pin_count = ((ioapic_read(IOAPIC_REG_VER) >> 16) & 0xFF) + 1;
+	for (int pin = 0; pin < ioapic_pin_count; pin++) {
+		ioapic_write(IOAPIC_REG_REDTBL + pin * 2, IOAPIC_RED_MASKED);
+		ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, 0);
+	}
+
+	log_printf("ioapic: %d pins, gsi base %d", ioapic_pin_count, gsi_base);
+	return 0;
+}
+
+/**
+ * 设置引脚对应的中断向量及目标 CPU, 设置后仍处于屏蔽状态
+ * flags 为 IOAPIC_RED_ACTIVE_LOW、IOAPIC_RED_LEVEL 的组合
+ */
+void ioapic_route(uint32_t gsi, int vector, uint32_t flags, int apic_id) {
+	int pin = gsi_to_pin(gsi);
+	if (pin < 0) {
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&ioapic_lock);
+	ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, apic_id << 24);
+	ioapic_write(IOAPIC_REG_REDTBL + pin * 2, vector | flags | IOAPIC_RED_MASKED);
+	spin_unlock_irqrestore(&ioapic_lock, state);
+}
+
+void ioapic_mask(uint32_t gsi) {
+	int pin = gsi_to_pin(gsi);
+	if (pin < 0) {
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&ioapic_lock);
+	int reg = IOAPIC_REG_REDTBL + pin * 2;
+	ioapic_write(reg, ioapic_read(reg) | IOAPIC_RED_MASKED);
+	spin_unlock_irqrestore(&ioapic_lock, state);
+}
+
+void ioapic_unmask(uint32_t gsi) {
+	int pin = gsi_to_pin(gsi);
+	if (pin < 0) {
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&ioapic_lock);
+	int reg = IOAPIC_REG_REDTBL + pin * 2;
+	ioapic_write(reg, ioapic_read(reg) & ~IOAPIC_RED_MASKED);
+	spin_unlock_irqrestore(&ioapic_lock, state);
+}
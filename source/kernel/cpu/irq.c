@@ -7,11 +7,41 @@
 #include "os_cfg.h"
 #include "tools/log.h"
 #include "core/task.h"
+#include "cpu/smp.h"
+#include "cpu/lapic.h"
+#include "cpu/ioapic.h"
+#include "core/softirq.h"
 
-#define IDT_TABLE_NR 128 // IDT表项数量
+#define IDT_TABLE_NR 256 // IDT表项数量
 
 static gate_desc_t idt_table[IDT_TABLE_NR]; // 中断描述表
 
+static int apic_mode;                       // 外部中断已改由 IOAPIC 投递
+static uint32_t isa_gsi[ISA_IRQ_NR];        // ISA 中断对应的 IOAPIC 全局中断号
+
+// 各 ISA 中断在 APIC 模式下的优先级, 时钟最高, 磁盘高于键盘等输入设备
+static const uint8_t isa_prio[ISA_IRQ_NR] = {
+		IRQ_APIC_PRIO_TIMER, IRQ_APIC_PRIO_INPUT, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER,
+		IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER,
+		IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_OTHER,
+		IRQ_APIC_PRIO_INPUT, IRQ_APIC_PRIO_OTHER, IRQ_APIC_PRIO_DISK, IRQ_APIC_PRIO_DISK,
+};
+
+/**
+ * ISA 中断在 APIC 模式下的向量号
+ */
+static inline int isa_apic_vector(int isa_irq) {
+	return (isa_prio[isa_irq] << 4) | isa_irq;
+}
+
+/**
+ * PIC 模式下的向量号换算为 ISA 中断号, 不是外部中断时返回 -1
+ */
+static inline int vector_to_isa(int irq_num) {
+	irq_num -= IRQ_PIC_START;
+	return (irq_num >= 0) && (irq_num < ISA_IRQ_NR) ? irq_num : -1;
+}
+
 static void dump_core_regs(exception_frame_t *frame) {
 	uint32_t ss, esp;
 	if (frame->cs & 0x3) {
@@ -194,6 +224,12 @@ void do_handler_virtual_exception(exception_frame_t *frame) {
 	do_default_handler(frame, "Virtualization Exception.\n");
 }
 
+/**
+ * 本地 APIC 的伪中断, 不需要 EOI
+ */
+void do_handler_lapic_spurious(exception_frame_t *frame) {
+}
+
 static void init_pic(void) {
 	// 边缘触发，级联，需要配置icw4, 8086模式
 	outb(PIC0_ICW1, PIC_ICW1_ALWAYS_1 | PIC_ICW1_ICW4);
@@ -235,6 +271,17 @@ void pic_send_eoi(int irq_num) {
 	outb(PIC0_OCW2, PIC_OCW2_EOI);
 }
 
+/**
+ * 中断处理结束, APIC 模式下只需写一次本地 APIC 的寄存器
+ */
+void irq_send_eoi(int irq_num) {
+	if (apic_mode) {
+		lapic_eoi();
+	} else {
+		pic_send_eoi(irq_num);
+	}
+}
+
 /**
  * @brief 中断和异常初始化
  */
@@ -265,22 +312,87 @@ void irq_init(void) {
 	irq_install(IRQ19_XM, exception_handler_smd_exception);
 	irq_install(IRQ20_VE, exception_handler_virtual_exception);
 
+	irq_install(IRQ_LAPIC_SPURIOUS, exception_handler_lapic_spurious);
+
 	lidt((uint32_t) idt_table, sizeof(idt_table));
 
 	// 初始化pic 控制器
 	init_pic();
 }
 
+/**
+ * 改由 IOAPIC 投递外部中断, 在 BSP 的本地 APIC 启用后、开中断前调用
+ * 已在 PIC 上开启的中断按相同的开关状态转移过来, 之后 PIC 全部屏蔽
+ */
+int irq_apic_init(mp_info_t *info) {
+	if (ioapic_init(info->ioapic_addr, info->ioapic_gsi_base) < 0) {
+		return -1;
+	}
+
+	// 开机时处于 PIC 模式的主板, 须通过 IMCR 将中断信号切换到 APIC
+	if (info->imcr) {
+		outb(IMCR_ADDR_PORT, IMCR_SELECT);
+		outb(IMCR_DATA_PORT, IMCR_APIC_MODE);
+	}
+
+	uint16_t pic_mask = inb(PIC0_IMR) | (inb(PIC1_IMR) << 8);
+	int apic_id = lapic_id();
+	for (int irq = 0; irq < ISA_IRQ_NR; irq++) {
+		// IRQ2 是 PIC 的级联线, 其引脚通常被时钟中断占用
+		if (irq == 2) {
+			continue;
+		}
+
+		uint32_t flags = 0;
+		if ((info->isa_flags[irq] & MP_INTR_POLARITY_MASK) == MP_INTR_POLARITY_LOW) {
+			flags |= IOAPIC_RED_ACTIVE_LOW;
+		}
+		if ((info->isa_flags[irq] & MP_INTR_TRIGGER_MASK) == MP_INTR_TRIGGER_LEVEL) {
+			flags |= IOAPIC_RED_LEVEL;
+		}
+
+		isa_gsi[irq] = info->isa_gsi[irq];
+		ioapic_route(isa_gsi[irq], isa_apic_vector(irq), flags, apic_id);
+		if (!(pic_mask & (1 << irq))) {
+			ioapic_unmask(isa_gsi[irq]);
+		}
+	}
+
+	outb(PIC0_IMR, 0xFF);
+	outb(PIC1_IMR, 0xFF);
+	apic_mode = 1;
+	log_printf("irq: using ioapic");
+	return 0;
+}
+
+int irq_apic_enabled(void) {
+	return apic_mode;
+}
+
+/**
+ * @brief AP启动后加载与BSP共用的IDT
+ */
+void irq_ap_init(void) {
+	lidt((uint32_t) idt_table, sizeof(idt_table));
+}
+
 /**
  * @brief 安装中断或异常处理程序
+ * 外部中断同时安装到 APIC 模式下的向量上, 驱动程序不必关心当前使用哪种中断控制器
  */
 int irq_install(int irq_num, irq_handler_t handler) {
-	if (irq_num >= IDT_TABLE_NR) {
+	if ((irq_num < 0) || (irq_num >= IDT_TABLE_NR)) {
 		return -1;
 	}
 
 	gate_desc_set(idt_table + irq_num, KERNEL_SELECTOR_CS, (uint32_t) handler,
 	              GATE_P_PRESENT | GATE_DPL0 | GATE_TYPE_IDT);
+
+	int isa_irq = vector_to_isa(irq_num);
+	if (isa_irq >= 0) {
+		gate_desc_set(idt_table + isa_apic_vector(isa_irq), KERNEL_SELECTOR_CS, (uint32_t) handler,
+		              GATE_P_PRESENT | GATE_DPL0 | GATE_TYPE_IDT);
+	}
 	return 0;
 }
 
@@ -289,6 +401,14 @@ void irq_enable(int irq_num) {
 		return;
 	}
 
+	if (apic_mode) {
+		int isa_irq = vector_to_isa(irq_num);
+		if (isa_irq >= 0) {
+			ioapic_unmask(isa_gsi[isa_irq]);
+		}
+		return;
+	}
+
 	irq_num -= IRQ_PIC_START;
 	if (irq_num < 8) {
 		uint8_t mask = inb(PIC0_IMR) & ~(1 << irq_num);
@@ -305,6 +425,14 @@ void irq_disable(int irq_num) {
 		return;
 	}
 
+	if (apic_mode) {
+		int isa_irq = vector_to_isa(irq_num);
+		if (isa_irq >= 0) {
+			ioapic_mask(isa_gsi[isa_irq]);
+		}
+		return;
+	}
+
 	irq_num -= IRQ_PIC_START;
 	if (irq_num < 8) {
 		uint8_t mask = inb(PIC0_IMR) | (1 << irq_num);
@@ -324,6 +452,22 @@ void irq_enable_global(void) {
 	sti();
 }
 
+/**
+ * 中断处理函数返回后调用, 执行登记的软中断, 再补做处理期间记录的任务切换
+ * 被打断的代码关着中断或持有锁时都不能做, 由它自己在放锁时处理
+ */
+void irq_exit(exception_frame_t *frame) {
+	cpu_t *cpu = cpu_this();
+	if ((cpu->preempt_count == 0) && (frame->eflags & EFLAGS_IF)) {
+		if (cpu->softirq_pending) {
+			softirq_do_pending();
+		}
+		if (cpu->need_resched) {
+			task_dispatch();
+		}
+	}
+}
+
 irq_state_t irq_enter_protection() {
 	irq_state_t state = read_eflags();
 	irq_disable_global();
@@ -0,0 +1,138 @@
+/**
+ * 本地 APIC
+ * 用于读取 APIC ID、发送处理器间中断唤醒 AP 及通知其调度, 以及提供各 CPU 自己的时钟中断
+ */
+#include "cpu/lapic.h"
+#include "core/memory.h"
+#include "dev/time.h"
+#include "tools/log.h"
+#include "os_cfg.h"
+
+static volatile uint32_t *lapic_base;
+static uint32_t timer_count;            // 每个时钟节拍的定时器计数值
+
+static inline uint32_t lapic_read(int reg) {
+	return lapic_base[reg >> 2];
+}
+
+static inline void lapic_write(int reg, uint32_t value) {
+	lapic_base[reg >> 2] = value;
+	(void) lapic_base[LAPIC_ID >> 2];       // 读一次, 等待写操作完成
+}
+
+/**
+ * 等待上一个处理器间中断发送完毕
+ */
+static void lapic_wait_icr(void) {
+	while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_DELIVS) {
+	}
+}
+
+/**
+ * 映射 LAPIC 寄存器, 各个 CPU 的 LAPIC 位于同一物理地址
+ */
+void lapic_init(uint32_t paddr) {
+	lapic_base = (volatile uint32_t *) memory_map_mmio(paddr, MEM_PAGE_SIZE);
+	if (lapic_base == (volatile uint32_t *) 0) {
+		log_printf("map lapic failed");
+	}
+}
+
+/**
+ * 在当前 CPU 上启用 LAPIC, 屏蔽本地中断引脚
+ * 没有 IOAPIC 时 BSP 仍然通过 8259 接收外部中断, 不调用该函数
+ */
+void lapic_enable(void) {
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_LAPIC_SPURIOUS);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+
+	// 清除错误状态, 需要连续写两次
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+
+	lapic_write(LAPIC_EOI, 0);
+	lapic_write(LAPIC_TPR, 0);
+}
+
+/**
+ * 当前 CPU 的 APIC ID, 未映射时返回 0
+ */
+int lapic_id(void) {
+	if (lapic_base == (volatile uint32_t *) 0) {
+		return 0;
+	}
+	return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * 中断结束, 每次中断都要调用, 不必等待写入完成
+ */
+void lapic_eoi(void) {
+	lapic_base[LAPIC_EOI >> 2] = 0;
+}
+
+/**
+ * 向指定 CPU 发送 INIT 中断, 使其复位并等待 STARTUP
+ */
+void lapic_send_init(int apic_id) {
+	lapic_write(LAPIC_ICR_HI, apic_id << 24);
+	lapic_write(LAPIC_ICR_LO, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+	lapic_wait_icr();
+	lapic_write(LAPIC_ICR_LO, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+	lapic_wait_icr();
+}
+
+/**
+ * 发送 STARTUP 中断, AP 从 entry 处以实模式开始运行, entry 须 4KB 对齐且低于 1MB
+ */
+void lapic_send_startup(int apic_id, uint32_t entry) {
+	lapic_write(LAPIC_ICR_HI, apic_id << 24);
+	lapic_write(LAPIC_ICR_LO, LAPIC_ICR_STARTUP | (entry >> 12));
+	lapic_wait_icr();
+}
+
+/**
+ * 向指定 CPU 发送固定向量的中断. ICR 分两次写入, 调用者须关中断, 以免中断处理中发送的 IPI 插在中间
+ */
+void lapic_send_ipi(int apic_id, int vector) {
+	lapic_wait_icr();
+	lapic_write(LAPIC_ICR_HI, apic_id << 24);
+	lapic_write(LAPIC_ICR_LO, vector & 0xFF);
+}
+
+/**
+ * 用 PIT 测量定时器在一个时钟节拍内的计数值, 各 CPU 的总线频率相同, 只需在 BSP 上测一次
+ */
+int lapic_timer_calibrate(void) {
+	if (lapic_base == (volatile uint32_t *) 0) {
+		return -1;
+	}
+
+	lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | IRQ_LAPIC_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+	time_udelay(LAPIC_TIMER_CALIBRATE_MS * 1000);
+	uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURR);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	timer_count = elapsed / LAPIC_TIMER_CALIBRATE_MS * OS_TICKS_MS;
+	log_printf("lapic timer: %d counts per tick", timer_count);
+	return timer_count ? 0 : -1;
+}
+
+/**
+ * 在当前 CPU 上以周期模式启动定时器, 未校准时返回 -1
+ */
+int lapic_timer_start(void) {
+	if (timer_count == 0) {
+		return -1;
+	}
+
+	lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_PERIODIC | IRQ_LAPIC_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, timer_count);
+	return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * 多处理器配置表解析
+ */
+#include "cpu/mp.h"
+#include "cpu/lapic.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+#define BDA_EBDA_SEG                0x40E       // BIOS 数据区中保存 EBDA 段地址的位置
+#define BDA_BASE_MEM_KB             0x413       // BIOS 数据区中保存常规内存大小 (KB) 的位置
+
+static uint8_t checksum(void *addr, int size) {
+	uint8_t sum = 0;
+	uint8_t *p = (uint8_t *) addr;
+	for (int i = 0; i < size; i++) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+/**
+ * 取得物理地址对应的可访问地址, 一一映射区域之外的临时映射到设备窗口
+ */
+static void *phys_addr(uint32_t paddr, uint32_t size) {
+	if (paddr + size <= MEM_EXT_END) {
+		return (void *) paddr;
+	}
+	return (void *) memory_map_mmio(paddr, size);
+}
+
+/**
+ * 在 [start, start + size) 中按 16 字节对齐查找带校验和的签名
+ */
+static void *scan_signature(uint32_t start, uint32_t size, const char *sig, int sig_len, int sum_len) {
+	for (uint32_t addr = start; addr + sum_len <= start + size; addr += 16) {
+		if (kernel_memcmp((void *) addr, (void *) sig, sig_len) == 0
+		    && checksum((void *) addr, sum_len) == 0) {
+			return (void *) addr;
+		}
+	}
+	return (void *) 0;
+}
+
+/**
+ * 依次在 EBDA 的前 1KB, 常规内存最后 1KB 和 BIOS ROM 中查找
+ */
+static void *scan_bios(const char *sig, int sig_len, int sum_len) {
+	uint32_t ebda = (*(uint16_t *) BDA_EBDA_SEG) << 4;
+	void *p;
+	if (ebda >= MEM_EBDA_START && ebda < MEM_EBDA_END) {
+		if ((p = scan_signature(ebda, 1024, sig, sig_len, sum_len))) {
+			return p;
+		}
+	}
+
+	uint32_t base_end = (*(uint16_t *) BDA_BASE_MEM_KB) * 1024;
+	if (base_end > MEM_EBDA_START && base_end <= MEM_EBDA_END) {
+		if ((p = scan_signature(base_end - 1024, 1024, sig, sig_len, sum_len))) {
+			return p;
+		}
+	}
+
+	return scan_signature(MEM_BIOS_START, MEM_BIOS_END - MEM_BIOS_START, sig, sig_len, sum_len);
+}
+
+static void add_cpu(mp_info_t *info, int apic_id) {
+	if (info->cpu_count >= SMP_CPU_MAX) {
+		log_printf("too many cpus, apic id %d ignored", apic_id);
+		return;
+	}
+	info->apic_id[info->cpu_count++] = apic_id;
+}
+
+static int parse_madt(mp_info_t *info, acpi_madt_t *madt) {
+	info->lapic_addr = madt->lapic_addr;
+
+	uint8_t *p = (uint8_t *) (madt + 1);
+	uint8_t *end = (uint8_t *) madt + madt->header.length;
+	while (p + sizeof(madt_entry_t) <= end) {
+		madt_entry_t *entry = (madt_entry_t *) p;
+		if (entry->length == 0) {
+			break;
+		}
+
+		if (entry->type == MADT_TYPE_LAPIC) {
+			madt_lapic_t *lapic = (madt_lapic_t *) entry;
+			if (lapic->flags & MADT_LAPIC_ENABLED) {
+				add_cpu(info, lapic->apic_id);
+			}
+		} else if ((entry->type == MADT_TYPE_IOAPIC) && !info->ioapic_addr) {
+			madt_ioapic_t *ioapic = (madt_ioapic_t *) entry;
+			info->ioapic_id = ioapic->ioapic_id;
+			info->ioapic_addr = ioapic->addr;
+			info->ioapic_gsi_base = ioapic->gsi_base;
+		} else if (entry->type == MADT_TYPE_OVERRIDE) {
+			madt_override_t *override = (madt_override_t *) entry;
+			if (override->source < ISA_IRQ_NR) {
+				info->isa_gsi[override->source] = override->gsi;
+				info->isa_flags[override->source] = override->flags;
+			}
+		}
+		p += entry->length;
+	}
+
+	return info->cpu_count > 0 ? 0 : -1;
+}
+
+/**
+ * 通过 ACPI 查找 MADT 表
+ */
+static int acpi_init(mp_info_t *info) {
+	acpi_rsdp_t *rsdp = (acpi_rsdp_t *) scan_bios("RSD PTR ", 8, sizeof(acpi_rsdp_t));
+	if (!rsdp) {
+		return -1;
+	}
+
+	acpi_sdt_header_t *rsdt = (acpi_sdt_header_t *) phys_addr(rsdp->rsdt_addr, sizeof(acpi_sdt_header_t));
+	if (!rsdt || kernel_memcmp(rsdt->signature, (void *) "RSDT", 4) != 0) {
+		return -1;
+	}
+	rsdt = (acpi_sdt_header_t *) phys_addr(rsdp->rsdt_addr, rsdt->length);
+	if (!rsdt || checksum(rsdt, rsdt->length) != 0) {
+		return -1;
+	}
+
+	uint32_t *tables = (uint32_t *) (rsdt + 1);
+	int count = (rsdt->length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+	for (int i = 0; i < count; i++) {
+		acpi_sdt_header_t *header = (acpi_sdt_header_t *) phys_addr(tables[i], sizeof(acpi_sdt_header_t));
+		if (!header || kernel_memcmp(header->signature, (void *) "APIC", 4) != 0) {
+			continue;
+		}
+
+		acpi_madt_t *madt = (acpi_madt_t *) phys_addr(tables[i], header->length);
+		if (madt && checksum(madt, madt->header.length) == 0) {
+			return parse_madt(info, madt);
+		}
+	}
+	return -1;
+}
+
+/**
+ * 通过 MP 规范表查找处理器, 用于不支持 ACPI 的老机器
+ */
+static int mp_table_init(mp_info_t *info) {
+	mp_float_t *mpf = (mp_float_t *) scan_bios("_MP_", 4, sizeof(mp_float_t));
+	if (!mpf || mpf->config_addr == 0) {
+		return -1;
+	}
+
+	mp_config_t *conf = (mp_config_t *) phys_addr(mpf->config_addr, sizeof(mp_config_t));
+	if (!conf || kernel_memcmp(conf->signature, (void *) "PCMP", 4) != 0) {
+		return -1;
+	}
+	conf = (mp_config_t *) phys_addr(mpf->config_addr, conf->length);
+	if (!conf || checksum(conf, conf->length) != 0) {
+		return -1;
+	}
+
+	info->lapic_addr = conf->lapic_addr;
+	info->imcr = (mpf->features[1] & MP_FEATURE_IMCR) != 0;
+
+	int isa_bus = -1;
+	uint8_t *p = (uint8_t *) (conf + 1);
+	uint8_t *end = (uint8_t *) conf + conf->length;
+	for (int i = 0; (i < conf->entry_count) && (p < end); i++) {
+		switch (*p) {
+			case MP_ENTRY_PROCESSOR: {
+				mp_proc_t *proc = (mp_proc_t *) p;
+				if (proc->flags & MP_PROC_ENABLED) {
+					add_cpu(info, proc->apic_id);
+				}
+				p += sizeof(mp_proc_t);
+				break;
+			}
+			case MP_ENTRY_IOAPIC: {
+				mp_ioapic_t *ioapic = (mp_ioapic_t *) p;
+				if (!info->ioapic_addr) {
+					info->ioapic_id = ioapic->ioapic_id;
+					info->ioapic_addr = ioapic->addr;
+				}
+				p += sizeof(mp_ioapic_t);
+				break;
+			}
+			case MP_ENTRY_BUS: {
+				mp_bus_t *bus = (mp_bus_t *) p;
+				if (kernel_memcmp(bus->bus_type, (void *) "ISA", 3) == 0) {
+					isa_bus = bus->bus_id;
+				}
+				p += sizeof(mp_bus_t);
+				break;
+			}
+			case MP_ENTRY_IOINTR: {
+				// 总线和 IOAPIC 表项都排在中断表项之前, 只处理第一个 IOAPIC 上的 ISA 中断
+				mp_iointr_t *intr = (mp_iointr_t *) p;
+				if ((intr->intr_type == 0) && (intr->src_bus == isa_bus) && (intr->src_irq < ISA_IRQ_NR)
+				    && (intr->dst_ioapic == info->ioapic_id)) {
+					info->isa_gsi[intr->src_irq] = intr->dst_pin;
+					info->isa_flags[intr->src_irq] = intr->flags;
+				}
+				p += sizeof(mp_iointr_t);
+				break;
+			}
+			default:
+				// 其余表项均为 8 字节
+				p += 8;
+				break;
+		}
+	}
+
+	return info->cpu_count > 0 ? 0 : -1;
+}
+
+/**
+ * 清空配置, ISA 中断默认与 IOAPIC 引脚一一对应
+ */
+static void reset_info(mp_info_t *info) {
+	kernel_memset(info, 0, sizeof(mp_info_t));
+	for (int i = 0; i < ISA_IRQ_NR; i++) {
+		info->isa_gsi[i] = i;
+	}
+}
+
+/**
+ * 获取处理器及中断控制器配置, 都找不到时按单处理器处理
+ */
+int mp_init(mp_info_t *info) {
+	reset_info(info);
+
+	if (acpi_init(info) == 0) {
+		log_printf("acpi: %d cpu(s), lapic 0x%x", info->cpu_count, info->lapic_addr);
+		return 0;
+	}
+
+	reset_info(info);
+	if (mp_table_init(info) == 0) {
+		log_printf("mp table: %d cpu(s), lapic 0x%x", info->cpu_count, info->lapic_addr);
+		return 0;
+	}
+
+	reset_info(info);
+	info->cpu_count = 1;
+	info->lapic_addr = LAPIC_DEFAULT_BASE;
+	return -1;
+}
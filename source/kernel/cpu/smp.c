@@ -0,0 +1,231 @@
+/**
+ * 多处理器启动
+ *
+ * BSP 解析 MP/ACPI 表得到所有 CPU, 为每个 AP 创建空闲任务, 再按 INIT-SIPI-SIPI 的顺序唤醒.
+ * 所有 CPU 共用一张 GDT: 任务切换使用各任务自己的 TSS, 每个 AP 以自己的空闲任务的 TSS 运行.
+ */
+#include "cpu/smp.h"
+#include "cpu/mp.h"
+#include "cpu/lapic.h"
+#include "cpu/cpu.h"
+#include "cpu/irq.h"
+#include "core/task.h"
+#include "core/softirq.h"
+#include "core/memory.h"
+#include "dev/time.h"
+#include "dev/pci.h"
+#include "comm/cpu_instr.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+#define CMOS_ADDR_PORT              0x70
+#define CMOS_DATA_PORT              0x71
+#define CMOS_SHUTDOWN_STATUS        0x0F
+#define CMOS_WARM_RESET             0x0A
+#define BDA_WARM_RESET_VECTOR       0x467
+
+#define AP_START_TIMEOUT_MS         100
+
+static cpu_t cpu_table[SMP_CPU_MAX];
+static int cpu_count = 1;
+static uint8_t apic_to_cpu[256];
+static uint8_t tss_to_cpu[GDT_TABLE_SIZE];     // 按 TSS 选择子查任务所在的 CPU
+
+/**
+ * 当前 CPU, 多处理器启动前总是 BSP
+ * 任务不在 CPU 间迁移, 由 TR 中当前任务的 TSS 即可查到, 不必读本地 APIC 的寄存器.
+ * 只有 AP 载入自己空闲任务的 TSS 之前才按 APIC ID 查找
+ */
+cpu_t *cpu_this(void) {
+	if (cpu_count == 1) {
+		return cpu_table;
+	}
+
+	uint16_t tss_selector = read_tr();
+	if (tss_selector == 0) {
+		return cpu_table + apic_to_cpu[lapic_id()];
+	}
+	return cpu_table + tss_to_cpu[tss_selector >> 3];
+}
+
+/**
+ * 记录以该 TSS 运行的任务所在的 CPU, 任务启动时调用
+ */
+void smp_bind_tss(int tss_selector, int cpu_id) {
+	tss_to_cpu[tss_selector >> 3] = cpu_id;
+}
+
+cpu_t *cpu_get(int id) {
+	return cpu_table + id;
+}
+
+int smp_cpu_count(void) {
+	return cpu_count;
+}
+
+/**
+ * 通知另一个 CPU 检查调度请求, 请求本身由调用者事先记在 need_resched 中
+ */
+void smp_send_resched(cpu_t *cpu) {
+	if ((cpu == cpu_this()) || !cpu->online) {
+		return;
+	}
+
+	irq_state_t state = irq_enter_protection();
+	lapic_send_ipi(cpu->apic_id, IRQ_LAPIC_RESCHED);
+	irq_leave_protection(state);
+}
+
+/**
+ * 等待另一个 CPU 响应一次处理器间中断
+ * 它在关中断期间所做的事 (如退出的任务切换出去) 在返回时一定已经完成
+ */
+void smp_sync(cpu_t *cpu) {
+	if ((cpu == cpu_this()) || !cpu->online) {
+		return;
+	}
+
+	uint32_t count = cpu->ipi_count;
+	smp_send_resched(cpu);
+	while (cpu->ipi_count == count) {
+		cpu_pause();
+	}
+}
+
+/**
+ * 调度处理器间中断, 切换在中断返回时的 irq_exit 中完成
+ */
+void do_handler_lapic_resched(exception_frame_t *frame) {
+	lapic_eoi();
+	cpu_this()->ipi_count++;
+}
+
+/**
+ * AP 进入保护模式并开启分页后的入口, 运行在自己的空闲任务栈上
+ */
+static void ap_main(void) {
+	cpu_ap_init();
+	irq_ap_init();
+	lapic_enable();
+
+	cpu_t *cpu = cpu_this();
+	task_t *idle = cpu->idle_task;
+	cpu->current = idle;
+	idle->state = TASK_RUNNING;
+	write_tr(idle->tss_selector);
+
+	// 没有本地时钟就无法按时间片抢占, 这样的 AP 只运行空闲任务
+	cpu->online = lapic_timer_start() == 0;
+	cpu->started = 1;
+
+	// 空闲时停机, 有任务就绪时由处理器间中断唤醒, 在中断返回时切换
+	irq_enable_global();
+	while (1) {
+		hlt();
+	}
+}
+
+/**
+ * 设置热复位向量, 部分老的处理器在 INIT 后从这里开始运行
+ */
+static void set_warm_reset(uint32_t entry) {
+	outb(CMOS_ADDR_PORT, CMOS_SHUTDOWN_STATUS);
+	outb(CMOS_DATA_PORT, CMOS_WARM_RESET);
+
+	uint16_t *vector = (uint16_t *) BDA_WARM_RESET_VECTOR;
+	vector[0] = 0;
+	vector[1] = entry >> 4;
+}
+
+/**
+ * 按 MP 规范唤醒一个 AP, 并等待其完成启动
+ */
+static int ap_start(cpu_t *cpu) {
+	extern uint32_t ap_boot_cr3, ap_boot_esp, ap_boot_entry;
+	extern uint8_t ap_boot_start[];
+
+	// 启动代码已复制到低端内存, 参数需要写在复制后的位置
+	*(uint32_t *) (AP_BOOT_ADDR + ((uint8_t *) &ap_boot_cr3 - ap_boot_start)) = memory_kernel_page_dir();
+	*(uint32_t *) (AP_BOOT_ADDR + ((uint8_t *) &ap_boot_esp - ap_boot_start)) = cpu->idle_task->tss.esp0;
+	*(uint32_t *) (AP_BOOT_ADDR + ((uint8_t *) &ap_boot_entry - ap_boot_start)) = (uint32_t) ap_main;
+
+	set_warm_reset(AP_BOOT_ADDR);
+
+	lapic_send_init(cpu->apic_id);
+	time_udelay(10000);
+	for (int i = 0; i < 2; i++) {
+		lapic_send_startup(cpu->apic_id, AP_BOOT_ADDR);
+		time_udelay(200);
+	}
+
+	for (int ms = 0; !cpu->started && (ms < AP_START_TIMEOUT_MS); ms++) {
+		time_udelay(1000);
+	}
+	return cpu->started ? 0 : -1;
+}
+
+/**
+ * 唤醒所有 AP, 在任务管理器初始化后、开中断前调用
+ */
+void smp_init(void) {
+	extern uint8_t ap_boot_start[], ap_boot_end[];
+
+	mp_info_t info;
+	mp_init(&info);
+	lapic_init(info.lapic_addr);
+
+	// 有 IOAPIC 时 BSP 也启用本地 APIC, 外部中断改由 IOAPIC 投递, 时钟改用本地定时器
+	// 切换失败时本地 APIC 保持原状, 8259 的中断仍经 LINT0 送达
+	if (info.ioapic_addr && (irq_apic_init(&info) == 0)) {
+		lapic_enable();
+		time_lapic_init();
+		pci_irq_apic_init();
+		irq_install(IRQ_LAPIC_RESCHED, exception_handler_lapic_resched);
+	}
+
+	int bsp_apic_id = lapic_id();
+	cpu_table[0].apic_id = bsp_apic_id;
+	cpu_table[0].started = 1;
+	cpu_table[0].online = 1;
+	apic_to_cpu[bsp_apic_id] = 0;
+
+	kernel_memcpy((void *) AP_BOOT_ADDR, ap_boot_start, ap_boot_end - ap_boot_start);
+
+	for (int i = 0; i < info.cpu_count; i++) {
+		int apic_id = info.apic_id[i];
+		if (apic_id == bsp_apic_id) {
+			continue;
+		}
+
+		cpu_t *cpu = cpu_table + cpu_count;
+		kernel_memset(cpu, 0, sizeof(cpu_t));
+		cpu->id = cpu_count;
+		cpu->apic_id = apic_id;
+		sched_rq_init(&cpu->rq);
+		list_init(&cpu->tasklet_list);
+		cpu->idle_task = task_create_idle(cpu->id);
+		if (cpu->idle_task == (task_t *) 0) {
+			log_printf("cpu %d: create idle task failed", cpu->id);
+			break;
+		}
+
+		// 先登记, AP 启动后通过 cpu_this 找到自己
+		apic_to_cpu[apic_id] = cpu->id;
+		cpu_count++;
+
+		if (ap_start(cpu) < 0) {
+			log_printf("cpu %d (apic %d) not responding", cpu->id, apic_id);
+			cpu_count--;
+			task_uninit(cpu->idle_task);
+			free_task(cpu->idle_task);
+			kernel_memset(cpu, 0, sizeof(cpu_t));
+			continue;
+		}
+
+		if (cpu->online) {
+			softirq_cpu_init(cpu->id);
+		}
+	}
+
+	log_printf("smp: %d cpu(s) online", cpu_count);
+}
@@ -0,0 +1,554 @@
+/**
+ * AHCI SATA 控制器
+ *
+ * 每个端口的命令槽组成一个小队列: 请求队列线程取出一组请求后占用一个空闲槽发出命令,
+ * 不等完成就继续取下一组, 直到槽用完或达到磁盘的队列深度. 支持 NCQ 的磁盘用 FPDMA 命令,
+ * 可以乱序完成; 否则每次只发一条命令. 中断中只应答并记下端口状态, 完成的请求由小任务结束
+ */
+#include "dev/ahci.h"
+#include "dev/dev.h"
+#include "tools/log.h"
+#include "tools/klib.h"
+#include "core/memory.h"
+
+#define HBA_REG(reg)            (hba[(reg) / 4])
+#define PORT_REG(port, reg)     ((port)->regs[(reg) / 4])
+
+static volatile uint32_t *hba;
+static uint32_t hba_cap;
+static ahci_port_t port_buf[AHCI_DISK_MAX];
+static int port_count;
+static pci_irq_t ahci_irq;
+static int ahci_poll;               // 中断安装失败, 每条命令都查询等待完成
+
+/**
+ * 等待寄存器中的 mask 位全部清零, 超时返回 -1
+ */
+static int ahci_wait_clear(volatile uint32_t *reg, uint32_t mask) {
+	for (int i = 0; i < AHCI_SPIN_MAX; i++) {
+		if (!(*reg & mask)) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * 停止端口的命令处理和 FIS 接收, 之后 CI 和 SACT 被清零
+ */
+static int ahci_port_stop(ahci_port_t *port) {
+	PORT_REG(port, AHCI_PxCMD) &= ~AHCI_PxCMD_ST;
+	if (ahci_wait_clear(&PORT_REG(port, AHCI_PxCMD), AHCI_PxCMD_CR) < 0) {
+		return -1;
+	}
+
+	PORT_REG(port, AHCI_PxCMD) &= ~AHCI_PxCMD_FRE;
+	return ahci_wait_clear(&PORT_REG(port, AHCI_PxCMD), AHCI_PxCMD_FR);
+}
+
+static void ahci_port_start(ahci_port_t *port) {
+	PORT_REG(port, AHCI_PxSERR) = 0xFFFFFFFF;
+	PORT_REG(port, AHCI_PxIS) = 0xFFFFFFFF;
+	PORT_REG(port, AHCI_PxCMD) |= AHCI_PxCMD_FRE;
+	PORT_REG(port, AHCI_PxCMD) |= AHCI_PxCMD_ST;
+}
+
+/**
+ * 为端口分配命令列表、FIS 接收区和各命令槽的命令表
+ * 命令列表 1KB, 接收区 256 字节, 放在同一页中; 每个命令表占一页
+ */
+static int ahci_port_rebase(ahci_port_t *port) {
+	if (ahci_port_stop(port) < 0) {
+		log_printf("ahci %s: stop port failed\n", port->name);
+		return -1;
+	}
+
+	uint32_t page = memory_alloc_page();
+	if (page == 0) {
+		return -1;
+	}
+	kernel_memset((void *) page, 0, MEM_PAGE_SIZE);
+	port->cmd_list = (ahci_cmd_header_t *) page;
+	port->fis = (uint8_t *) (page + 1024);
+
+	for (int i = 0; i < port->slot_count; i++) {
+		uint32_t table = memory_alloc_page();
+		if (table == 0) {
+			return -1;
+		}
+		kernel_memset((void *) table, 0, MEM_PAGE_SIZE);
+		port->cmd_table[i] = (ahci_cmd_table_t *) table;
+		port->cmd_list[i].ctba = table;
+		port->cmd_list[i].ctbau = 0;
+	}
+
+	PORT_REG(port, AHCI_PxCLB) = (uint32_t) port->cmd_list;
+	PORT_REG(port, AHCI_PxCLBU) = 0;
+	PORT_REG(port, AHCI_PxFB) = (uint32_t) port->fis;
+	PORT_REG(port, AHCI_PxFBU) = 0;
+	ahci_port_start(port);
+	return 0;
+}
+
+/**
+ * 追加一段物理连续的内存, 与上一项相接时合并
+ * 返回追加后的描述符数量, 内存不满足 DMA 要求或描述符用完时返回 -1
+ */
+static int ahci_prdt_add(ahci_cmd_table_t *table, int count, uint32_t paddr, uint32_t size) {
+	if ((paddr & 0x1) || (size & 0x1)) {
+		return -1;
+	}
+
+	ahci_prd_t *prd = table->prdt + count - 1;
+	if (count && (prd->dba + prd->dbc + 1 == paddr) && (prd->dbc + 1 + size <= AHCI_PRD_MAX_SIZE)) {
+		prd->dbc += size;
+		return count;
+	}
+
+	if (count >= AHCI_PRDT_NR) {
+		return -1;
+	}
+	prd = table->prdt + count++;
+	prd->dba = paddr;
+	prd->dbau = 0;
+	prd->dbc = size - 1;
+	return count;
+}
+
+/**
+ * 在命令槽中填写一组请求的命令, 返回 -1 表示缓冲区无法用于 DMA
+ */
+static int ahci_setup(ahci_port_t *port, int slot, blk_request_t *req, uint8_t cmd) {
+	ahci_cmd_table_t *table = port->cmd_table[slot];
+	int count = 0;
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		bio_iter_t iter;
+		uint32_t paddr, len;
+		bio_iter_init(&iter, part->bio, part->bio_offset, part->count * port->sector_size);
+		while ((len = bio_iter_next(&iter, &paddr, AHCI_PRD_MAX_SIZE)) > 0) {
+			count = ahci_prdt_add(table, count, paddr, len);
+			if (count < 0) {
+				return -1;
+			}
+		}
+	}
+
+	fis_reg_h2d_t *fis = (fis_reg_h2d_t *) table->cfis;
+	kernel_memset(fis, 0, sizeof(fis_reg_h2d_t));
+	fis->type = FIS_TYPE_REG_H2D;
+	fis->flags = FIS_H2D_CMD;
+	fis->command = cmd;
+	fis->lba0 = (uint8_t) req->sector;
+	fis->lba1 = (uint8_t) (req->sector >> 8);
+	fis->lba2 = (uint8_t) (req->sector >> 16);
+	fis->lba3 = (uint8_t) (req->sector >> 24);
+	if ((cmd == ATA_CMD_READ_FPDMA) || (cmd == ATA_CMD_WRITE_FPDMA)) {
+		// NCQ 命令的扇区数放在特征字段, 计数字段存放命令槽号
+		fis->feature_lo = (uint8_t) req->sectors;
+		fis->feature_hi = (uint8_t) (req->sectors >> 8);
+		fis->count_lo = slot << 3;
+		fis->device = ATA_DEVICE_LBA;
+	} else if (cmd != ATA_CMD_IDENTIFY) {
+		fis->count_lo = (uint8_t) req->sectors;
+		fis->count_hi = (uint8_t) (req->sectors >> 8);
+		fis->device = ATA_DEVICE_LBA;
+	}
+
+	ahci_cmd_header_t *header = port->cmd_list + slot;
+	header->flags = AHCI_CMD_CFL(sizeof(fis_reg_h2d_t)) | (req->is_write ? AHCI_CMD_WRITE : 0);
+	header->prdtl = count;
+	header->prdbc = 0;
+	return 0;
+}
+
+/**
+ * 发出命令槽中的命令, 调用者持有端口的锁
+ */
+static void ahci_issue(ahci_port_t *port, int slot, uint8_t cmd) {
+	if ((cmd == ATA_CMD_READ_FPDMA) || (cmd == ATA_CMD_WRITE_FPDMA)) {
+		PORT_REG(port, AHCI_PxSACT) = 1 << slot;
+	}
+	PORT_REG(port, AHCI_PxCI) = 1 << slot;
+}
+
+/**
+ * 查询等待命令槽中的命令完成或出错, 端口中断状态转入 irq_status
+ * 超时按出错处理, 由 ahci_complete 停止端口并让未完成的命令失败
+ */
+static void ahci_poll_slot(ahci_port_t *port, int slot) {
+	uint32_t status = 0;
+	int done = 0;
+	for (int i = 0; (i < AHCI_SPIN_MAX) && !done; i++) {
+		status = PORT_REG(port, AHCI_PxIS);
+		uint32_t active = PORT_REG(port, AHCI_PxSACT) | PORT_REG(port, AHCI_PxCI);
+		done = !(active & (1 << slot)) || (status & AHCI_PxIS_TFES);
+	}
+
+	irq_state_t state = spin_lock_irqsave(&port->lock);
+	status = PORT_REG(port, AHCI_PxIS);
+	PORT_REG(port, AHCI_PxIS) = status;
+	port->irq_status |= status;
+	if (!done) {
+		log_printf("ahci %s: slot %d timeout\n", port->name, slot);
+		port->irq_status |= AHCI_PxIS_TFES;
+	}
+	spin_unlock_irqrestore(&port->lock, state);
+}
+
+/**
+ * 初始化时用槽 0 查询执行一条命令, 此时端口上没有其它命令
+ */
+static int ahci_exec(ahci_port_t *port, uint8_t cmd, uint32_t sector, void *buf) {
+	bio_t bio;
+	bio_vec_t vec[1];
+	bio_init(&bio, 0, sector, vec, 1);
+	if (bio_add_buf(&bio, buf, SECTOR_SIZE) != SECTOR_SIZE) {
+		return -1;
+	}
+
+	blk_request_t req;
+	blk_request_init(&req, &bio, 0, sector, 1, 0, 0);
+	if (ahci_setup(port, 0, &req, cmd) < 0) {
+		return -1;
+	}
+
+	ahci_issue(port, 0, cmd);
+	ahci_poll_slot(port, 0);
+
+	int err = (port->irq_status & AHCI_PxIS_TFES) || (PORT_REG(port, AHCI_PxCI) & 1);
+	port->irq_status = 0;
+	if (err) {
+		ahci_port_stop(port);
+		ahci_port_start(port);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * 结束已完成的命令: 不再处于 SACT 或 CI 中的槽已完成
+ * 磁盘报告错误时端口停止处理命令, 仍未完成的全部按失败结束, 再重启端口
+ */
+static void ahci_complete(ahci_port_t *port) {
+	blk_request_t *req_list[AHCI_SLOT_MAX];
+	int done_list[AHCI_SLOT_MAX];
+	int count = 0;
+
+	irq_state_t state = spin_lock_irqsave(&port->lock);
+	uint32_t status = port->irq_status;
+	port->irq_status = 0;
+
+	uint32_t active = PORT_REG(port, AHCI_PxSACT) | PORT_REG(port, AHCI_PxCI);
+	uint32_t failed = 0;
+	if (status & AHCI_PxIS_TFES) {
+		log_printf("ahci %s: error, tfd %x\n", port->name, PORT_REG(port, AHCI_PxTFD));
+		failed = port->issued & active;
+		ahci_port_stop(port);
+		ahci_port_start(port);
+	}
+
+	uint32_t finished = port->issued & (~active | failed);
+	for (int slot = 0; finished; slot++) {
+		if (!(finished & (1 << slot))) {
+			continue;
+		}
+
+		finished &= ~(1 << slot);
+		req_list[count] = port->slot_req[slot];
+		done_list[count] = (failed & (1 << slot)) ? 0 : req_list[count]->sectors;
+		count++;
+		port->slot_req[slot] = (blk_request_t *) 0;
+		port->issued &= ~(1 << slot);
+		port->reserved &= ~(1 << slot);
+	}
+	spin_unlock_irqrestore(&port->lock, state);
+
+	for (int i = 0; i < count; i++) {
+		blk_end_request(&port->queue, req_list[i], done_list[i]);
+	}
+}
+
+static void ahci_tasklet(void *data) {
+	ahci_complete((ahci_port_t *) data);
+}
+
+/**
+ * 请求队列的执行函数: 占用一个空闲槽发出命令后立即返回, 由中断下半部结束请求
+ * 队列深度不超过槽数, 执行到这里时一定有空闲槽
+ */
+static void ahci_request(blk_queue_t *queue, blk_request_t *req) {
+	ahci_port_t *port = (ahci_port_t *) queue->data;
+
+	uint8_t cmd;
+	if (port->ncq) {
+		cmd = req->is_write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+	} else {
+		cmd = req->is_write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+	}
+
+	// 准备命令表时不持锁, 槽先记为已分配; 写入 CI 时才记为已发出, 以免被 ahci_complete 当作已完成
+	irq_state_t state = spin_lock_irqsave(&port->lock);
+	int slot = 0;
+	while ((slot < port->slot_count) && (port->reserved & (1 << slot))) {
+		slot++;
+	}
+	if (slot < port->slot_count) {
+		port->reserved |= 1 << slot;
+		port->slot_req[slot] = req;
+	}
+	spin_unlock_irqrestore(&port->lock, state);
+
+	if (slot >= port->slot_count) {
+		log_printf("ahci %s: no free slot\n", port->name);
+		blk_end_request(queue, req, 0);
+		return;
+	}
+
+	if (ahci_setup(port, slot, req, cmd) < 0) {
+		log_printf("ahci %s: buffer can't be used for dma\n", port->name);
+		state = spin_lock_irqsave(&port->lock);
+		port->reserved &= ~(1 << slot);
+		port->slot_req[slot] = (blk_request_t *) 0;
+		spin_unlock_irqrestore(&port->lock, state);
+		blk_end_request(queue, req, 0);
+		return;
+	}
+
+	state = spin_lock_irqsave(&port->lock);
+	port->issued |= 1 << slot;
+	ahci_issue(port, slot, cmd);
+	spin_unlock_irqrestore(&port->lock, state);
+
+	// 队列线程创建之前须在返回前完成
+	if (ahci_poll || (queue->thread == (task_t *) 0)) {
+		ahci_poll_slot(port, slot);
+		ahci_complete(port);
+	}
+}
+
+static void ahci_detect_part(ahci_port_t *port) {
+	static mbr_t mbr;
+	if (ahci_exec(port, ATA_CMD_READ_DMA_EXT, 0, &mbr) < 0) {
+		log_printf("ahci %s: read MBR failed\n", port->name);
+		return;
+	}
+
+	part_item_t *item = mbr.part_item;
+	for (int i = 0; i < MBR_PRIMARY_PART_NR; ++i, ++item) {
+		ahci_part_t *part = port->part + i + 1;
+		if (item->system_id != FS_INVALID) {
+			part->start_sector = item->relative_sectors;
+			part->total_sectors = item->total_sectors;
+		}
+	}
+}
+
+/**
+ * 读取磁盘参数, 磁盘和控制器都支持 NCQ 时启用
+ */
+static int ahci_identify(ahci_port_t *port) {
+	static uint16_t buf[256];
+	if (ahci_exec(port, ATA_CMD_IDENTIFY, 0, buf) < 0) {
+		log_printf("ahci %s: identify failed\n", port->name);
+		return -1;
+	}
+
+	port->sector_size = SECTOR_SIZE;
+	port->sector_count = *(uint32_t *) (buf + ATA_IDENT_LBA48_SECTORS);
+	port->ncq = 0;
+	if ((hba_cap & AHCI_CAP_SNCQ) && (buf[ATA_IDENT_SATA_CAPS] & ATA_IDENT_SATA_NCQ)) {
+		int depth = (buf[ATA_IDENT_QUEUE_DEPTH] & 0x1F) + 1;
+		port->ncq = depth < port->slot_count ? depth : port->slot_count;
+	}
+
+	kernel_memset(port->part, 0, sizeof(port->part));
+	for (int i = 0; i < DISK_PRIMARY_PART_CNT; i++) {
+		port->part[i].port = port;
+	}
+	port->part[0].total_sectors = port->sector_count;
+	ahci_detect_part(port);
+	return 0;
+}
+
+static void print_port_info(ahci_port_t *port) {
+	log_printf("Disk %s: ahci port %d\n", port->name, port->index);
+	log_printf("    ncq %s, queue depth %d\n", port->ncq ? "on" : "off", port->queue.depth);
+	log_printf("    total size: %dM\n", port->sector_size * port->sector_count / 1024 / 1024);
+	for (int i = 1; i < DISK_PRIMARY_PART_CNT; i++) {
+		ahci_part_t *part = port->part + i;
+		if (part->total_sectors) {
+			log_printf("        %s%d: %dM\n", port->name, i, part->total_sectors * port->sector_size / 1024 / 1024);
+		}
+	}
+}
+
+/**
+ * 检查端口上是否连接了 SATA 磁盘
+ */
+static int ahci_port_present(volatile uint32_t *regs) {
+	uint32_t ssts = regs[AHCI_PxSSTS / 4];
+	if (((ssts & 0xF) != AHCI_SSTS_DET_PRESENT) || (((ssts >> 8) & 0xF) != 1)) {
+		return 0;
+	}
+	return regs[AHCI_PxSIG / 4] == AHCI_SIG_ATA;
+}
+
+static void ahci_port_init(int index) {
+	ahci_port_t *port = port_buf + port_count;
+	kernel_memset(port, 0, sizeof(ahci_port_t));
+	kernel_sprintf(port->name, "hd%c", port_count + 'a');
+	port->index = index;
+	port->regs = hba + (AHCI_PORT_BASE + index * AHCI_PORT_SIZE) / 4;
+	port->slot_count = AHCI_CAP_NCS(hba_cap);
+	spinlock_init(&port->lock, "ahci");
+	tasklet_init(&port->tasklet, ahci_tasklet, port);
+
+	if ((ahci_port_rebase(port) < 0) || (ahci_identify(port) < 0)) {
+		return;
+	}
+
+	blk_queue_init(&port->queue, port->name, port->sector_size, AHCI_XFER_MAX_SECTORS, ahci_request, port);
+	blk_queue_set_depth(&port->queue, port->ncq ? port->ncq : 1);
+	for (int i = 1; i < DISK_PRIMARY_PART_CNT; i++) {
+		if (port->part[i].total_sectors) {
+			blk_queue_add_part(&port->queue, i, port->part[i].start_sector, port->part[i].total_sectors);
+		}
+	}
+	PORT_REG(port, AHCI_PxIE) = AHCI_PxIE_DEFAULT;
+	port_count++;
+	print_port_info(port);
+}
+
+/**
+ * 查找 AHCI 控制器并初始化已连接磁盘的端口, 支持 MSI 时在切换到 APIC 后改用 MSI
+ */
+void ahci_init(void) {
+	pci_dev_t *dev = (pci_dev_t *) 0;
+	while ((dev = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, dev)) != (pci_dev_t *) 0) {
+		if (dev->prog_if == PCI_SATA_PROG_AHCI) {
+			break;
+		}
+	}
+	if (dev == (pci_dev_t *) 0) {
+		return;
+	}
+
+	log_printf("Check ahci...\n");
+	pci_enable(dev, PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+	hba = (volatile uint32_t *) memory_map_mmio(pci_bar_addr(dev, AHCI_ABAR),
+	                                            AHCI_PORT_BASE + AHCI_PORT_MAX * AHCI_PORT_SIZE);
+	if (hba == (volatile uint32_t *) 0) {
+		log_printf("ahci: map registers failed\n");
+		return;
+	}
+
+	HBA_REG(AHCI_GHC) |= AHCI_GHC_AE;
+	hba_cap = HBA_REG(AHCI_CAP);
+
+	uint32_t pi = HBA_REG(AHCI_PI);
+	for (int i = 0; (i < AHCI_PORT_MAX) && (port_count < AHCI_DISK_MAX); i++) {
+		if ((pi & (1 << i)) && ahci_port_present(hba + (AHCI_PORT_BASE + i * AHCI_PORT_SIZE) / 4)) {
+			ahci_port_init(i);
+		}
+	}
+
+	if (port_count == 0) {
+		return;
+	}
+
+	if (pci_irq_install(&ahci_irq, dev, exception_handler_ahci, IRQ_MSI_AHCI) < 0) {
+		log_printf("ahci: no irq, use polling\n");
+		ahci_poll = 1;
+		return;
+	}
+	HBA_REG(AHCI_IS) = 0xFFFFFFFF;
+	HBA_REG(AHCI_GHC) |= AHCI_GHC_IE;
+}
+
+/**
+ * 应答各端口的中断并记下状态, 先清端口的状态再清控制器的
+ */
+void do_handler_ahci(exception_frame_t *frame) {
+	uint32_t is = HBA_REG(AHCI_IS);
+	for (int i = 0; i < port_count; i++) {
+		ahci_port_t *port = port_buf + i;
+		if (!(is & (1 << port->index))) {
+			continue;
+		}
+
+		spin_lock(&port->lock);
+		uint32_t status = PORT_REG(port, AHCI_PxIS);
+		PORT_REG(port, AHCI_PxIS) = status;
+		port->irq_status |= status;
+		spin_unlock(&port->lock);
+		tasklet_schedule(&port->tasklet);
+	}
+	HBA_REG(AHCI_IS) = is;
+	irq_send_eoi(ahci_irq.vector);
+}
+
+int ahci_open(device_t *dev) {
+	int port_id = (dev->minor >> 4) - 0xa;
+	int part_id = dev->minor & 0xF;
+
+	if (port_id < 0 || port_id >= port_count || part_id >= DISK_PRIMARY_PART_CNT) {
+		log_printf("ahci_open: invalid disk id or partition id\n");
+		return -1;
+	}
+
+	ahci_part_t *part = port_buf[port_id].part + part_id;
+	if (part->total_sectors == 0) {
+		log_printf("ahci_open: partition %s%d doesn't exist\n", port_buf[port_id].name, part_id);
+		return -1;
+	}
+
+	dev->data = part;
+	return 0;
+}
+
+int ahci_read(device_t *dev, int addr, char *buf, int size) {
+	ahci_part_t *part = (ahci_part_t *) dev->data;
+	int sector_cnt = blk_rw(&part->port->queue, 0, part->start_sector + addr, buf, size);
+	if (sector_cnt < size) {
+		log_printf("ahci_read: disk(%s) read error: start sect %d, count %d", part->port->name, addr, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int ahci_write(device_t *dev, int addr, const char *buf, int size) {
+	ahci_part_t *part = (ahci_part_t *) dev->data;
+	int sector_cnt = blk_rw(&part->port->queue, 1, part->start_sector + addr, (char *) buf, size);
+	if (sector_cnt < size) {
+		log_printf("ahci_write: disk(%s) write error: start sect %d, count %d", part->port->name, addr, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int ahci_submit(device_t *dev, bio_t *bio) {
+	ahci_part_t *part = (ahci_part_t *) dev->data;
+	int sector_cnt = blk_submit_bio(&part->port->queue, bio, part->start_sector);
+	if (sector_cnt < (int) (bio->size / part->port->sector_size)) {
+		log_printf("ahci_submit: disk(%s) %s error: start sect %d, count %d", part->port->name,
+		           bio->is_write ? "write" : "read", bio->sector, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int ahci_control(device_t *dev, int cmd, int arg0, int arg1) {
+	return 0;
+}
+
+void ahci_close(device_t *dev) {
+
+}
+
+dev_desc_t dev_ahci_desc = {
+		.name = "ahci",
+		.major = DEV_TYPE_AHCI,
+		.open = ahci_open,
+		.read = ahci_read,
+		.write = ahci_write,
+		.control = ahci_control,
+		.close = ahci_close,
+		.submit = ahci_submit,
+};
@@ -0,0 +1,125 @@
+/**
+ * 块设备读写描述
+ */
+#include "dev/bio.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+
+void bio_init(bio_t *bio, int is_write, uint32_t sector, bio_vec_t *vec, int vec_max) {
+	bio->is_write = is_write;
+	bio->sector = sector;
+	bio->size = 0;
+	bio->vec = vec;
+	bio->vcnt = 0;
+	bio->vec_max = vec_max;
+}
+
+/**
+ * 追加一段, 与上一段物理相接时合并. 段数已满时返回 -1
+ */
+int bio_add_page(bio_t *bio, uint32_t page, uint32_t offset, uint32_t len) {
+	if (bio->vcnt > 0) {
+		bio_vec_t *last = bio->vec + bio->vcnt - 1;
+		if (last->page + last->offset + last->len == page + offset) {
+			last->len += len;
+			bio->size += len;
+			return 0;
+		}
+	}
+
+	if (bio->vcnt >= bio->vec_max) {
+		return -1;
+	}
+
+	bio_vec_t *vec = bio->vec + bio->vcnt++;
+	vec->page = page;
+	vec->offset = offset;
+	vec->len = len;
+	bio->size += len;
+	return 0;
+}
+
+/**
+ * 按当前任务的地址空间把缓冲区拆成物理页中的段, 段数用完时停止
+ * 返回加入的字节数, 地址无效时返回 -1
+ */
+int bio_add_buf(bio_t *bio, void *buf, uint32_t size) {
+	uint32_t vaddr = (uint32_t) buf;
+	uint32_t added = 0;
+	while (added < size) {
+		uint32_t paddr = memory_buf_paddr(vaddr);
+		if (paddr == 0) {
+			return -1;
+		}
+
+		uint32_t offset = vaddr & (MEM_PAGE_SIZE - 1);
+		uint32_t curr_size = MEM_PAGE_SIZE - offset;
+		if (curr_size > size - added) {
+			curr_size = size - added;
+		}
+
+		if (bio_add_page(bio, paddr - offset, offset, curr_size) < 0) {
+			break;
+		}
+		vaddr += curr_size;
+		added += curr_size;
+	}
+	return added;
+}
+
+/**
+ * 从 bio 数据的第 start 个字节开始, 遍历 size 个字节
+ */
+void bio_iter_init(bio_iter_t *iter, bio_t *bio, uint32_t start, uint32_t size) {
+	iter->bio = bio;
+	iter->idx = 0;
+	while ((iter->idx < bio->vcnt) && (start >= bio->vec[iter->idx].len)) {
+		start -= bio->vec[iter->idx++].len;
+	}
+	iter->offset = start;
+	iter->left = size;
+}
+
+/**
+ * 取出下一块物理连续的内存, 最多 max 字节, 返回其大小, 遍历完时返回 0
+ */
+uint32_t bio_iter_next(bio_iter_t *iter, uint32_t *paddr, uint32_t max) {
+	if ((iter->left == 0) || (iter->idx >= iter->bio->vcnt)) {
+		return 0;
+	}
+
+	bio_vec_t *vec = iter->bio->vec + iter->idx;
+	uint32_t len = vec->len - iter->offset;
+	if (len > iter->left) {
+		len = iter->left;
+	}
+	if (len > max) {
+		len = max;
+	}
+
+	*paddr = vec->page + vec->offset + iter->offset;
+	iter->offset += len;
+	iter->left -= len;
+	if (iter->offset >= vec->len) {
+		iter->idx++;
+		iter->offset = 0;
+	}
+	return len;
+}
+
+/**
+ * 在 bio 的内存段和连续缓冲区之间复制 size 个字节, to_bio 为 1 时复制到 bio 中
+ */
+void bio_iter_copy(bio_iter_t *iter, void *buf, uint32_t size, int to_bio) {
+	uint8_t *p = (uint8_t *) buf;
+	uint32_t paddr, len;
+	while ((size > 0) && ((len = bio_iter_next(iter, &paddr, size)) > 0)) {
+		if (to_bio) {
+			kernel_memcpy((void *) paddr, p, len);
+		} else {
+			kernel_memcpy(p, (void *) paddr, len);
+		}
+		p += len;
+		size -= len;
+	}
+}
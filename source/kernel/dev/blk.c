@@ -0,0 +1,489 @@
+/**
+ * 块设备请求队列
+ *
+ * 每个队列有一个线程, 按 C-LOOK 电梯顺序取出请求组交给驱动: 从上一组结束的扇区向上找,
+ * 到头后回到最小的扇区. 等待超过期限的请求优先处理, 以免远处的请求一直得不到服务.
+ * 新请求与队列中未开始执行的组首尾相接时合并进该组, 驱动用一条命令完成整组
+ *
+ * 统计按请求计算, 合并成组的请求分别计入. 时间取自 time_ns, 有 TSC 时按周期计数换算
+ */
+#include "dev/blk.h"
+#include "dev/time.h"
+#include "core/kthread.h"
+#include "ipc/sem.h"
+#include "tools/log.h"
+#include "tools/klib.h"
+#include "os_cfg.h"
+
+static blk_queue_t *queue_table[BLK_QUEUE_NR];
+static int queue_count;
+static int blk_started;             // 队列线程已创建
+
+/**
+ * 初始化请求, 传输 bio 中从 bio_offset 开始的 count 个扇区
+ */
+void blk_request_init(blk_request_t *req, bio_t *bio, uint32_t bio_offset, uint32_t sector, int count,
+                      void (*complete)(blk_request_t *req), void *data) {
+	list_node_init(&req->node);
+	list_node_init(&req->fifo_node);
+	list_init(&req->merged);
+	req->sectors = count;
+	req->is_write = bio->is_write;
+	req->sector = sector;
+	req->count = count;
+	req->bio = bio;
+	req->bio_offset = bio_offset;
+	req->expire = 0;
+	req->done = 0;
+	req->start = 0;
+	req->part = (blk_part_t *) 0;
+	req->complete = complete;
+	req->data = data;
+}
+
+/**
+ * 遍历一组中的请求, part 为空时返回组首
+ */
+blk_request_t *blk_request_next(blk_request_t *req, blk_request_t *part) {
+	list_node_t *node;
+	if (part == (blk_request_t *) 0) {
+		return req;
+	} else if (part == req) {
+		node = list_first(&req->merged);
+	} else {
+		node = list_node_next(&part->node);
+	}
+	return node ? list_node_parent(node, blk_request_t, node) : (blk_request_t *) 0;
+}
+
+/**
+ * 整组成功传输的扇区数按扇区顺序分给组内各请求
+ */
+static void blk_request_set_done(blk_request_t *req, int done) {
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		part->done = done > part->count ? part->count : done;
+		done -= part->done;
+	}
+}
+
+/**
+ * 通知组内各请求的提交者, 回调返回后请求可能已被释放, 先取下合并链
+ */
+static void blk_request_end(blk_request_t *req) {
+	list_t merged = req->merged;
+	list_init(&req->merged);
+	req->complete(req);
+
+	list_node_t *node;
+	while ((node = list_pop_front(&merged)) != (list_node_t *) 0) {
+		blk_request_t *part = list_node_parent(node, blk_request_t, node);
+		part->complete(part);
+	}
+}
+
+/**
+ * 累计到 now 为止有请求未完成的时间
+ */
+static void blk_stats_update_time(blk_stats_t *stats, uint64_t now) {
+	if (stats->in_flight && (now > stats->stamp)) {
+		stats->io_ticks += now - stats->stamp;
+		stats->time_in_queue += (now - stats->stamp) * stats->in_flight;
+	}
+	stats->stamp = now;
+}
+
+static void blk_stats_start(blk_stats_t *stats, uint64_t now) {
+	blk_stats_update_time(stats, now);
+	stats->in_flight++;
+}
+
+static void blk_stats_done(blk_stats_t *stats, blk_request_t *req, uint64_t now, int bucket) {
+	int rw = req->is_write ? 1 : 0;
+	blk_stats_update_time(stats, now);
+	stats->in_flight--;
+	stats->ios[rw]++;
+	stats->sectors[rw] += req->done;
+	stats->ticks[rw] += now - req->start;
+	stats->lat_hist[rw][bucket]++;
+}
+
+/**
+ * 请求进入队列, 记下提交时间和所在分区, 调用者持有队列锁
+ */
+static void blk_account_start(blk_queue_t *queue, blk_request_t *req) {
+	req->start = time_ns();
+	req->part = (blk_part_t *) 0;
+	for (int i = 0; i < BLK_PART_NR; i++) {
+		blk_part_t *part = queue->part + i;
+		if (part->total_sectors && (req->sector >= part->start_sector)
+		    && (req->sector - part->start_sector < part->total_sectors)) {
+			req->part = part;
+			break;
+		}
+	}
+
+	blk_stats_start(&queue->stats, req->start);
+	if (req->part) {
+		blk_stats_start(&req->part->stats, req->start);
+	}
+}
+
+static void blk_account_merge(blk_queue_t *queue, blk_request_t *req) {
+	int rw = req->is_write ? 1 : 0;
+	queue->stats.merges[rw]++;
+	if (req->part) {
+		req->part->stats.merges[rw]++;
+	}
+}
+
+/**
+ * 请求完成, 延迟按微秒取对数放入直方图, 调用者持有队列锁
+ */
+static void blk_account_done(blk_queue_t *queue, blk_request_t *req, uint64_t now) {
+	uint32_t rem;
+	uint64_t us = now > req->start ? div64_32(now - req->start, NSEC_PER_USEC, &rem) : 0;
+	int bucket = 0;
+	while ((us > 1) && (bucket < BLK_LAT_HIST_NR - 1)) {
+		us >>= 1;
+		bucket++;
+	}
+
+	blk_stats_done(&queue->stats, req, now, bucket);
+	if (req->part) {
+		blk_stats_done(&req->part->stats, req, now, bucket);
+	}
+}
+
+/**
+ * 驱动完成一组请求, done 为整组成功传输的扇区数
+ */
+void blk_end_request(blk_queue_t *queue, blk_request_t *req, int done) {
+	blk_request_set_done(req, done);
+	uint64_t now = time_ns();
+
+	irq_state_t state = spin_lock_irqsave(&queue->lock);
+	queue->inflight--;
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		blk_account_done(queue, part, now);
+	}
+	spin_unlock_irqrestore(&queue->lock, state);
+
+	blk_request_end(req);
+	if (queue->thread) {
+		kthread_wakeup(queue->thread);
+	}
+}
+
+/**
+ * 用 to 替换 from 在排序及超时队列中的位置
+ */
+static void blk_replace(blk_queue_t *queue, blk_request_t *from, blk_request_t *to) {
+	list_node_t *pre = list_node_pre(&from->node);
+	list_ease(&queue->sort_list, &from->node);
+	list_insert_after(&queue->sort_list, pre, &to->node);
+
+	pre = list_node_pre(&from->fifo_node);
+	list_ease(&queue->fifo_list, &from->fifo_node);
+	list_insert_after(&queue->fifo_list, pre, &to->fifo_node);
+}
+
+/**
+ * 尝试合并到已有的组中, 成功时返回 1
+ */
+static int blk_try_merge(blk_queue_t *queue, blk_request_t *req) {
+	for (list_node_t *node = list_first(&queue->sort_list); node; node = list_node_next(node)) {
+		blk_request_t *group = list_node_parent(node, blk_request_t, node);
+		if ((group->is_write != req->is_write) || (group->sectors + req->count > queue->max_sectors)) {
+			continue;
+		}
+
+		if (group->sector + group->sectors == req->sector) {
+			// 接在组尾
+			list_push_back(&group->merged, &req->node);
+			group->sectors += req->count;
+			return 1;
+		} else if (req->sector + req->count == group->sector) {
+			// 接在组首之前, 新请求成为组首, 沿用原组的超时时间
+			blk_replace(queue, group, req);
+			req->merged = group->merged;
+			list_init(&group->merged);
+			list_push_front(&req->merged, &group->node);
+			req->sectors = group->sectors + req->count;
+			req->expire = group->expire;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * 按起始扇区插入排序队列, 按超时时间插入超时队列
+ */
+static void blk_insert(blk_queue_t *queue, blk_request_t *req) {
+	list_node_t *pre = (list_node_t *) 0;
+	for (list_node_t *node = list_first(&queue->sort_list); node; node = list_node_next(node)) {
+		if (list_node_parent(node, blk_request_t, node)->sector > req->sector) {
+			break;
+		}
+		pre = node;
+	}
+	list_insert_after(&queue->sort_list, pre, &req->node);
+
+	pre = list_last(&queue->fifo_list);
+	while (pre && (list_node_parent(pre, blk_request_t, fifo_node)->expire > req->expire)) {
+		pre = list_node_pre(pre);
+	}
+	list_insert_after(&queue->fifo_list, pre, &req->fifo_node);
+}
+
+/**
+ * 取出下一组请求, 队列为空时返回空
+ */
+static blk_request_t *blk_dispatch(blk_queue_t *queue) {
+	if (list_is_empty(&queue->sort_list)) {
+		return (blk_request_t *) 0;
+	}
+
+	blk_request_t *req = list_node_parent(list_first(&queue->fifo_list), blk_request_t, fifo_node);
+	if (time_ns() < req->expire) {
+		req = list_node_parent(list_first(&queue->sort_list), blk_request_t, node);
+		for (list_node_t *node = list_first(&queue->sort_list); node; node = list_node_next(node)) {
+			blk_request_t *curr = list_node_parent(node, blk_request_t, node);
+			if (curr->sector >= queue->head_pos) {
+				req = curr;
+				break;
+			}
+		}
+	}
+
+	list_ease(&queue->sort_list, &req->node);
+	list_ease(&queue->fifo_list, &req->fifo_node);
+	queue->head_pos = req->sector + req->sectors;
+	return req;
+}
+
+/**
+ * 提交请求, 完成后调用 req->complete, 可能在队列线程或中断下半部中
+ * 队列线程还未创建时直接在调用者中执行
+ */
+void blk_submit(blk_queue_t *queue, blk_request_t *req) {
+	list_init(&req->merged);
+	req->sectors = req->count;
+
+	if (queue->thread == (task_t *) 0) {
+		irq_state_t state = spin_lock_irqsave(&queue->lock);
+		blk_account_start(queue, req);
+		queue->inflight++;
+		spin_unlock_irqrestore(&queue->lock, state);
+
+		queue->transfer(queue, req);
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&queue->lock);
+	blk_account_start(queue, req);
+	uint32_t expire_ms = req->is_write ? BLK_WRITE_EXPIRE_MS : BLK_READ_EXPIRE_MS;
+	req->expire = req->start + (uint64_t) expire_ms * NSEC_PER_MSEC;
+	if (blk_try_merge(queue, req)) {
+		blk_account_merge(queue, req);
+	} else {
+		blk_insert(queue, req);
+	}
+	spin_unlock_irqrestore(&queue->lock, state);
+
+	kthread_wakeup(queue->thread);
+}
+
+static void blk_rw_complete(blk_request_t *req) {
+	sem_v((sem_t *) req->data);
+}
+
+/**
+ * 同步执行 bio, 设备上的起始扇区为 base_sector + bio->sector
+ * 超过一组的上限时拆成多个请求, 每次同时提交几个, 让驱动可以并行执行. 返回从头起连续成功的扇区数
+ */
+int blk_submit_bio(blk_queue_t *queue, bio_t *bio, uint32_t base_sector) {
+	int count = bio->size / queue->sector_size;
+	int done = 0;
+	while (done < count) {
+		blk_request_t req_list[BLK_BIO_REQ_NR];
+		sem_t sem;
+		sem_init(&sem, 0);
+		int async = queue->thread != (task_t *) 0;
+
+		int req_count = 0;
+		for (int pos = done; (req_count < BLK_BIO_REQ_NR) && (pos < count); req_count++) {
+			int curr_count = count - pos;
+			if (curr_count > queue->max_sectors) {
+				curr_count = queue->max_sectors;
+			}
+
+			blk_request_t *req = req_list + req_count;
+			blk_request_init(req, bio, pos * queue->sector_size, base_sector + bio->sector + pos, curr_count,
+			                 blk_rw_complete, &sem);
+			blk_submit(queue, req);
+			pos += curr_count;
+		}
+
+		if (async) {
+			for (int i = 0; i < req_count; i++) {
+				sem_p(&sem);
+			}
+		}
+
+		for (int i = 0; i < req_count; i++) {
+			done += req_list[i].done;
+			if (req_list[i].done < req_list[i].count) {
+				return done;
+			}
+		}
+	}
+	return done;
+}
+
+/**
+ * 同步读写连续的缓冲区, 返回成功传输的扇区数
+ * 在调用者的地址空间中把缓冲区拆成物理段, 队列线程和中断中不需要访问调用者的页表
+ */
+int blk_rw(blk_queue_t *queue, int is_write, uint32_t sector, char *buf, int count) {
+	int done = 0;
+	while (done < count) {
+		bio_vec_t vec[BIO_VEC_NR];
+		bio_t bio;
+		bio_init(&bio, is_write, sector + done, vec, BIO_VEC_NR);
+		int size = bio_add_buf(&bio, buf + done * queue->sector_size, (count - done) * queue->sector_size);
+		if (size < (int) queue->sector_size) {
+			break;
+		}
+		bio.size = size - size % queue->sector_size;
+
+		int curr_count = bio.size / queue->sector_size;
+		int curr_done = blk_submit_bio(queue, &bio, 0);
+		done += curr_done;
+		if (curr_done < curr_count) {
+			break;
+		}
+	}
+	return done;
+}
+
+static int blk_thread(void *arg) {
+	blk_queue_t *queue = (blk_queue_t *) arg;
+
+	while (1) {
+		irq_state_t state = spin_lock_irqsave(&queue->lock);
+		blk_request_t *req = (blk_request_t *) 0;
+		if (queue->inflight < queue->depth) {
+			req = blk_dispatch(queue);
+			if (req) {
+				queue->inflight++;
+			}
+		}
+		spin_unlock_irqrestore(&queue->lock, state);
+
+		// 队列为空或驱动已满, 等待新请求或有请求完成
+		if (req == (blk_request_t *) 0) {
+			kthread_park();
+			continue;
+		}
+
+		queue->transfer(queue, req);
+	}
+	return 0;
+}
+
+static void blk_queue_start(blk_queue_t *queue) {
+	queue->thread = kthread_create(blk_thread, queue, queue->name);
+	if (queue->thread == (task_t *) 0) {
+		log_printf("blk: create thread for %s failed", queue->name);
+	}
+}
+
+void blk_queue_init(blk_queue_t *queue, const char *name, uint32_t sector_size, int max_sectors,
+                    blk_transfer_t transfer, void *data) {
+	queue->name = name;
+	spinlock_init(&queue->lock, "blk");
+	list_init(&queue->sort_list);
+	list_init(&queue->fifo_list);
+	queue->head_pos = 0;
+	queue->sector_size = sector_size;
+	queue->max_sectors = max_sectors;
+	queue->depth = 1;
+	queue->inflight = 0;
+	queue->transfer = transfer;
+	queue->data = data;
+	queue->thread = (task_t *) 0;
+	kernel_memset(&queue->stats, 0, sizeof(queue->stats));
+	kernel_memset(queue->part, 0, sizeof(queue->part));
+
+	if (queue_count >= BLK_QUEUE_NR) {
+		log_printf("blk: too many queues, %s runs synchronously", name);
+		return;
+	}
+	queue_table[queue_count++] = queue;
+
+	if (blk_started) {
+		blk_queue_start(queue);
+	}
+}
+
+/**
+ * 设置驱动能同时执行的组数, 默认为 1
+ */
+void blk_queue_set_depth(blk_queue_t *queue, int depth) {
+	queue->depth = depth > 0 ? depth : 1;
+}
+
+/**
+ * 登记第 index 个主分区, 从 1 开始, 之后落在分区内的请求同时计入分区的统计
+ */
+void blk_queue_add_part(blk_queue_t *queue, int index, uint32_t start_sector, uint32_t total_sectors) {
+	if ((index < 1) || (index > BLK_PART_NR)) {
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&queue->lock);
+	blk_part_t *part = queue->part + index - 1;
+	kernel_memset(part, 0, sizeof(blk_part_t));
+	kernel_sprintf(part->name, "%s%d", queue->name, index);
+	part->start_sector = start_sector;
+	part->total_sectors = total_sectors;
+	spin_unlock_irqrestore(&queue->lock, state);
+}
+
+/**
+ * 按注册顺序取得第 index 个队列, 超出时返回空
+ */
+blk_queue_t *blk_queue_get(int index) {
+	if ((index < 0) || (index >= queue_count)) {
+		return (blk_queue_t *) 0;
+	}
+	return queue_table[index];
+}
+
+/**
+ * 复制一份统计, part 为 0 时取整个磁盘, 否则取第 part 个分区. 分区不存在时返回 -1
+ */
+int blk_queue_stats(blk_queue_t *queue, int part, blk_stats_t *stats) {
+	if ((part < 0) || (part > BLK_PART_NR) || (part && (queue->part[part - 1].total_sectors == 0))) {
+		return -1;
+	}
+
+	uint64_t now = time_ns();
+	irq_state_t state = spin_lock_irqsave(&queue->lock);
+	blk_stats_t *src = part ? &queue->part[part - 1].stats : &queue->stats;
+	blk_stats_update_time(src, now);
+	kernel_memcpy(stats, src, sizeof(blk_stats_t));
+	spin_unlock_irqrestore(&queue->lock, state);
+	return 0;
+}
+
+/**
+ * 在任务管理器初始化之后调用, 为之前注册的队列创建线程
+ */
+void blk_init(void) {
+	blk_started = 1;
+	for (int i = 0; i < queue_count; i++) {
+		blk_queue_start(queue_table[i]);
+	}
+}
@@ -2,20 +2,22 @@
 #include "tools/klib.h"
 #include "comm/cpu_instr.h"
 #include "dev/keyboard.h"
+#include "ipc/spinlock.h"
 
 #define CONSOLE_NR TTY_NR
 static console_t console_buf[CONSOLE_NR];
 static int current_console = 0;
+static spinlock_t cursor_lock = SPINLOCK_INIT("cursor");     // 光标寄存器须成对访问
 
 static uint16_t read_cursor_pos() {
 	uint16_t pos;
 
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&cursor_lock);
 	outb(0x3D4, 0x0F);
 	pos = inb(0x3D5);
 	outb(0x3D4, 0x0E);
 	pos |= inb(0x3D5) << 8;
-	irq_leave_protection(state);
+	spin_unlock_irqrestore(&cursor_lock, state);
 	return pos;
 }
 
@@ -23,12 +25,12 @@ static void update_cursor_pos(console_t *console) {
 	uint16_t pos = (console - console_buf) * (console->display_cols * console->display_rows);
 	pos += console->cursor_row * console->display_cols + console->cursor_col;
 
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&cursor_lock);
 	outb(0x3D4, 0x0F);        // 写低地址
 	outb(0x3D5, (uint8_t) (pos & 0xFF));
 	outb(0x3D4, 0x0E);        // 写高地址
 	outb(0x3D5, (uint8_t) ((pos >> 8) & 0xFF));
-	irq_leave_protection(state);
+	spin_unlock_irqrestore(&cursor_lock, state);
 }
 
 static void erase_rows(console_t *con, int start, int end) {
@@ -1,65 +1,98 @@
 #include "dev/dev.h"
-#include "cpu/irq.h"
+#include "ipc/spinlock.h"
+#include "ipc/mutex.h"
 #include "tools/klib.h"
 
 #define DEV_MAX_COUNT 128
 
 extern dev_desc_t dev_tty_desc;
 extern dev_desc_t dev_disk_desc;
+extern dev_desc_t dev_ahci_desc;
+extern dev_desc_t dev_virtio_blk_desc;
+extern dev_desc_t dev_ramdisk_desc;
+extern dev_desc_t dev_diskstats_desc;
 
 static dev_desc_t *dev_desc_table[] = {
 		&dev_tty_desc,
 		&dev_disk_desc,
+		&dev_ahci_desc,
+		&dev_virtio_blk_desc,
+		&dev_ramdisk_desc,
+		&dev_diskstats_desc,
 };
 
 static device_t dev_table[DEV_MAX_COUNT];
+static spinlock_t dev_lock = SPINLOCK_INIT("dev");
+static mutex_t dev_open_mutex;          // 串行化打开过程, 设备的 open 可能阻塞
 
 static int is_devid_bad(int dev_id) {
 	return dev_id < 0 || dev_id >= DEV_MAX_COUNT
 	       || dev_table[dev_id].desc == (dev_desc_t *) 0;
 }
 
+/**
+ * 在第一次打开设备之前调用
+ */
+void dev_init(void) {
+	mutex_init(&dev_open_mutex);
+}
+
+/**
+ * 打开设备, 已打开的直接增加引用计数
+ * 表项在设备的 open 成功之后才登记, 同时打开同一设备的其它任务在互斥锁上等待, 不会拿到未打开好的表项
+ */
 int dev_open(int major, int minor, void *data) {
-	irq_state_t state = irq_enter_protection();
+	// 查找描述符不涉及共享数据, 放在锁外
+	dev_desc_t *desc = (dev_desc_t *) 0;
+	for (int i = 0; i < sizeof(dev_desc_table) / sizeof(dev_desc_table[0]); i++) {
+		dev_desc_t *d = dev_desc_table[i];
+		if (d->major == major) {
+			desc = d;
+			break;
+		}
+	}
+
+	mutex_lock(&dev_open_mutex);
+	spin_lock(&dev_lock);
 
 	device_t *free_dev = (device_t *) 0;
 	for (int i = 0; i < DEV_MAX_COUNT; ++i) {
 		device_t *dev = &dev_table[i];
 		if (dev->open_count == 0) {
-			free_dev = dev;
+			if (!free_dev) {
+				free_dev = dev;
+			}
 		} else if (dev->desc->major == major && dev->minor == minor) {
 			dev->open_count++;
-			irq_leave_protection(state);
+			spin_unlock(&dev_lock);
+			mutex_unlock(&dev_open_mutex);
 			return i;
 		}
 	}
 
-	// 新打开设备？查找设备类型描述符, 看看是不是支持的类型
-	dev_desc_t *desc = (dev_desc_t *) 0;
-	for (int i = 0; i < sizeof(dev_desc_table) / sizeof(dev_desc_table[0]); i++) {
-		dev_desc_t *d = dev_desc_table[i];
-		if (d->major == major) {
-			desc = d;
-			break;
-		}
+	// 没有空闲项或不支持的类型
+	if (!desc || !free_dev) {
+		spin_unlock(&dev_lock);
+		mutex_unlock(&dev_open_mutex);
+		return -1;
 	}
-
-	// 有空闲且有对应的描述项
-	if (desc && free_dev) {
-		free_dev->minor = minor;
-		free_dev->data = data;
-		free_dev->desc = desc;
-
-		int err = desc->open(free_dev);
-		if (err == 0) {
-			free_dev->open_count = 1;
-			irq_leave_protection(state);
-			return free_dev - dev_table;
-		}
+	spin_unlock(&dev_lock);
+
+	// 持有互斥锁期间只有关闭会释放表项, 空闲项不会被别人占用; open 可能阻塞, 不能持有自旋锁
+	free_dev->minor = minor;
+	free_dev->data = data;
+	free_dev->desc = desc;
+	int err = desc->open(free_dev);
+
+	spin_lock(&dev_lock);
+	if (err < 0) {
+		kernel_memset(free_dev, 0, sizeof(device_t));
+	} else {
+		free_dev->open_count = 1;
 	}
-
-	irq_leave_protection(state);
-	return -1;
+	spin_unlock(&dev_lock);
+	mutex_unlock(&dev_open_mutex);
+	return err < 0 ? -1 : free_dev - dev_table;
 }
 
 int dev_read(int dev_id, int addr, char *buf, int size) {
@@ -78,6 +111,20 @@ int dev_write(int dev_id, int addr, char *buf, int size) {
 	return dev->desc->write(dev, addr, buf, size);
 }
 
+/**
+ * 按 bio 同步读写块设备, 设备不支持时返回 -1
+ */
+int dev_submit(int dev_id, bio_t *bio) {
+	if (is_devid_bad(dev_id)) {
+		return -1;
+	}
+	device_t *dev = dev_table + dev_id;
+	if (dev->desc->submit == 0) {
+		return -1;
+	}
+	return dev->desc->submit(dev, bio);
+}
+
 int dev_control(int dev_id, int cmd, int arg0, int arg1) {
 	if (is_devid_bad(dev_id)) {
 		return -1;
@@ -92,10 +139,11 @@ void dev_close(int dev_id) {
 	}
 	device_t *dev = dev_table + dev_id;
 
-	irq_state_t state = irq_enter_protection();
+	// 各设备的 close 都不会阻塞, 在锁内完成, 避免表项被提前复用
+	spin_lock(&dev_lock);
 	if (--dev->open_count == 0) {
 		dev->desc->close(dev);
 		kernel_memset(dev, 0, sizeof(device_t));
 	}
-	irq_leave_protection(state);
+	spin_unlock(&dev_lock);
 }
\ No newline at end of file
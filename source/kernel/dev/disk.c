@@ -5,15 +5,18 @@
 #include "comm/boot_info.h"
 #include "dev/dev.h"
 #include "cpu/irq.h"
+#include "dev/pci.h"
+#include "dev/blk.h"
+#include "os_cfg.h"
+#include "core/memory.h"
 
-static mutex_t mutex;
-static sem_t op_sem;
+static disk_channel_t channel_buf[DISK_CHANNEL_CNT];
 static disk_t disk_buf[DISK_CNT];
-static int task_on_disk_flag = 0;
+static int pio32;                   // IDE 控制器的数据端口支持 32 位访问
 
 static void disk_send_cmd(disk_t *disk, uint32_t start_sector, uint32_t sector_count, uint8_t cmd) {
 	outb(DISK_DRIVE(disk), DISK_DRIVE_BASE | disk->drive);
-	outb(DISK_SECTOR_COUNT(disk), (uint8_t) sector_count >> 8);
+	outb(DISK_SECTOR_COUNT(disk), (uint8_t) (sector_count >> 8));
 	outb(DISK_LBA_LO(disk), (uint8_t) (start_sector >> 24));
 	outb(DISK_LBA_MID(disk), 0);
 	outb(DISK_LBA_HI(disk), 0);
@@ -25,16 +28,18 @@ static void disk_send_cmd(disk_t *disk, uint32_t start_sector, uint32_t sector_c
 }
 
 static inline void disk_read_data(disk_t *disk, void *buf, int size) {
-	uint16_t *data_buf = (uint16_t *) buf;
-	for (int i = 0; i < size / 2; ++i) {
-		*data_buf++ = inw(DISK_DATA(disk));
+	if (disk->pio32) {
+		insl(DISK_DATA(disk), buf, size / 4);
+	} else {
+		insw(DISK_DATA(disk), buf, size / 2);
 	}
 }
 
 static inline void disk_write_data(disk_t *disk, void *buf, int size) {
-	uint16_t *data_buf = (uint16_t *) buf;
-	for (int i = 0; i < size / 2; ++i) {
-		outw(DISK_DATA(disk), *data_buf++);
+	if (disk->pio32) {
+		outsl(DISK_DATA(disk), buf, size / 4);
+	} else {
+		outsw(DISK_DATA(disk), buf, size / 2);
 	}
 }
 
@@ -48,9 +53,348 @@ static inline int disk_wait(disk_t *disk) {
 	return status & DISK_STATUS_ERR ? -1 : 0;
 }
 
+/**
+ * 发送命令前清除之前残留的中断标志
+ */
+static void disk_irq_reset(disk_t *disk) {
+	disk_channel_t *channel = disk->channel;
+	irq_state_t state = spin_lock_irqsave(&channel->op_wait.lock);
+	channel->op_done = 0;
+	spin_unlock_irqrestore(&channel->op_wait.lock, state);
+}
+
+/**
+ * 等待磁盘中断, 中断可能在开始等待前就已到达
+ * 超时后不再等待, 由随后的状态查询判断操作是否完成
+ */
+static void disk_wait_irq(disk_t *disk) {
+	disk_channel_t *channel = disk->channel;
+	irq_state_t state = spin_lock_irqsave(&channel->op_wait.lock);
+	while (!channel->op_done) {
+		int err = wait_queue_sleep_locked(&channel->op_wait, WAIT_EXCLUSIVE, DISK_IRQ_TIMEOUT_MS, state);
+		if (err == WAIT_TIMEOUT) {
+			log_printf("disk %s: wait irq timeout\n", disk->name);
+			return;
+		}
+		state = spin_lock_irqsave(&channel->op_wait.lock);
+	}
+	channel->op_done = 0;
+	spin_unlock_irqrestore(&channel->op_wait.lock, state);
+}
+
+/**
+ * 等待磁盘完成当前阶段, 随后由 disk_wait 查询结果
+ * 短传输休眠和切换任务的开销比传输本身还大, 直接查询状态; 这时先等待 400ns, 让磁盘来得及置上忙标志
+ */
+static void disk_wait_event(disk_t *disk, int poll) {
+	if (!poll && (task_current() != (task_t *) 0)) {
+		disk_wait_irq(disk);
+		return;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		inb(DISK_ALT_STATUS(disk));
+	}
+}
+
+/**
+ * 为一段物理连续的内存追加描述符, 与上一项相接且在同一 64KB 内时合并
+ * prd 为上一次追加的最后一项, 返回本次的最后一项; 内存不满足 DMA 要求时返回空
+ */
+static prd_t *disk_dma_add(disk_t *disk, prd_t *prd, uint32_t paddr, uint32_t size) {
+	if ((paddr | size) & 0x1) {
+		return (prd_t *) 0;
+	}
+
+	while (size > 0) {
+		// 每项不跨越 64KB 边界
+		uint32_t curr_size = DISK_PRD_BOUNDARY - (paddr & (DISK_PRD_BOUNDARY - 1));
+		if (curr_size > size) {
+			curr_size = size;
+		}
+
+		uint32_t prd_size = prd ? (prd->size ? prd->size : DISK_PRD_BOUNDARY) : 0;
+		if (prd && (prd->paddr + prd_size == paddr)
+		    && (((prd->paddr ^ (paddr + curr_size - 1)) & ~(DISK_PRD_BOUNDARY - 1)) == 0)) {
+			prd->size = (uint16_t) (prd_size + curr_size);
+		} else {
+			prd = prd ? prd + 1 : disk->prd_table;
+			if (prd >= disk->prd_table + DISK_PRD_NR) {
+				return (prd_t *) 0;
+			}
+			prd->paddr = paddr;
+			prd->size = (uint16_t) curr_size;
+			prd->flags = 0;
+		}
+
+		paddr += curr_size;
+		size -= curr_size;
+	}
+	return prd;
+}
+
+/**
+ * 为一组请求的所有缓冲区填写描述符表, 不满足 DMA 要求时返回 -1, 由调用者改用 PIO
+ */
+static int disk_dma_setup(disk_t *disk, blk_request_t *req) {
+	prd_t *prd = (prd_t *) 0;
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		bio_iter_t iter;
+		uint32_t paddr, len;
+		bio_iter_init(&iter, part->bio, part->bio_offset, part->count * disk->sector_size);
+		while ((len = bio_iter_next(&iter, &paddr, DISK_PRD_BOUNDARY)) > 0) {
+			prd = disk_dma_add(disk, prd, paddr, len);
+			if (prd == (prd_t *) 0) {
+				return -1;
+			}
+		}
+	}
+
+	prd->flags = DISK_PRD_EOT;
+	return 0;
+}
+
+/**
+ * 按已填好的描述符表传输, 传输期间 CPU 可以运行其它任务
+ */
+static int disk_dma_transfer(disk_t *disk, uint32_t start_sector, int sector_count, int is_write, int poll) {
+	uint8_t dir = is_write ? 0 : DISK_BM_CMD_READ;
+
+	outb(DISK_BM_CMD(disk), 0);
+	outl(DISK_BM_PRDT(disk), (uint32_t) disk->prd_table);
+	outb(DISK_BM_STATUS(disk), inb(DISK_BM_STATUS(disk)) | DISK_BM_STATUS_ERR | DISK_BM_STATUS_IRQ);
+	outb(DISK_BM_CMD(disk), dir);
+
+	disk_irq_reset(disk);
+	disk_send_cmd(disk, start_sector, sector_count, is_write ? DISK_CMD_WRITE_DMA : DISK_CMD_READ_DMA);
+	outb(DISK_BM_CMD(disk), dir | DISK_BM_CMD_START);
+	disk_wait_event(disk, poll);
+
+	// 查询模式、中断超时或尚未开中断时在这里等待完成
+	uint8_t bm_status = 0;
+	int done = 0;
+	for (int i = 0; (i < DISK_SPIN_MAX) && !done; i++) {
+		bm_status = inb(DISK_BM_STATUS(disk));
+		done = bm_status & (DISK_BM_STATUS_IRQ | DISK_BM_STATUS_ERR);
+	}
+
+	outb(DISK_BM_CMD(disk), dir);
+	if (!done) {
+		// 磁盘没有响应, 停止总线主控后放弃; 磁盘可能仍然忙, 不再查询它的状态
+		log_printf("disk %s: dma timeout\n", disk->name);
+		outb(DISK_BM_STATUS(disk), bm_status | DISK_BM_STATUS_ERR | DISK_BM_STATUS_IRQ);
+		return -1;
+	}
+
+	int err = disk_wait(disk);
+	outb(DISK_BM_STATUS(disk), bm_status | DISK_BM_STATUS_ERR | DISK_BM_STATUS_IRQ);
+	return ((bm_status & DISK_BM_STATUS_ERR) || (err < 0)) ? -1 : 0;
+}
+
+/**
+ * 用 PIO 传输一个扇区, 扇区跨越两个内存段时经过栈上的缓冲区
+ */
+static void disk_pio_sector(disk_t *disk, bio_iter_t *iter, int is_write) {
+	bio_iter_t start = *iter;
+	uint32_t paddr;
+	if (bio_iter_next(iter, &paddr, disk->sector_size) == disk->sector_size) {
+		if (is_write) {
+			disk_write_data(disk, (void *) paddr, disk->sector_size);
+		} else {
+			disk_read_data(disk, (void *) paddr, disk->sector_size);
+		}
+		return;
+	}
+
+	uint8_t buf[SECTOR_SIZE];
+	*iter = start;
+	if (is_write) {
+		bio_iter_copy(iter, buf, disk->sector_size, 0);
+		disk_write_data(disk, buf, disk->sector_size);
+	} else {
+		disk_read_data(disk, buf, disk->sector_size);
+		bio_iter_copy(iter, buf, disk->sector_size, 1);
+	}
+}
+
+/**
+ * 用一条 PIO 命令传输一组请求, 返回成功传输的扇区数
+ * 支持 READ/WRITE MULTIPLE 时每个数据块只产生一次中断, 否则每个扇区一次
+ * 读: 每块数据准备好后产生中断; 写: 第一块直接等待 DRQ, 每写完一块产生一次中断
+ */
+static int disk_pio_transfer(disk_t *disk, blk_request_t *req, int poll) {
+	int block = disk->multiple;
+	uint8_t cmd;
+	if (block > 1) {
+		cmd = req->is_write ? DISK_CMD_WRITE_MULTIPLE : DISK_CMD_READ_MULTIPLE;
+	} else {
+		cmd = req->is_write ? DISK_CMD_WRITE : DISK_CMD_READ;
+		block = 1;
+	}
+
+	disk_irq_reset(disk);
+	disk_send_cmd(disk, req->sector, req->sectors, cmd);
+
+	int sector_cnt = 0;
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		bio_iter_t iter;
+		bio_iter_init(&iter, part->bio, part->bio_offset, part->count * disk->sector_size);
+		for (int i = 0; i < part->count; ++i, ++sector_cnt) {
+			if ((sector_cnt % block) == 0) {
+				if (!req->is_write || (sector_cnt > 0)) {
+					disk_wait_event(disk, poll);
+				}
+				if (disk_wait(disk) < 0) {
+					// 写入时出错的是上一块
+					return (req->is_write && sector_cnt) ? sector_cnt - block : sector_cnt;
+				}
+			}
+
+			disk_pio_sector(disk, &iter, req->is_write);
+		}
+	}
+
+	// 等待最后一块写完
+	if (req->is_write) {
+		disk_wait_event(disk, poll);
+		if (disk_wait(disk) < 0) {
+			int last = sector_cnt % block;
+			return sector_cnt - (last ? last : block);
+		}
+	}
+	return sector_cnt;
+}
+
+/**
+ * 请求队列的执行函数, 能用 DMA 时用 DMA
+ * 同一通道上的磁盘共用寄存器, 传输期间持有通道的锁
+ */
+static void disk_request(blk_queue_t *queue, blk_request_t *req) {
+	disk_t *disk = (disk_t *) queue->data;
+
+	int poll = req->sectors <= DISK_POLL_MAX_SECTORS;
+
+	mutex_lock(&disk->channel->mutex);
+	int sector_cnt;
+	if (disk->bm_base && (disk_dma_setup(disk, req) == 0)) {
+		int err = disk_dma_transfer(disk, req->sector, req->sectors, req->is_write, poll);
+		sector_cnt = err < 0 ? 0 : req->sectors;
+	} else {
+		sector_cnt = disk_pio_transfer(disk, req, poll);
+	}
+	mutex_unlock(&disk->channel->mutex);
+
+	blk_end_request(queue, req, sector_cnt);
+}
+
+/**
+ * ATA 数据端口只有 16 位, 32 位访问要由控制器拆分, 只对已知支持的控制器使用
+ */
+static int disk_pio32_supported(pci_dev_t *dev) {
+	if (dev == (pci_dev_t *) 0) {
+		return 0;
+	}
+
+	if ((dev->vendor == PCI_VENDOR_INTEL)
+	    && ((dev->device == PCI_DEVICE_PIIX3_IDE) || (dev->device == PCI_DEVICE_PIIX4_IDE))) {
+		return 1;
+	}
+	return DISK_PIO32;
+}
+
+/**
+ * 查找 PCI IDE 控制器, 找不到或不支持总线主控时只使用 PIO
+ * 两个通道的总线主控寄存器依次排列, 各自使用一张描述符表
+ */
+static void disk_dma_init(void) {
+	pci_dev_t *dev = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, (pci_dev_t *) 0);
+	pio32 = disk_pio32_supported(dev);
+	if ((dev == (pci_dev_t *) 0) || !(dev->prog_if & PCI_IDE_PROG_MASTER)
+	    || !(dev->bar[DISK_BM_BAR] & PCI_BAR_IO)) {
+		log_printf("disk: no bus master ide, use pio\n");
+		return;
+	}
+
+	uint16_t bm_base = pci_bar_addr(dev, DISK_BM_BAR);
+	for (int i = 0; i < DISK_CHANNEL_CNT; i++) {
+		disk_channel_t *channel = channel_buf + i;
+		channel->prd_table = (prd_t *) memory_alloc_page();
+		if (channel->prd_table == (prd_t *) 0) {
+			log_printf("disk: alloc prd table failed\n");
+			continue;
+		}
+		channel->bm_base = bm_base + i * DISK_BM_CHANNEL_SIZE;
+	}
+
+	pci_enable(dev, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+}
+
+static void disk_channel_init(disk_channel_t *channel, uint16_t port_base, int irq, void (*handler)(void),
+                              const char *name) {
+	channel->port_base = port_base;
+	channel->bm_base = 0;
+	channel->prd_table = (prd_t *) 0;
+	channel->irq = irq;
+	channel->handler = handler;
+	mutex_init(&channel->mutex);
+	wait_queue_init(&channel->op_wait, name);
+	channel->op_done = 0;
+}
+
+#if DISK_PIO_BENCH
+/**
+ * 按指定方式读取一个扇区: 0 逐字 inw, 1 rep insw, 2 rep insl
+ */
+static void disk_bench_read(disk_t *disk, int mode, void *buf) {
+	if (mode == 0) {
+		uint16_t *data_buf = (uint16_t *) buf;
+		for (int i = 0; i < disk->sector_size / 2; ++i) {
+			*data_buf++ = inw(DISK_DATA(disk));
+		}
+	} else if (mode == 1) {
+		insw(DISK_DATA(disk), buf, disk->sector_size / 2);
+	} else {
+		insl(DISK_DATA(disk), buf, disk->sector_size / 4);
+	}
+}
+
+/**
+ * 比较各种 PIO 读取方式的速度, 只统计从数据端口取数的时钟周期, 不含等待磁盘的时间
+ * 未启用 32 位 PIO 的控制器也测试 rep insl, 用于判断是否值得打开 DISK_PIO32
+ */
+static void disk_pio_bench(disk_t *disk) {
+	static const char *mode_name[] = {"inw", "rep insw", "rep insl"};
+	static uint8_t buf[SECTOR_SIZE];
+
+	int sectors = disk->sector_count < DISK_PIO_BENCH_SECTORS ? disk->sector_count : DISK_PIO_BENCH_SECTORS;
+	for (int mode = 0; mode < sizeof(mode_name) / sizeof(mode_name[0]); mode++) {
+		uint64_t cycles = 0;
+		disk_send_cmd(disk, 0, sectors, DISK_CMD_READ);
+
+		int i;
+		for (i = 0; i < sectors; i++) {
+			disk_wait_event(disk, 1);
+			if (disk_wait(disk) < 0) {
+				break;
+			}
+
+			uint64_t start = rdtsc();
+			disk_bench_read(disk, mode, buf);
+			cycles += rdtsc() - start;
+		}
+
+		uint32_t rem;
+		uint32_t per_sector = i ? (uint32_t) div64_32(cycles, i, &rem) : 0;
+		log_printf("Disk %s pio bench: %s, %d sectors, %d cycles/sector%s\n", disk->name, mode_name[mode], i, per_sector,
+		           (mode == 2) && !disk->pio32 ? " (not enabled)" : "");
+	}
+}
+#endif
+
 static void print_disk_info(disk_t *disk) {
 	log_printf("Disk %s: %s\n", disk->name, disk->drive == DISK_DISK_MASTER ? "master" : "slave");
-	log_printf("    port base: %x\n", disk->port_base);
+	log_printf("    port base: %x, %s, multiple %d, pio %d bits\n", disk->port_base, disk->bm_base ? "dma" : "pio",
+	           disk->multiple, disk->pio32 ? 32 : 16);
 	log_printf("    total size: %dM\n", disk->sector_size * disk->sector_count / 1024 / 1024);
 
 	log_printf("    Partitions:\n");
@@ -91,6 +435,26 @@ static int detect_part_info(disk_t *disk) {
 	}
 }
 
+/**
+ * 设置 READ/WRITE MULTIPLE 每个数据块的扇区数, 磁盘不支持时仍按扇区传输
+ */
+static void disk_set_multiple(disk_t *disk, int max) {
+	disk->multiple = 1;
+
+	int block = max < DISK_MULTIPLE_MAX ? max : DISK_MULTIPLE_MAX;
+	if (block <= 1) {
+		return;
+	}
+
+	disk_send_cmd(disk, 0, block, DISK_CMD_SET_MULTIPLE);
+	disk_wait_event(disk, 1);
+	if (disk_wait(disk) < 0) {
+		log_printf("Disk %s set multiple %d failed\n", disk->name, block);
+		return;
+	}
+	disk->multiple = block;
+}
+
 static int disk_identify(disk_t *disk) {
 	disk_send_cmd(disk, 0, 0, DISK_CMD_IDENTIFY);
 
@@ -110,6 +474,10 @@ static int disk_identify(disk_t *disk) {
 	disk_read_data(disk, buf, sizeof(buf));
 	disk->sector_count = *(uint32_t *) (buf + 100);
 	disk->sector_size = SECTOR_SIZE;
+	if (!(buf[DISK_IDENT_CAPS] & DISK_IDENT_CAPS_DMA)) {
+		disk->bm_base = 0;
+	}
+	disk_set_multiple(disk, buf[DISK_IDENT_MULTIPLE_MAX] & 0xFF);
 
 	partinfo_t *part = &disk->partinfo[0];
 	part->disk = disk;
@@ -127,21 +495,35 @@ void disk_init() {
 
 	kernel_memset(disk_buf, 0, sizeof(disk_buf));
 
-	mutex_init(&mutex);
-	sem_init(&op_sem, 0);
-	for (int i = 0; i < DISK_PER_CHANNEL; ++i) {
+	disk_channel_init(channel_buf + 0, IOBASE_PRIMARY, IRQ14_HARDDISK_PRIMARY, exception_handler_ide_primary, "ide0");
+	disk_channel_init(channel_buf + 1, IOBASE_SECONDARY, IRQ15_HARDDISK_SECONDARY, exception_handler_ide_secondary, "ide1");
+	disk_dma_init();
+	for (int i = 0; i < DISK_CNT; ++i) {
 		disk_t *disk = &disk_buf[i];
+		disk_channel_t *channel = channel_buf + i / DISK_PER_CHANNEL;
 
-		// sda, sdb, sdc, sdd
+		// sda, sdb 位于主通道, sdc, sdd 位于从通道
 		kernel_sprintf(disk->name, "sd%c", i + 'a');
-		disk->drive = i == 0 ? DISK_DISK_MASTER : DISK_DISK_SLAVE;
-		disk->port_base = IOBASE_PRIMARY;
-		disk->mutex = &mutex;
-		disk->op_sem = &op_sem;
+		disk->drive = (i % DISK_PER_CHANNEL) == 0 ? DISK_DISK_MASTER : DISK_DISK_SLAVE;
+		disk->port_base = channel->port_base;
+		disk->bm_base = channel->bm_base;
+		disk->pio32 = pio32;
+		disk->prd_table = channel->prd_table;
+		disk->channel = channel;
 
 		int err = disk_identify(disk);
 		if (err == 0) {
+			blk_queue_init(&disk->queue, disk->name, disk->sector_size, DISK_XFER_MAX_SECTORS, disk_request, disk);
+			for (int j = 1; j < DISK_PRIMARY_PART_CNT; j++) {
+				partinfo_t *part_info = disk->partinfo + j;
+				if (part_info->disk) {
+					blk_queue_add_part(&disk->queue, j, part_info->start_sector, part_info->total_sectors);
+				}
+			}
 			print_disk_info(disk);
+#if DISK_PIO_BENCH
+			disk_pio_bench(disk);
+#endif
 		}
 	}
 }
@@ -150,7 +532,7 @@ int disk_open(device_t *dev) {
 	int disk_id = (dev->minor >> 4) - 0xa;
 	int part_id = dev->minor & 0xF;
 
-	if (disk_id >= DISK_CNT || part_id >= DISK_PRIMARY_PART_CNT) {
+	if (disk_id < 0 || disk_id >= DISK_CNT || part_id >= DISK_PRIMARY_PART_CNT) {
 		log_printf("disk_open: invalid disk id or partition id\n");
 		return -1;
 	}
@@ -168,8 +550,8 @@ int disk_open(device_t *dev) {
 	}
 
 	dev->data = part_info;
-	irq_install(IRQ14_HARDDISK_PRIMARY, (irq_handler_t) exception_handler_ide_primary);
-	irq_enable(IRQ14_HARDDISK_PRIMARY);
+	irq_install(disk->channel->irq, (irq_handler_t) disk->channel->handler);
+	irq_enable(disk->channel->irq);
 	return 0;
 }
 
@@ -186,25 +568,10 @@ int disk_read(device_t *dev, int addr, char *buf, int size) {
 		return -1;
 	}
 
-	mutex_lock(disk->mutex);
-	task_on_disk_flag = 1;
-
-	int sector_cnt;
-	disk_send_cmd(disk, part_info->start_sector + addr, size, DISK_CMD_READ);
-	for (sector_cnt = 0; sector_cnt < size; ++sector_cnt, buf += disk->sector_size) {
-		if (task_current() != (task_t *) 0) {
-			sem_p(disk->op_sem);
-		}
-		
-		int err = disk_wait(disk);
-		if (err < 0) {
-			log_printf("disk_read: disk(%s) read error: start sect %d, count %d", disk->name, addr, sector_cnt);
-			break;
-		}
-		disk_read_data(disk, buf, disk->sector_size);
+	int sector_cnt = blk_rw(&disk->queue, 0, part_info->start_sector + addr, buf, size);
+	if (sector_cnt < size) {
+		log_printf("disk_read: disk(%s) read error: start sect %d, count %d", disk->name, addr, sector_cnt);
 	}
-
-	mutex_unlock(disk->mutex);
 	return sector_cnt;
 }
 
@@ -221,25 +588,26 @@ int disk_write(device_t *dev, int addr, const char *buf, int size) {
 		return -1;
 	}
 
-	mutex_lock(disk->mutex);
-	task_on_disk_flag = 1;
-
-	int sector_cnt;
-	disk_send_cmd(disk, part_info->start_sector + addr, size, DISK_CMD_WRITE);
-	for (sector_cnt = 0; sector_cnt < size; ++sector_cnt, buf += disk->sector_size) {
-		disk_write_data(disk, (void *) buf, disk->sector_size);
-		if (task_current() != (task_t *) 0) {
-			sem_p(disk->op_sem);
-		}
+	int sector_cnt = blk_rw(&disk->queue, 1, part_info->start_sector + addr, (char *) buf, size);
+	if (sector_cnt < size) {
+		log_printf("disk_write: disk(%s) write error: start sect %d, count %d", disk->name, addr, sector_cnt);
+	}
+	return sector_cnt;
+}
 
-		int err = disk_wait(disk);
-		if (err < 0) {
-			log_printf("disk_write: disk(%s) read error: start sect %d, count %d", disk->name, addr, sector_cnt);
-			break;
-		}
+int disk_submit(device_t *dev, bio_t *bio) {
+	partinfo_t *part_info = (partinfo_t *) dev->data;
+	if ((part_info == (partinfo_t *) 0) || (part_info->disk == (disk_t *) 0)) {
+		log_printf("disk_submit: invalid partition\n");
+		return -1;
 	}
 
-	mutex_unlock(disk->mutex);
+	disk_t *disk = part_info->disk;
+	int sector_cnt = blk_submit_bio(&disk->queue, bio, part_info->start_sector);
+	if (sector_cnt < (int) (bio->size / disk->sector_size)) {
+		log_printf("disk_submit: disk(%s) %s error: start sect %d, count %d", disk->name,
+		           bio->is_write ? "write" : "read", bio->sector, sector_cnt);
+	}
 	return sector_cnt;
 }
 
@@ -251,12 +619,20 @@ void disk_close(device_t *dev) {
 
 }
 
+static void disk_channel_irq(disk_channel_t *channel) {
+	irq_send_eoi(channel->irq);
+	irq_state_t state = spin_lock_irqsave(&channel->op_wait.lock);
+	channel->op_done = 1;
+	wake_up_locked(&channel->op_wait, 1);
+	spin_unlock_irqrestore(&channel->op_wait.lock, state);
+}
+
 void do_handler_ide_primary(exception_frame_t *frame) {
-	// log_printf("do_handler_ide_primary\n");
-	pic_send_eoi(IRQ14_HARDDISK_PRIMARY);
-	if (task_on_disk_flag && task_current() != (task_t *) 0) {
-		sem_v(&op_sem);
-	}
+	disk_channel_irq(channel_buf + 0);
+}
+
+void do_handler_ide_secondary(exception_frame_t *frame) {
+	disk_channel_irq(channel_buf + 1);
 }
 
 dev_desc_t dev_disk_desc = {
@@ -267,4 +643,5 @@ dev_desc_t dev_disk_desc = {
 		.write = disk_write,
 		.control = disk_control,
 		.close = disk_close,
+		.submit = disk_submit,
 };
\ No newline at end of file
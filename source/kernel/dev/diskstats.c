@@ -0,0 +1,112 @@
+/**
+ * 磁盘读写统计
+ *
+ * 不保存生成的文本, 每次读取时按当前统计重新生成, 只复制落在 [addr, addr + size) 内的部分.
+ * 分多次读取时统计可能已经变化, 应使用足够大的缓冲区一次读完
+ */
+#include "dev/diskstats.h"
+#include "dev/dev.h"
+#include "dev/blk.h"
+#include "dev/time.h"
+#include "tools/klib.h"
+
+typedef struct _diskstats_out_t {
+	char *buf;
+	int size;
+	int addr;                       // 读取的起始位置
+	int offset;                     // 已生成的文本长度
+	int copied;
+} diskstats_out_t;
+
+static void diskstats_put(diskstats_out_t *out, const char *text) {
+	int len = kernel_strlen(text);
+	int start = out->addr > out->offset ? out->addr - out->offset : 0;
+	if ((start < len) && (out->copied < out->size)) {
+		int count = len - start;
+		if (count > out->size - out->copied) {
+			count = out->size - out->copied;
+		}
+		kernel_memcpy(out->buf + out->copied, (void *) (text + start), count);
+		out->copied += count;
+	}
+	out->offset += len;
+}
+
+static int ns_to_ms(uint64_t ns) {
+	uint32_t rem;
+	return (int) div64_32(ns, NSEC_PER_MSEC, &rem);
+}
+
+static void diskstats_show(diskstats_out_t *out, const char *name, blk_stats_t *stats) {
+	char line[DISKSTATS_LINE_SIZE];
+	kernel_sprintf(line, "%s %d %d %d %d %d %d %d %d %d %d %d\n", name,
+	               stats->ios[0], stats->merges[0], stats->sectors[0], ns_to_ms(stats->ticks[0]),
+	               stats->ios[1], stats->merges[1], stats->sectors[1], ns_to_ms(stats->ticks[1]),
+	               stats->in_flight, ns_to_ms(stats->io_ticks), ns_to_ms(stats->time_in_queue));
+	diskstats_put(out, line);
+}
+
+static void diskstats_show_hist(diskstats_out_t *out, const char *name, int is_write, blk_stats_t *stats) {
+	int rw = is_write ? 1 : 0;
+	if (stats->ios[rw] == 0) {
+		return;
+	}
+
+	char item[DISKSTATS_LINE_SIZE];
+	kernel_sprintf(item, "%s %s lat(us)", name, is_write ? "write" : "read");
+	diskstats_put(out, item);
+	for (int i = 0; i < BLK_LAT_HIST_NR; i++) {
+		if (stats->lat_hist[rw][i]) {
+			kernel_sprintf(item, " %d:%d", i ? 1 << i : 0, stats->lat_hist[rw][i]);
+			diskstats_put(out, item);
+		}
+	}
+	diskstats_put(out, "\n");
+}
+
+int diskstats_open(device_t *dev) {
+	return dev->minor == 0 ? 0 : -1;
+}
+
+int diskstats_read(device_t *dev, int addr, char *buf, int size) {
+	diskstats_out_t out = {.buf = buf, .size = size, .addr = addr, .offset = 0, .copied = 0};
+	blk_stats_t stats;
+	blk_queue_t *queue;
+
+	for (int i = 0; (queue = blk_queue_get(i)) != (blk_queue_t *) 0; i++) {
+		for (int part = 0; part <= BLK_PART_NR; part++) {
+			if (blk_queue_stats(queue, part, &stats) == 0) {
+				diskstats_show(&out, part ? queue->part[part - 1].name : queue->name, &stats);
+			}
+		}
+	}
+
+	for (int i = 0; (queue = blk_queue_get(i)) != (blk_queue_t *) 0; i++) {
+		blk_queue_stats(queue, 0, &stats);
+		diskstats_show_hist(&out, queue->name, 0, &stats);
+		diskstats_show_hist(&out, queue->name, 1, &stats);
+	}
+	return out.copied;
+}
+
+int diskstats_write(device_t *dev, int addr, const char *buf, int size) {
+	return -1;
+}
+
+int diskstats_control(device_t *dev, int cmd, int arg0, int arg1) {
+	return 0;
+}
+
+void diskstats_close(device_t *dev) {
+
+}
+
+dev_desc_t dev_diskstats_desc = {
+		.name = "diskstats",
+		.major = DEV_TYPE_DISKSTATS,
+		.open = diskstats_open,
+		.read = diskstats_read,
+		.write = diskstats_write,
+		.control = diskstats_control,
+		.close = diskstats_close,
+};
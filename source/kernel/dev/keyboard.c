@@ -4,9 +4,17 @@
 #include "tools/log.h"
 #include "tools/klib.h"
 #include "dev/tty.h"
+#include "core/softirq.h"
 
 static keyboard_state_t keyboard_state;    // 键盘状态
 
+// 中断中只取走扫描码, 解码放到小任务中
+static uint8_t scan_buf[KEYBOARD_SCAN_BUF_SIZE];
+static volatile uint32_t scan_read, scan_write;    // 只增不减, 取模得到下标
+static tasklet_t keyboard_tasklet;
+
+static void keyboard_decode(void *data);
+
 /**
  * 键盘映射表，分3类
  * normal是没有shift键按下，或者没有numlock按下时默认的键值
@@ -82,6 +90,7 @@ void keyboard_init() {
 	}
 	init_flag = 1;
 	kernel_memset(&keyboard_state, 0, sizeof(keyboard_state));
+	tasklet_init(&keyboard_tasklet, keyboard_decode, (void *) 0);
 	irq_install(IRQ1_KEYBOARD, exception_handler_keyboard);
 	irq_enable(IRQ1_KEYBOARD);
 }
@@ -213,40 +222,60 @@ static void do_e0_key(uint8_t raw_code) {
 	}
 }
 
-void do_handler_keyboard(exception_frame_t *frame) {
+/**
+ * 解码中断中收到的扫描码, 在小任务中运行
+ */
+static void keyboard_decode(void *data) {
 	static enum {
 		NORMAL,                // 普通，无e0或e1
 		BEGIN_E0,            // 收到e0字符
 		BEGIN_E1,            // 收到e1字符
 	} recv_state = NORMAL;
 
+	while (scan_read != scan_write) {
+		uint8_t raw_code = scan_buf[scan_read % KEYBOARD_SCAN_BUF_SIZE];
+		barrier();
+		scan_read++;
+
+		if (raw_code == KEY_E0) {
+			// E0字符
+			recv_state = BEGIN_E0;
+		} else if (raw_code == KEY_E1) {
+			// E1字符，不处理
+			recv_state = BEGIN_E1;
+		} else {
+			switch (recv_state) {
+				case NORMAL:
+					do_normal_key(raw_code);
+					break;
+				case BEGIN_E0:
+					do_e0_key(raw_code);
+					recv_state = NORMAL;
+					break;
+				case BEGIN_E1:
+					recv_state = NORMAL;
+					break;
+			}
+		}
+	}
+}
+
+void do_handler_keyboard(exception_frame_t *frame) {
 	// 检查是否有数据，无数据则退出
 	uint8_t status = inb(KEYBOARD_STATUS_PORT);
 	if (!(status & KEYBOARD_STATUS_RECV_READY)) {
-		pic_send_eoi(IRQ1_KEYBOARD);
+		irq_send_eoi(IRQ1_KEYBOARD);
 		return;
 	}
 
 	uint8_t raw_code = inb(KEYBOARD_DATA_PORT);
-	pic_send_eoi(IRQ1_KEYBOARD);
-	if (raw_code == KEY_E0) {
-		// E0字符
-		recv_state = BEGIN_E0;
-	} else if (raw_code == KEY_E1) {
-		// E1字符，不处理
-		recv_state = BEGIN_E1;
-	} else {
-		switch (recv_state) {
-			case NORMAL:
-				do_normal_key(raw_code);
-				break;
-			case BEGIN_E0:
-				do_e0_key(raw_code);
-				recv_state = NORMAL;
-				break;
-			case BEGIN_E1:
-				recv_state = NORMAL;
-				break;
-		}
+	irq_send_eoi(IRQ1_KEYBOARD);
+
+	// 缓冲区满时丢弃
+	if (scan_write - scan_read < KEYBOARD_SCAN_BUF_SIZE) {
+		scan_buf[scan_write % KEYBOARD_SCAN_BUF_SIZE] = raw_code;
+		barrier();
+		scan_write++;
 	}
-}
\ No newline at end of file
+	tasklet_schedule(&keyboard_tasklet);
+}
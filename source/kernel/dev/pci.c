@@ -0,0 +1,286 @@
+/**
+ * PCI 总线
+ * 只使用配置访问机制 1, 设备表在启动时建立, 之后不再变化
+ */
+#include "dev/pci.h"
+#include "comm/cpu_instr.h"
+#include "ipc/spinlock.h"
+#include "tools/log.h"
+#include "cpu/lapic.h"
+#include "core/memory.h"
+
+static pci_dev_t pci_dev_table[PCI_DEV_MAX];
+static int pci_dev_count;
+static pci_irq_t *pci_irq_table[PCI_IRQ_MAX];
+static int pci_irq_count;
+static spinlock_t pci_lock = SPINLOCK_INIT("pci");       // 地址和数据端口须成对访问
+
+/**
+ * 读取配置空间中 reg 所在的 32 位
+ */
+static uint32_t config_read(int bus, int slot, int func, int reg) {
+	uint32_t addr = PCI_CONFIG_ENABLE | (bus << 16) | (slot << 11) | (func << 8) | (reg & 0xFC);
+
+	irq_state_t state = spin_lock_irqsave(&pci_lock);
+	outl(PCI_CONFIG_ADDR, addr);
+	uint32_t value = inl(PCI_CONFIG_DATA);
+	spin_unlock_irqrestore(&pci_lock, state);
+	return value;
+}
+
+static void config_write(int bus, int slot, int func, int reg, uint32_t value) {
+	uint32_t addr = PCI_CONFIG_ENABLE | (bus << 16) | (slot << 11) | (func << 8) | (reg & 0xFC);
+
+	irq_state_t state = spin_lock_irqsave(&pci_lock);
+	outl(PCI_CONFIG_ADDR, addr);
+	outl(PCI_CONFIG_DATA, value);
+	spin_unlock_irqrestore(&pci_lock, state);
+}
+
+uint32_t pci_read_config(pci_dev_t *dev, int reg) {
+	return config_read(dev->bus, dev->slot, dev->func, reg);
+}
+
+void pci_write_config(pci_dev_t *dev, int reg, uint32_t value) {
+	config_write(dev->bus, dev->slot, dev->func, reg, value);
+}
+
+/**
+ * 取基址寄存器中的地址, 去掉类型位
+ */
+uint32_t pci_bar_addr(pci_dev_t *dev, int bar) {
+	uint32_t value = dev->bar[bar];
+	return (value & PCI_BAR_IO) ? (value & PCI_BAR_IO_MASK) : (value & PCI_BAR_MEM_MASK);
+}
+
+/**
+ * 打开命令寄存器中的 IO、内存或总线主控位
+ */
+void pci_enable(pci_dev_t *dev, uint32_t command) {
+	uint32_t value = pci_read_config(dev, PCI_COMMAND);
+	pci_write_config(dev, PCI_COMMAND, (value & 0xFFFF) | command);
+}
+
+/**
+ * 查找扩展能力, 返回其在配置空间中的偏移, 没有时返回 0
+ */
+int pci_find_cap(pci_dev_t *dev, int cap_id) {
+	if (!((pci_read_config(dev, PCI_COMMAND) >> 16) & PCI_STATUS_CAP_LIST)) {
+		return 0;
+	}
+
+	int offset = pci_read_config(dev, PCI_CAP_PTR) & 0xFC;
+	while (offset) {
+		uint32_t cap = pci_read_config(dev, offset);
+		if ((cap & 0xFF) == cap_id) {
+			return offset;
+		}
+		offset = (cap >> 8) & 0xFC;
+	}
+	return 0;
+}
+
+/**
+ * 让设备通过 MSI 向 BSP 发出中断, 设备不支持时返回 -1
+ */
+static int pci_enable_msi(pci_dev_t *dev, int vector) {
+	int cap = pci_find_cap(dev, PCI_CAP_ID_MSI);
+	if (cap == 0) {
+		return -1;
+	}
+
+	uint32_t ctrl = pci_read_config(dev, cap) >> 16;
+	pci_write_config(dev, cap + 4, PCI_MSI_ADDR_BASE | (lapic_id() << 12));
+	if (ctrl & PCI_MSI_CTRL_64BIT) {
+		pci_write_config(dev, cap + 8, 0);
+		pci_write_config(dev, cap + 12, vector);
+	} else {
+		pci_write_config(dev, cap + 8, vector);
+	}
+
+	// 只使用一个向量
+	uint32_t value = pci_read_config(dev, cap) & 0xFFFF;
+	ctrl = (ctrl & ~(0x7 << 4)) | PCI_MSI_CTRL_ENABLE;
+	pci_write_config(dev, cap, value | (ctrl << 16));
+	pci_enable(dev, PCI_COMMAND_INTX_DISABLE);
+	return 0;
+}
+
+/**
+ * 设置 MSI-X 表的第 0 项并启用, 其余项保持复位后的屏蔽状态
+ */
+static int pci_enable_msix(pci_dev_t *dev, int vector) {
+	int cap = pci_find_cap(dev, PCI_CAP_ID_MSIX);
+	if (cap == 0) {
+		return -1;
+	}
+
+	uint32_t table = pci_read_config(dev, cap + 4);
+	int bir = table & PCI_MSIX_BIR_MASK;
+	if (dev->bar[bir] & PCI_BAR_IO) {
+		return -1;
+	}
+
+	volatile uint32_t *entry = (volatile uint32_t *) memory_map_mmio(
+			pci_bar_addr(dev, bir) + (table & ~PCI_MSIX_BIR_MASK), PCI_MSIX_ENTRY_SIZE);
+	if (entry == (volatile uint32_t *) 0) {
+		return -1;
+	}
+
+	entry[PCI_MSIX_ENTRY_ADDR_LO] = PCI_MSI_ADDR_BASE | (lapic_id() << 12);
+	entry[PCI_MSIX_ENTRY_ADDR_HI] = 0;
+	entry[PCI_MSIX_ENTRY_DATA] = vector;
+	entry[PCI_MSIX_ENTRY_CTRL] = 0;
+
+	uint32_t value = pci_read_config(dev, cap);
+	uint32_t ctrl = ((value >> 16) & ~PCI_MSIX_CTRL_MASK) | PCI_MSIX_CTRL_ENABLE;
+	pci_write_config(dev, cap, (value & 0xFFFF) | (ctrl << 16));
+	pci_enable(dev, PCI_COMMAND_INTX_DISABLE);
+	return 0;
+}
+
+/**
+ * 改用消息中断, 先试 MSI 再试 MSI-X, 成功后通知驱动
+ */
+static int pci_irq_enable_msi(pci_irq_t *irq) {
+	if (pci_enable_msi(irq->dev, irq->msi_vector) == 0) {
+		irq->msix = 0;
+	} else if (pci_enable_msix(irq->dev, irq->msi_vector) == 0) {
+		irq->msix = 1;
+	} else {
+		return -1;
+	}
+
+	if (irq->msi_setup) {
+		irq->msi_setup(irq);
+	}
+	return 0;
+}
+
+/**
+ * 安装设备中断, 此时还在使用 8259, 先使用 BIOS 分配的 INTx 中断
+ */
+int pci_irq_install(pci_irq_t *irq, pci_dev_t *dev, irq_handler_t handler, int msi_vector) {
+	irq->dev = dev;
+	irq->handler = handler;
+	irq->msi_vector = msi_vector;
+	irq->msix = 0;
+
+	if (irq_apic_enabled() && (pci_irq_enable_msi(irq) == 0)) {
+		irq->vector = msi_vector;
+		irq_install(irq->vector, handler);
+	} else {
+		if ((dev->irq == 0) || (dev->irq >= 16)) {
+			log_printf("pci %d:%d.%d: no irq", dev->bus, dev->slot, dev->func);
+			return -1;
+		}
+
+		irq->vector = IRQ_PIC_START + dev->irq;
+		irq_install(irq->vector, handler);
+		irq_enable(irq->vector);
+	}
+
+	if (pci_irq_count < PCI_IRQ_MAX) {
+		pci_irq_table[pci_irq_count++] = irq;
+	}
+	return 0;
+}
+
+/**
+ * 切换到 APIC 模式后调用, 支持 MSI 或 MSI-X 的设备改用消息中断
+ * PCI 的 INTx 为电平触发且可能共享, 经 IOAPIC 投递时的触发方式及引脚不一定与 ISA 中断相同
+ */
+void pci_irq_apic_init(void) {
+	for (int i = 0; i < pci_irq_count; i++) {
+		pci_irq_t *irq = pci_irq_table[i];
+		if (irq->vector == irq->msi_vector) {
+			continue;
+		}
+
+		// 先装好新向量的处理函数, 设备改用消息中断后可能立即发出中断
+		irq_install(irq->msi_vector, irq->handler);
+		if (pci_irq_enable_msi(irq) == 0) {
+			irq_state_t state = irq_enter_protection();
+			irq_disable(irq->vector);
+			irq->vector = irq->msi_vector;
+			irq_leave_protection(state);
+		}
+	}
+}
+
+static void add_device(int bus, int slot, int func) {
+	if (pci_dev_count >= PCI_DEV_MAX) {
+		log_printf("pci: too many devices");
+		return;
+	}
+
+	pci_dev_t *dev = pci_dev_table + pci_dev_count++;
+	uint32_t id = config_read(bus, slot, func, PCI_VENDOR_ID);
+	uint32_t class_rev = config_read(bus, slot, func, PCI_CLASS_REV);
+
+	dev->bus = bus;
+	dev->slot = slot;
+	dev->func = func;
+	dev->vendor = id & 0xFFFF;
+	dev->device = id >> 16;
+	dev->class_code = class_rev >> 24;
+	dev->subclass = (class_rev >> 16) & 0xFF;
+	dev->prog_if = (class_rev >> 8) & 0xFF;
+	dev->irq = config_read(bus, slot, func, PCI_INTERRUPT_LINE) & 0xFF;
+	for (int i = 0; i < PCI_BAR_NR; i++) {
+		dev->bar[i] = config_read(bus, slot, func, PCI_BAR0 + i * 4);
+	}
+
+	log_printf("pci %d:%d.%d: %x:%x class %x.%x irq %d", bus, slot, func,
+	           dev->vendor, dev->device, dev->class_code, dev->subclass, dev->irq);
+}
+
+/**
+ * 逐个总线和插槽探测, 多功能设备再探测其余功能
+ */
+void pci_init(void) {
+	pci_dev_count = 0;
+	for (int bus = 0; bus < PCI_BUS_NR; bus++) {
+		for (int slot = 0; slot < PCI_SLOT_NR; slot++) {
+			if ((config_read(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == PCI_VENDOR_NONE) {
+				continue;
+			}
+
+			add_device(bus, slot, 0);
+
+			uint32_t header = config_read(bus, slot, 0, PCI_HEADER_TYPE) >> 16;
+			if (!(header & PCI_HEADER_MULTI_FUNC)) {
+				continue;
+			}
+
+			for (int func = 1; func < PCI_FUNC_NR; func++) {
+				if ((config_read(bus, slot, func, PCI_VENDOR_ID) & 0xFFFF) != PCI_VENDOR_NONE) {
+					add_device(bus, slot, func);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * 从 from 之后开始查找指定类别的设备, from 为空时从头查找
+ */
+pci_dev_t *pci_find_class(int class_code, int subclass, pci_dev_t *from) {
+	pci_dev_t *dev = from ? from + 1 : pci_dev_table;
+	for (; dev < pci_dev_table + pci_dev_count; dev++) {
+		if ((dev->class_code == class_code) && (dev->subclass == subclass)) {
+			return dev;
+		}
+	}
+	return (pci_dev_t *) 0;
+}
+
+pci_dev_t *pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *from) {
+	pci_dev_t *dev = from ? from + 1 : pci_dev_table;
+	for (; dev < pci_dev_table + pci_dev_count; dev++) {
+		if ((dev->vendor == vendor) && (dev->device == device)) {
+			return dev;
+		}
+	}
+	return (pci_dev_t *) 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * 内存盘
+ *
+ * 引导程序加载了映像时直接使用映像所在的内存, 否则按 RAMDISK_SIZE 分配一块空白的内存盘.
+ * 映像中有分区表时按分区访问, 也可以通过 0 号分区访问整个内存盘
+ */
+#include "dev/ramdisk.h"
+#include "dev/dev.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include "os_cfg.h"
+
+static ramdisk_t ramdisk;
+
+static void ramdisk_detect_part(ramdisk_t *disk) {
+	ramdisk_part_t *part = disk->part;
+	part->disk = disk;
+	part->start_sector = 0;
+	part->total_sectors = disk->sector_count;
+
+	mbr_t *mbr = (mbr_t *) disk->start;
+	if ((disk->sector_count == 0) || (mbr->boot_sign[0] != 0x55) || (mbr->boot_sign[1] != 0xAA)) {
+		return;
+	}
+
+	part_item_t *item = mbr->part_item;
+	for (int i = 0; i < MBR_PRIMARY_PART_NR; ++i, ++item) {
+		part = disk->part + i + 1;
+		part->disk = disk;
+		if ((item->system_id == FS_INVALID) || (item->relative_sectors >= disk->sector_count)) {
+			continue;
+		}
+
+		part->start_sector = item->relative_sectors;
+		part->total_sectors = item->total_sectors;
+		if (part->total_sectors > disk->sector_count - part->start_sector) {
+			part->total_sectors = disk->sector_count - part->start_sector;
+		}
+	}
+}
+
+void ramdisk_init(boot_info_t *boot_info) {
+	ramdisk_t *disk = &ramdisk;
+	kernel_memset(disk, 0, sizeof(ramdisk_t));
+	kernel_sprintf(disk->name, "ram0");
+
+	if (boot_info->ramdisk_size) {
+		disk->start = (uint8_t *) boot_info->ramdisk_start;
+		disk->sector_count = boot_info->ramdisk_size / SECTOR_SIZE;
+	} else if (RAMDISK_SIZE) {
+		uint32_t paddr = memory_alloc_pages(up2(RAMDISK_SIZE, MEM_PAGE_SIZE) / MEM_PAGE_SIZE);
+		if (paddr == 0) {
+			log_printf("ramdisk: alloc %d bytes failed\n", RAMDISK_SIZE);
+			return;
+		}
+		kernel_memset((void *) paddr, 0, RAMDISK_SIZE);
+		disk->start = (uint8_t *) paddr;
+		disk->sector_count = RAMDISK_SIZE / SECTOR_SIZE;
+	} else {
+		return;
+	}
+
+	ramdisk_detect_part(disk);
+	log_printf("Disk %s: ramdisk at %x, %dK\n", disk->name, (uint32_t) disk->start, disk->sector_count / 2);
+}
+
+int ramdisk_open(device_t *dev) {
+	int disk_id = (dev->minor >> 4) - 0xa;
+	int part_id = dev->minor & 0xF;
+
+	if ((disk_id != 0) || (part_id >= DISK_PRIMARY_PART_CNT)) {
+		log_printf("ramdisk_open: invalid disk id or partition id\n");
+		return -1;
+	}
+
+	ramdisk_part_t *part = ramdisk.part + part_id;
+	if (part->total_sectors == 0) {
+		log_printf("ramdisk_open: partition %s%d doesn't exist\n", ramdisk.name, part_id);
+		return -1;
+	}
+
+	dev->data = part;
+	return 0;
+}
+
+/**
+ * 截取不超出分区的部分, 返回可以访问的扇区数
+ */
+static int ramdisk_clip(ramdisk_part_t *part, int addr, int size) {
+	if ((addr < 0) || (size < 0) || (addr >= part->total_sectors)) {
+		return 0;
+	}
+	return size > part->total_sectors - addr ? part->total_sectors - addr : size;
+}
+
+int ramdisk_read(device_t *dev, int addr, char *buf, int size) {
+	ramdisk_part_t *part = (ramdisk_part_t *) dev->data;
+	int sector_cnt = ramdisk_clip(part, addr, size);
+	uint8_t *src = part->disk->start + (part->start_sector + addr) * SECTOR_SIZE;
+	kernel_memcpy(buf, src, sector_cnt * SECTOR_SIZE);
+	return sector_cnt;
+}
+
+int ramdisk_write(device_t *dev, int addr, const char *buf, int size) {
+	ramdisk_part_t *part = (ramdisk_part_t *) dev->data;
+	int sector_cnt = ramdisk_clip(part, addr, size);
+	uint8_t *dest = part->disk->start + (part->start_sector + addr) * SECTOR_SIZE;
+	kernel_memcpy(dest, (void *) buf, sector_cnt * SECTOR_SIZE);
+	return sector_cnt;
+}
+
+/**
+ * 直接在映像和 bio 的各段之间复制
+ */
+int ramdisk_submit(device_t *dev, bio_t *bio) {
+	ramdisk_part_t *part = (ramdisk_part_t *) dev->data;
+	int sector_cnt = ramdisk_clip(part, bio->sector, bio->size / SECTOR_SIZE);
+	uint8_t *start = part->disk->start + (part->start_sector + bio->sector) * SECTOR_SIZE;
+
+	bio_iter_t iter;
+	bio_iter_init(&iter, bio, 0, sector_cnt * SECTOR_SIZE);
+	bio_iter_copy(&iter, start, sector_cnt * SECTOR_SIZE, !bio->is_write);
+	return sector_cnt;
+}
+
+int ramdisk_control(device_t *dev, int cmd, int arg0, int arg1) {
+	return 0;
+}
+
+void ramdisk_close(device_t *dev) {
+
+}
+
+dev_desc_t dev_ramdisk_desc = {
+		.name = "ramdisk",
+		.major = DEV_TYPE_RAMDISK,
+		.open = ramdisk_open,
+		.read = ramdisk_read,
+		.write = ramdisk_write,
+		.control = ramdisk_control,
+		.close = ramdisk_close,
+		.submit = ramdisk_submit,
+};
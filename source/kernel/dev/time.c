@@ -3,21 +3,83 @@
 //
 
 #include "dev/time.h"
+#include "core/vdso.h"
+#include "cpu/cpu.h"
+#include "cpu/lapic.h"
+#include "cpu/smp.h"
+#include "core/softirq.h"
+#include "tools/klib.h"
+#include "tools/log.h"
 
 static uint32_t sys_tick;                        // 系统启动后的tick数量
+static uint32_t pending_ticks;                   // 尚未在软中断中处理的节拍数
+static uint32_t tsc_khz;                         // TSC 频率, 为 0 表示不可用
+static uint64_t tsc_base;                        // 开机计时起点的 TSC 值
+
+static uint64_t tsc_to_ns(uint64_t tsc);
 
 /**
- * 定时器中断处理函数
+ * 全局的时钟节拍, 每个节拍只在一个 CPU 上处理
+ * 中断中只更新时间, 睡眠和超时的检查放到软中断中
  */
-void do_handler_timer(exception_frame_t *frame) {
+static void time_global_tick(void) {
 	sys_tick++;
+	uint64_t tsc = tsc_khz ? rdtsc() : 0;
+	vdso_time_tick(sys_tick, tsc_to_ns(tsc), tsc);
+	pending_ticks++;
+	softirq_raise(SOFTIRQ_TIMER);
+}
+
+/**
+ * 时钟软中断, 软中断被推迟时补上错过的节拍
+ */
+static void time_softirq(void) {
+	irq_state_t state = irq_enter_protection();
+	uint32_t ticks = pending_ticks;
+	pending_ticks = 0;
+	irq_leave_protection(state);
+
+	while (ticks-- > 0) {
+		task_sleep_tick();
+	}
+}
 
+/**
+ * 定时器中断处理函数, 没有 IOAPIC 时使用
+ */
+void do_handler_timer(exception_frame_t *frame) {
 	// 先发EOI，而不是放在最后
 	// 放最后将从任务中切换出去之后，除非任务再切换回来才能继续噢应
-	pic_send_eoi(IRQ0_TIMER);
+	irq_send_eoi(IRQ0_TIMER);
+	time_global_tick();
+	task_time_tick();
+}
+
+/**
+ * 各 CPU 的本地定时器中断, 全局节拍由 BSP 负责
+ */
+void do_handler_lapic_timer(exception_frame_t *frame) {
+	lapic_eoi();
+	if (cpu_this()->id == 0) {
+		time_global_tick();
+	}
 	task_time_tick();
 }
 
+/**
+ * 改用本地 APIC 定时器作为时钟, 在切换到 IOAPIC 之后调用
+ * 校准失败时继续使用 PIT
+ */
+void time_lapic_init(void) {
+	if (lapic_timer_calibrate() < 0) {
+		return;
+	}
+
+	irq_disable(IRQ0_TIMER);
+	irq_install(IRQ_LAPIC_TIMER, exception_handler_lapic_timer);
+	lapic_timer_start();
+}
+
 /**
  * 初始化硬件定时器
  */
@@ -34,12 +96,148 @@ static void init_pit(void) {
 	irq_enable(IRQ0_TIMER);
 }
 
+/**
+ * 忙等待指定的微秒数, 不依赖中断, 可在开中断前使用
+ * 使用 PIT 通道2的单次计数模式, 通道0保持周期中断不受影响
+ */
+void time_udelay(uint32_t us) {
+	while (us > 0) {
+		// 16位计数器最多约 54ms, 分段等待
+		uint32_t curr_us = us > 50000 ? 50000 : us;
+		uint32_t count = curr_us * (PIT_OSC_FREQ / 1000) / 1000 + 1;
+
+		uint8_t gate = inb(PIT_CHANNEL2_GATE_PORT) & ~(PIT_GATE_ENABLE | PIT_SPEAKER_ENABLE);
+		outb(PIT_CHANNEL2_GATE_PORT, gate);
+		outb(PIT_COMMAND_MODE_PORT, PIT_CHANNLE2 | PIT_LOAD_LOHI | PIT_MODE0);
+		outb(PIT_CHANNEL2_DATA_PORT, count & 0xFF);
+		outb(PIT_CHANNEL2_DATA_PORT, (count >> 8) & 0xFF);
+		outb(PIT_CHANNEL2_GATE_PORT, gate | PIT_GATE_ENABLE);
+
+		while (!(inb(PIT_CHANNEL2_GATE_PORT) & PIT_CHANNEL2_OUT)) {
+		}
+
+		us -= curr_us;
+	}
+}
+
+/**
+ * 用 PIT 通道2 测量 TSC 的频率
+ */
+static void calibrate_tsc(void) {
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_FEAT_EDX_TSC)) {
+		log_printf("no tsc, clock resolution %d ms", OS_TICKS_MS);
+		return;
+	}
+
+	uint64_t start = rdtsc();
+	time_udelay(TSC_CALIBRATE_MS * 1000);
+	uint64_t cycles = rdtsc() - start;
+
+	uint32_t rem;
+	tsc_khz = (uint32_t) div64_32(cycles, TSC_CALIBRATE_MS, &rem);
+	tsc_base = rdtsc();
+	vdso_set_tsc(tsc_khz);
+	log_printf("tsc: %d khz", tsc_khz);
+}
+
+/**
+ * TSC 为 tsc 时开机以来的纳秒数
+ * 没有 TSC 时只能精确到时钟节拍
+ */
+static uint64_t tsc_to_ns(uint64_t tsc) {
+	if (tsc_khz == 0) {
+		return (uint64_t) sys_tick * OS_TICKS_MS * NSEC_PER_MSEC;
+	}
+
+	// 先整除再处理余数, 避免乘法溢出
+	uint32_t rem;
+	uint64_t ms = div64_32(tsc - tsc_base, tsc_khz, &rem);
+	return ms * NSEC_PER_MSEC + div64_32((uint64_t) rem * NSEC_PER_MSEC, tsc_khz, &rem);
+}
+
+/**
+ * 开机以来的纳秒数, 单调递增
+ */
+uint64_t time_ns(void) {
+	return tsc_to_ns(tsc_khz ? rdtsc() : 0);
+}
+
+static void ns_to_timespec(uint64_t ns, struct timespec *ts) {
+	uint32_t nsec;
+	ts->tv_sec = (time_t) div64_32(ns, NSEC_PER_SEC, &nsec);
+	ts->tv_nsec = nsec;
+}
+
+int sys_clock_gettime(clockid_t clock_id, struct timespec *ts) {
+	if (ts == (struct timespec *) 0) {
+		return -1;
+	}
+
+	switch (clock_id) {
+		case CLOCK_MONOTONIC:
+		case CLOCK_MONOTONIC_RAW:
+		case CLOCK_BOOTTIME:
+			ns_to_timespec(time_ns(), ts);
+			return 0;
+		case CLOCK_MONOTONIC_COARSE:
+			ns_to_timespec((uint64_t) sys_tick * OS_TICKS_MS * NSEC_PER_MSEC, ts);
+			return 0;
+		default:
+			// 没有实时时钟, 不提供墙上时间
+			return -1;
+	}
+}
+
+/**
+ * 精确睡眠: 先按整节拍睡眠, 剩余不足一个节拍的部分忙等
+ * 睡 n 个节拍实际经过的时间在 n-1 到 n 个节拍之间, 所以按剩余时间向下取整, 不会睡过头
+ */
+int sys_nanosleep(const struct timespec *req, struct timespec *rem) {
+	if ((req == (struct timespec *) 0) || (req->tv_sec < 0)
+	    || (req->tv_nsec < 0) || (req->tv_nsec >= NSEC_PER_SEC)) {
+		return -1;
+	}
+
+	uint64_t deadline = time_ns() + (uint64_t) req->tv_sec * NSEC_PER_SEC + req->tv_nsec;
+	uint32_t tick_ns = OS_TICKS_MS * NSEC_PER_MSEC;
+	while (1) {
+		uint64_t now = time_ns();
+		if (now >= deadline) {
+			break;
+		}
+
+		uint32_t rem_ns;
+		uint64_t ticks = div64_32(deadline - now, tick_ns, &rem_ns);
+		if (ticks > 0) {
+			task_sleep_ticks(ticks > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t) ticks);
+		} else if (tsc_khz == 0) {
+			// 没有 TSC 时无法忙等到更细的精度, 补足一个节拍
+			task_sleep_ticks(1);
+			break;
+		} else {
+			cpu_pause();
+		}
+	}
+
+	// 没有信号, 不会被提前打断
+	if (rem) {
+		rem->tv_sec = 0;
+		rem->tv_nsec = 0;
+	}
+	return 0;
+}
+
 /**
  * 定时器初始化
  */
 void time_init(void) {
 	sys_tick = 0;
+	pending_ticks = 0;
+	softirq_register(SOFTIRQ_TIMER, time_softirq);
 
+	calibrate_tsc();
 	init_pit();
 }
 
@@ -8,15 +8,16 @@ static tty_t tty_devs[TTY_NR];
 static int current_tty = 0;
 
 void tty_fifo_init(tty_fifo_t *fifo, char *buf, int size) {
+	spinlock_init(&fifo->lock, "tty_fifo");
 	fifo->buf = buf;
 	fifo->size = size;
 	fifo->read = fifo->write = fifo->count = 0;
 }
 
 int tty_fifo_put(tty_fifo_t *fifo, char c) {
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&fifo->lock);
 	if (fifo->count >= fifo->size) {
-		irq_leave_protection(state);
+		spin_unlock_irqrestore(&fifo->lock, state);
 		return -1;
 	}
 	fifo->buf[fifo->write++] = c;
@@ -24,14 +25,14 @@ int tty_fifo_put(tty_fifo_t *fifo, char c) {
 		fifo->write = 0;
 	}
 	++fifo->count;
-	irq_leave_protection(state);
+	spin_unlock_irqrestore(&fifo->lock, state);
 	return 0;
 }
 
 int tty_fifo_get(tty_fifo_t *fifo, char *c) {
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&fifo->lock);
 	if (fifo->count <= 0) {
-		irq_leave_protection(state);
+		spin_unlock_irqrestore(&fifo->lock, state);
 		return -1;
 	}
 	*c = fifo->buf[fifo->read++];
@@ -39,7 +40,7 @@ int tty_fifo_get(tty_fifo_t *fifo, char *c) {
 		fifo->read = 0;
 	}
 	--fifo->count;
-	irq_leave_protection(state);
+	spin_unlock_irqrestore(&fifo->lock, state);
 	return 0;
 }
 
@@ -60,7 +61,7 @@ int tty_open(device_t *dev) {
 	}
 	tty_t *tty = tty_devs + minor;
 	tty_fifo_init(&tty->ififo, tty->ibuf, TTY_IBUF_SIZE);
-	sem_init(&tty->isem, 0);
+	wait_queue_init(&tty->iwait, "tty_in");
 	tty->iflags = TTY_INCLR | TTY_IECHO;
 	tty_fifo_init(&tty->ofifo, tty->obuf, TTY_OBUF_SIZE);
 	sem_init(&tty->osem, TTY_OBUF_SIZE);
@@ -80,9 +81,18 @@ int tty_read(device_t *dev, int addr, char *buf, int size) {
 	char *p_buf = buf;
 	int len = 0;
 	while (len < size) {
-		sem_p(&tty->isem);
+		// 先检查再睡眠, 两者都在 iwait 的锁内进行, 不会错过键盘中断的唤醒
+		irq_state_t state = spin_lock_irqsave(&tty->iwait.lock);
+		while (tty->ififo.count == 0) {
+			wait_queue_sleep_locked(&tty->iwait, WAIT_EXCLUSIVE, WAIT_FOREVER, state);
+			state = spin_lock_irqsave(&tty->iwait.lock);
+		}
+		spin_unlock_irqrestore(&tty->iwait.lock, state);
+
 		char c;
-		tty_fifo_get(&tty->ififo, &c);
+		if (tty_fifo_get(&tty->ififo, &c) < 0) {
+			continue;
+		}
 		switch (c) {
 			case ASCII_DEL:
 				if (len == 0) {
@@ -173,11 +183,10 @@ void tty_close(device_t *dev) {
 
 void tty_in(char c) {
 	tty_t *tty = tty_devs + current_tty;
-	if (sem_count(&tty->isem) >= TTY_IBUF_SIZE) {
+	if (tty_fifo_put(&tty->ififo, c) < 0) {
 		return;
 	}
-	tty_fifo_put(&tty->ififo, c);
-	sem_v(&tty->isem);
+	wake_up(&tty->iwait);
 }
 
 void tty_select(int minor) {
@@ -0,0 +1,249 @@
+/**
+ * virtio 设备: 传统 PCI 接口及分离式虚拟队列
+ *
+ * 设备支持间接描述符时, 一条链无论有多少个缓冲区都只占用环中的一个描述符, 队列能同时容纳更多请求.
+ * 支持事件索引时, 驱动在已用环中记下希望被中断的位置, 设备在可用环中记下希望被通知的位置,
+ * 双方据此跳过对方正在处理时的多余中断和通知
+ */
+#include "dev/virtio.h"
+#include "comm/cpu_instr.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+/**
+ * 复位设备并协商特性, 只接受驱动支持的特性
+ */
+int virtio_dev_init(virtio_dev_t *dev, pci_dev_t *pci, uint32_t features) {
+	if (!(pci->bar[0] & PCI_BAR_IO)) {
+		return -1;
+	}
+
+	dev->pci = pci;
+	dev->io_base = pci_bar_addr(pci, 0);
+	dev->queue_count = 0;
+	pci_enable(pci, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+	outb(dev->io_base + VIRTIO_PCI_STATUS, 0);
+	outb(dev->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+	outb(dev->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+	dev->features = inl(dev->io_base + VIRTIO_PCI_HOST_FEATURES) & features;
+	outl(dev->io_base + VIRTIO_PCI_GUEST_FEATURES, dev->features);
+	return 0;
+}
+
+void virtio_dev_ready(virtio_dev_t *dev) {
+	uint8_t status = inb(dev->io_base + VIRTIO_PCI_STATUS);
+	outb(dev->io_base + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_dev_failed(virtio_dev_t *dev) {
+	uint8_t status = inb(dev->io_base + VIRTIO_PCI_STATUS);
+	outb(dev->io_base + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+uint32_t virtio_config_read32(virtio_dev_t *dev, int offset) {
+	return inl(dev->io_base + VIRTIO_PCI_CONFIG(dev->irq.msix) + offset);
+}
+
+/**
+ * 改用 MSI-X 后, 各队列的中断须指定使用的表项, 否则设备不再发出中断
+ */
+static void virtio_msi_setup(pci_irq_t *irq) {
+	virtio_dev_t *dev = (virtio_dev_t *) irq->data;
+	if (!irq->msix) {
+		return;
+	}
+
+	outw(dev->io_base + VIRTIO_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+	for (int i = 0; i < dev->queue_count; i++) {
+		outw(dev->io_base + VIRTIO_PCI_QUEUE_SEL, dev->queue[i]->index);
+		outw(dev->io_base + VIRTIO_MSI_QUEUE_VECTOR, 0);
+		if (inw(dev->io_base + VIRTIO_MSI_QUEUE_VECTOR) != 0) {
+			log_printf("virtio: queue %d msi-x vector rejected", dev->queue[i]->index);
+		}
+	}
+}
+
+int virtio_irq_install(virtio_dev_t *dev, irq_handler_t handler, int msi_vector) {
+	dev->irq.msi_setup = virtio_msi_setup;
+	dev->irq.data = dev;
+	return pci_irq_install(&dev->irq, dev->pci, handler, msi_vector);
+}
+
+/**
+ * 应答中断, 返回是否需要处理. INTx 可能共享, 读取 ISR 判断并撤销中断信号; MSI-X 不共享
+ */
+int virtio_irq_ack(virtio_dev_t *dev) {
+	if (dev->irq.msix) {
+		return 1;
+	}
+	return inb(dev->io_base + VIRTIO_PCI_ISR);
+}
+
+/**
+ * 初始化设备的第 index 个队列, 队列大小由设备决定
+ * 描述符表和可用环在前, 已用环从下一个 4KB 边界开始, 整个队列物理连续
+ */
+int virtq_init(virtq_t *vq, virtio_dev_t *dev, int index) {
+	outw(dev->io_base + VIRTIO_PCI_QUEUE_SEL, index);
+	uint16_t size = inw(dev->io_base + VIRTIO_PCI_QUEUE_NUM);
+	if ((size == 0) || (size > VIRTQ_SIZE_MAX) || (dev->queue_count >= sizeof(dev->queue) / sizeof(dev->queue[0]))) {
+		return -1;
+	}
+
+	uint32_t used_offset = up2(sizeof(vring_desc_t) * size + sizeof(uint16_t) * (3 + size), VIRTIO_PCI_QUEUE_ALIGN);
+	uint32_t total = used_offset + up2(sizeof(uint16_t) * 3 + sizeof(vring_used_elem_t) * size, VIRTIO_PCI_QUEUE_ALIGN);
+	uint32_t mem = memory_alloc_pages(total / MEM_PAGE_SIZE);
+	if (mem == 0) {
+		return -1;
+	}
+	kernel_memset((void *) mem, 0, total);
+
+	vq->dev = dev;
+	vq->index = index;
+	vq->size = size;
+	vq->indirect = (dev->features & VIRTIO_RING_F_INDIRECT_DESC) != 0;
+	vq->event_idx = (dev->features & VIRTIO_RING_F_EVENT_IDX) != 0;
+	vq->desc = (vring_desc_t *) mem;
+	vq->avail = (vring_avail_t *) (mem + sizeof(vring_desc_t) * size);
+	vq->used = (vring_used_t *) (mem + used_offset);
+	for (int i = 0; i < size; i++) {
+		vq->desc[i].next = i + 1;
+		vq->token[i] = (void *) 0;
+	}
+	vq->free_head = 0;
+	vq->free_count = size;
+	vq->avail_idx = 0;
+	vq->kicked_idx = 0;
+	vq->last_used = 0;
+
+	outl(dev->io_base + VIRTIO_PCI_QUEUE_PFN, mem / VIRTIO_PCI_QUEUE_ALIGN);
+	dev->queue[dev->queue_count++] = vq;
+	return 0;
+}
+
+/**
+ * 把 table 中的 count 个缓冲区作为一条链放入可用环, 完成后由 virtq_get_used 取回 token
+ * 支持间接描述符时直接使用 table, 调用者须保证 table 物理连续且在完成前不被修改;
+ * 否则复制到队列的描述符中. 描述符不够时返回 -1
+ */
+int virtq_add(virtq_t *vq, vring_desc_t *table, int count, void *token) {
+	for (int i = 0; i < count; i++) {
+		table[i].flags = (table[i].flags & ~VRING_DESC_F_NEXT) | (i < count - 1 ? VRING_DESC_F_NEXT : 0);
+		table[i].next = i + 1;
+	}
+
+	int indirect = vq->indirect && (count > 1);
+	int need = indirect ? 1 : count;
+	if (vq->free_count < need) {
+		return -1;
+	}
+
+	uint16_t head = vq->free_head;
+	if (indirect) {
+		vring_desc_t *desc = vq->desc + head;
+		desc->addr = (uint32_t) table;
+		desc->len = count * sizeof(vring_desc_t);
+		desc->flags = VRING_DESC_F_INDIRECT;
+		vq->free_head = desc->next;
+	} else {
+		// 空闲链表中相邻的描述符已经通过 next 相连, 只需填写内容
+		uint16_t idx = head;
+		for (int i = 0; i < count; i++) {
+			vring_desc_t *desc = vq->desc + idx;
+			desc->addr = table[i].addr;
+			desc->len = table[i].len;
+			desc->flags = table[i].flags;
+			idx = desc->next;
+		}
+		vq->free_head = idx;
+	}
+
+	vq->free_count -= need;
+	vq->token[head] = token;
+	vq->avail->ring[vq->avail_idx % vq->size] = head;
+	vq->avail_idx++;
+	return 0;
+}
+
+/**
+ * 发布新放入的链, 设备要求时才通知, 通知需要退出到虚拟机监控器, 代价较高
+ */
+void virtq_kick(virtq_t *vq) {
+	uint16_t old_idx = vq->kicked_idx;
+	uint16_t new_idx = vq->avail_idx;
+
+	barrier();
+	*(volatile uint16_t *) &vq->avail->idx = new_idx;
+	mb();
+
+	int notify;
+	if (vq->event_idx) {
+		uint16_t event = *(volatile uint16_t *) &vq->used->ring[vq->size];
+		notify = (uint16_t) (new_idx - event - 1) < (uint16_t) (new_idx - old_idx);
+	} else {
+		notify = !(*(volatile uint16_t *) &vq->used->flags & VRING_USED_F_NO_NOTIFY);
+	}
+
+	vq->kicked_idx = new_idx;
+	if (notify) {
+		outw(vq->dev->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+	}
+}
+
+/**
+ * 取出一条已完成的链并回收其描述符, 没有时返回空
+ */
+void *virtq_get_used(virtq_t *vq, uint32_t *len) {
+	if (vq->last_used == *(volatile uint16_t *) &vq->used->idx) {
+		return (void *) 0;
+	}
+	barrier();
+
+	vring_used_elem_t *elem = vq->used->ring + (vq->last_used % vq->size);
+	uint16_t head = elem->id;
+	if (len) {
+		*len = elem->len;
+	}
+	vq->last_used++;
+
+	uint16_t tail = head;
+	int count = 1;
+	if (!(vq->desc[head].flags & VRING_DESC_F_INDIRECT)) {
+		while (vq->desc[tail].flags & VRING_DESC_F_NEXT) {
+			tail = vq->desc[tail].next;
+			count++;
+		}
+	}
+	vq->desc[tail].next = vq->free_head;
+	vq->free_head = head;
+	vq->free_count += count;
+
+	void *token = vq->token[head];
+	vq->token[head] = (void *) 0;
+	return token;
+}
+
+/**
+ * 处理已用环期间不需要中断. 使用事件索引时不更新中断位置即可, 设备越过该位置后不会再次中断
+ */
+void virtq_disable_cb(virtq_t *vq) {
+	if (!vq->event_idx) {
+		vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+	}
+}
+
+/**
+ * 重新允许中断, 返回 1 表示在此期间又有链完成, 调用者须再处理一遍
+ */
+int virtq_enable_cb(virtq_t *vq) {
+	if (vq->event_idx) {
+		*(volatile uint16_t *) &vq->avail->ring[vq->size] = vq->last_used;
+	} else {
+		*(volatile uint16_t *) &vq->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+	}
+	mb();
+	return vq->last_used != *(volatile uint16_t *) &vq->used->idx;
+}
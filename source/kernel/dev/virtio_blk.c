@@ -0,0 +1,360 @@
+/**
+ * virtio 块设备
+ *
+ * 请求队列线程取出一组请求后, 为其填写一张描述符表并放入虚拟队列, 不等完成就继续取下一组.
+ * 设备完成后发出中断, 小任务关闭中断后取完已用环中的请求再重新打开, 设备连续完成多个请求时只中断一次.
+ * 目前只支持一个设备
+ */
+#include "dev/virtio_blk.h"
+#include "dev/dev.h"
+#include "comm/cpu_instr.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static virtio_blk_t virtio_blk;
+static int virtio_blk_poll;         // 中断安装失败, 每个请求都查询等待完成
+
+/**
+ * 追加一段物理连续的内存, 与上一段相接时合并
+ * 返回追加后的描述符数量, 超过设备允许的段数时返回 -1
+ */
+static int virtio_blk_add_seg(virtio_blk_t *blk, virtio_blk_cmd_t *cmd, int count, uint32_t paddr, uint32_t size, int is_write) {
+	vring_desc_t *desc = cmd->table + count - 1;
+	if ((count > 1) && ((uint32_t) desc->addr + desc->len == paddr)) {
+		desc->len += size;
+		return count;
+	}
+
+	if (count > blk->seg_max) {
+		return -1;
+	}
+	desc = cmd->table + count++;
+	desc->addr = paddr;
+	desc->len = size;
+	desc->flags = is_write ? 0 : VRING_DESC_F_WRITE;
+	return count;
+}
+
+/**
+ * 填写请求头、各数据段和状态字节, 返回描述符数量
+ */
+static int virtio_blk_setup(virtio_blk_t *blk, virtio_blk_cmd_t *cmd, blk_request_t *req) {
+	cmd->hdr.type = req->is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	cmd->hdr.reserved = 0;
+	cmd->hdr.sector = req->sector;
+	cmd->status = 0xFF;
+	cmd->req = req;
+
+	cmd->table[0].addr = (uint32_t) &cmd->hdr;
+	cmd->table[0].len = sizeof(virtio_blk_hdr_t);
+	cmd->table[0].flags = 0;
+
+	int count = 1;
+	for (blk_request_t *part = req; part; part = blk_request_next(req, part)) {
+		bio_iter_t iter;
+		uint32_t paddr, len;
+		bio_iter_init(&iter, part->bio, part->bio_offset, part->count * SECTOR_SIZE);
+		while ((len = bio_iter_next(&iter, &paddr, part->count * SECTOR_SIZE)) > 0) {
+			count = virtio_blk_add_seg(blk, cmd, count, paddr, len, req->is_write);
+			if (count < 0) {
+				return -1;
+			}
+		}
+	}
+
+	vring_desc_t *desc = cmd->table + count++;
+	desc->addr = (uint32_t) &cmd->status;
+	desc->len = 1;
+	desc->flags = VRING_DESC_F_WRITE;
+	return count;
+}
+
+static void virtio_blk_put_cmd(virtio_blk_t *blk, virtio_blk_cmd_t *cmd) {
+	irq_state_t state = spin_lock_irqsave(&blk->lock);
+	blk->busy &= ~(1 << cmd->index);
+	cmd->req = (blk_request_t *) 0;
+	spin_unlock_irqrestore(&blk->lock, state);
+}
+
+/**
+ * 结束设备已完成的请求, 取完后才重新允许中断
+ */
+static void virtio_blk_complete(virtio_blk_t *blk) {
+	virtio_blk_cmd_t *done_list[VIRTIO_BLK_DEPTH];
+	int count = 0;
+
+	irq_state_t state = spin_lock_irqsave(&blk->lock);
+	do {
+		virtq_disable_cb(&blk->vq);
+
+		virtio_blk_cmd_t *cmd;
+		while ((cmd = (virtio_blk_cmd_t *) virtq_get_used(&blk->vq, (uint32_t *) 0)) != (virtio_blk_cmd_t *) 0) {
+			done_list[count++] = cmd;
+		}
+	} while (virtq_enable_cb(&blk->vq));
+	spin_unlock_irqrestore(&blk->lock, state);
+
+	for (int i = 0; i < count; i++) {
+		virtio_blk_cmd_t *cmd = done_list[i];
+		blk_request_t *req = cmd->req;
+		int done = cmd->status == VIRTIO_BLK_S_OK ? req->sectors : 0;
+		if (done == 0) {
+			log_printf("virtio_blk %s: request failed, status %d\n", blk->name, cmd->status);
+		}
+
+		// 先放回 cmd, 队列线程被唤醒后可以立即使用
+		virtio_blk_put_cmd(blk, cmd);
+		blk_end_request(&blk->queue, req, done);
+	}
+}
+
+static void virtio_blk_tasklet(void *data) {
+	virtio_blk_complete((virtio_blk_t *) data);
+}
+
+/**
+ * 请求队列的执行函数: 放入虚拟队列后立即返回, 由中断下半部结束请求
+ * 队列深度不超过 cmd 的数量, 执行到这里时一定有空闲的 cmd
+ */
+static void virtio_blk_request(blk_queue_t *queue, blk_request_t *req) {
+	virtio_blk_t *blk = (virtio_blk_t *) queue->data;
+	if (req->is_write && blk->read_only) {
+		blk_end_request(queue, req, 0);
+		return;
+	}
+
+	irq_state_t state = spin_lock_irqsave(&blk->lock);
+	int index = 0;
+	while ((index < blk->cmd_count) && (blk->busy & (1 << index))) {
+		index++;
+	}
+	if (index < blk->cmd_count) {
+		blk->busy |= 1 << index;
+	}
+	spin_unlock_irqrestore(&blk->lock, state);
+
+	if (index >= blk->cmd_count) {
+		log_printf("virtio_blk %s: no free cmd\n", blk->name);
+		blk_end_request(queue, req, 0);
+		return;
+	}
+
+	virtio_blk_cmd_t *cmd = blk->cmd[index];
+	int count = virtio_blk_setup(blk, cmd, req);
+	int err = -1;
+	if (count > 0) {
+		state = spin_lock_irqsave(&blk->lock);
+		err = virtq_add(&blk->vq, cmd->table, count, cmd);
+		if (err == 0) {
+			virtq_kick(&blk->vq);
+		}
+		spin_unlock_irqrestore(&blk->lock, state);
+	}
+
+	if (err < 0) {
+		log_printf("virtio_blk %s: submit request failed\n", blk->name);
+		virtio_blk_put_cmd(blk, cmd);
+		blk_end_request(queue, req, 0);
+		return;
+	}
+
+	// 队列线程创建之前须在返回前完成
+	if (virtio_blk_poll || (queue->thread == (task_t *) 0)) {
+		while (blk->busy & (1 << index)) {
+			virtio_blk_complete(blk);
+			cpu_pause();
+		}
+	}
+}
+
+static void virtio_blk_detect_part(virtio_blk_t *blk) {
+	static mbr_t mbr;
+
+	blk->part[0].blk = blk;
+	blk->part[0].start_sector = 0;
+	blk->part[0].total_sectors = blk->sector_count;
+	if (blk_rw(&blk->queue, 0, 0, (char *) &mbr, 1) != 1) {
+		log_printf("virtio_blk %s: read MBR failed\n", blk->name);
+		return;
+	}
+
+	part_item_t *item = mbr.part_item;
+	for (int i = 0; i < MBR_PRIMARY_PART_NR; ++i, ++item) {
+		virtio_blk_part_t *part = blk->part + i + 1;
+		part->blk = blk;
+		if (item->system_id != FS_INVALID) {
+			part->start_sector = item->relative_sectors;
+			part->total_sectors = item->total_sectors;
+		}
+	}
+}
+
+static void print_blk_info(virtio_blk_t *blk) {
+	log_printf("Disk %s: virtio, %s\n", blk->name, blk->read_only ? "read only" : "read write");
+	log_printf("    queue size %d, depth %d, %s, %s\n", blk->vq.size, blk->queue.depth,
+	           blk->vq.indirect ? "indirect" : "direct", blk->vq.event_idx ? "event idx" : "no event idx");
+	log_printf("    total size: %dM\n", blk->sector_count / 2 / 1024);
+	for (int i = 1; i < DISK_PRIMARY_PART_CNT; i++) {
+		virtio_blk_part_t *part = blk->part + i;
+		if (part->total_sectors) {
+			log_printf("        %s%d: %dM\n", blk->name, i, part->total_sectors / 2 / 1024);
+		}
+	}
+}
+
+/**
+ * 按设备能力确定一个请求最多的扇区数和同时进行的请求数
+ * 不支持间接描述符时每个请求在环中占用整条链, 环中须能放下 depth 条最长的链
+ */
+static int virtio_blk_set_limits(virtio_blk_t *blk) {
+	blk->seg_max = VIRTIO_BLK_SEG_NR;
+	if (blk->dev.features & VIRTIO_BLK_F_SEG_MAX) {
+		int seg_max = virtio_config_read32(&blk->dev, VIRTIO_BLK_CFG_SEG_MAX);
+		if ((seg_max > 0) && (seg_max < blk->seg_max)) {
+			blk->seg_max = seg_max;
+		}
+	}
+	if (!blk->vq.indirect && (blk->seg_max > blk->vq.size - 2)) {
+		blk->seg_max = blk->vq.size - 2;
+	}
+	if (blk->seg_max < 2) {
+		return -1;
+	}
+
+	int depth = VIRTIO_BLK_DEPTH;
+	int chain = blk->vq.indirect ? 1 : blk->seg_max + 2;
+	if (depth * chain > blk->vq.size) {
+		depth = blk->vq.size / chain;
+	}
+
+	for (blk->cmd_count = 0; blk->cmd_count < depth; blk->cmd_count++) {
+		virtio_blk_cmd_t *cmd = (virtio_blk_cmd_t *) memory_alloc_page();
+		if (cmd == (virtio_blk_cmd_t *) 0) {
+			break;
+		}
+		kernel_memset(cmd, 0, sizeof(virtio_blk_cmd_t));
+		cmd->index = blk->cmd_count;
+		blk->cmd[blk->cmd_count] = cmd;
+	}
+	return blk->cmd_count > 0 ? 0 : -1;
+}
+
+void virtio_blk_init(void) {
+	pci_dev_t *pci = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_DEV_ID_BLK, (pci_dev_t *) 0);
+	if (pci == (pci_dev_t *) 0) {
+		return;
+	}
+
+	log_printf("Check virtio blk...\n");
+	virtio_blk_t *blk = &virtio_blk;
+	kernel_sprintf(blk->name, "vda");
+	spinlock_init(&blk->lock, "virtio_blk");
+	tasklet_init(&blk->tasklet, virtio_blk_tasklet, blk);
+
+	uint32_t features = VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+	if ((virtio_dev_init(&blk->dev, pci, features) < 0) || (virtq_init(&blk->vq, &blk->dev, 0) < 0)
+	    || (virtio_blk_set_limits(blk) < 0)) {
+		log_printf("virtio_blk: init failed\n");
+		virtio_dev_failed(&blk->dev);
+		return;
+	}
+
+	uint32_t capacity_hi = virtio_config_read32(&blk->dev, VIRTIO_BLK_CFG_CAPACITY + 4);
+	blk->sector_count = capacity_hi ? 0xFFFFFFFF : virtio_config_read32(&blk->dev, VIRTIO_BLK_CFG_CAPACITY);
+	blk->read_only = (blk->dev.features & VIRTIO_BLK_F_RO) != 0;
+	virtio_dev_ready(&blk->dev);
+
+	int max_sectors = blk->seg_max / 2;
+	if (max_sectors > VIRTIO_BLK_XFER_MAX_SECTORS) {
+		max_sectors = VIRTIO_BLK_XFER_MAX_SECTORS;
+	}
+	blk_queue_init(&blk->queue, blk->name, SECTOR_SIZE, max_sectors, virtio_blk_request, blk);
+	blk_queue_set_depth(&blk->queue, blk->cmd_count);
+
+	if (virtio_irq_install(&blk->dev, exception_handler_virtio_blk, IRQ_MSI_VIRTIO_BLK) < 0) {
+		log_printf("virtio_blk: no irq, use polling\n");
+		virtio_blk_poll = 1;
+	}
+
+	virtio_blk_detect_part(blk);
+	for (int i = 1; i < DISK_PRIMARY_PART_CNT; i++) {
+		if (blk->part[i].total_sectors) {
+			blk_queue_add_part(&blk->queue, i, blk->part[i].start_sector, blk->part[i].total_sectors);
+		}
+	}
+	print_blk_info(blk);
+}
+
+void do_handler_virtio_blk(exception_frame_t *frame) {
+	if (virtio_irq_ack(&virtio_blk.dev)) {
+		tasklet_schedule(&virtio_blk.tasklet);
+	}
+	irq_send_eoi(virtio_blk.dev.irq.vector);
+}
+
+int virtio_blk_open(device_t *dev) {
+	int disk_id = (dev->minor >> 4) - 0xa;
+	int part_id = dev->minor & 0xF;
+
+	if ((disk_id != 0) || (part_id >= DISK_PRIMARY_PART_CNT)) {
+		log_printf("virtio_blk_open: invalid disk id or partition id\n");
+		return -1;
+	}
+
+	virtio_blk_part_t *part = virtio_blk.part + part_id;
+	if (part->total_sectors == 0) {
+		log_printf("virtio_blk_open: partition %s%d doesn't exist\n", virtio_blk.name, part_id);
+		return -1;
+	}
+
+	dev->data = part;
+	return 0;
+}
+
+int virtio_blk_read(device_t *dev, int addr, char *buf, int size) {
+	virtio_blk_part_t *part = (virtio_blk_part_t *) dev->data;
+	int sector_cnt = blk_rw(&part->blk->queue, 0, part->start_sector + addr, buf, size);
+	if (sector_cnt < size) {
+		log_printf("virtio_blk_read: disk(%s) read error: start sect %d, count %d", part->blk->name, addr, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int virtio_blk_write(device_t *dev, int addr, const char *buf, int size) {
+	virtio_blk_part_t *part = (virtio_blk_part_t *) dev->data;
+	int sector_cnt = blk_rw(&part->blk->queue, 1, part->start_sector + addr, (char *) buf, size);
+	if (sector_cnt < size) {
+		log_printf("virtio_blk_write: disk(%s) write error: start sect %d, count %d", part->blk->name, addr, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int virtio_blk_submit(device_t *dev, bio_t *bio) {
+	virtio_blk_part_t *part = (virtio_blk_part_t *) dev->data;
+	int sector_cnt = blk_submit_bio(&part->blk->queue, bio, part->start_sector);
+	if (sector_cnt < (int) (bio->size / SECTOR_SIZE)) {
+		log_printf("virtio_blk_submit: disk(%s) %s error: start sect %d, count %d", part->blk->name,
+		           bio->is_write ? "write" : "read", bio->sector, sector_cnt);
+	}
+	return sector_cnt;
+}
+
+int virtio_blk_control(device_t *dev, int cmd, int arg0, int arg1) {
+	return 0;
+}
+
+void virtio_blk_close(device_t *dev) {
+
+}
+
+dev_desc_t dev_virtio_blk_desc = {
+		.name = "virtio_blk",
+		.major = DEV_TYPE_VIRTIO_BLK,
+		.open = virtio_blk_open,
+		.read = virtio_blk_read,
+		.write = virtio_blk_write,
+		.control = virtio_blk_control,
+		.close = virtio_blk_close,
+		.submit = virtio_blk_submit,
+};
@@ -8,7 +8,12 @@ static devfs_type_t dev_type_list[] = {
 				.name = "tty",
 				.dev_type = DEV_TYPE_TTY,
 				.file_type = FILE_TYPE_TTY,
-		}
+		},
+		{
+				.name = "diskstats",
+				.dev_type = DEV_TYPE_DISKSTATS,
+				.file_type = FILE_TYPE_NORMAL,
+		},
 };
 
 int devfs_mount(struct _fs_t *fs, int major, int minor) {
@@ -48,7 +53,12 @@ int devfs_open(struct _fs_t *fs, const char *path, file_t *file) {
 }
 
 int devfs_read(void *buf, int len, file_t *file) {
-	return dev_read(file->dev_id, file->pos, buf, len);
+	// 终端不使用读取位置, 统计等文本设备按位置分段读取
+	int size = dev_read(file->dev_id, file->pos, buf, len);
+	if (size > 0) {
+		file->pos += size;
+	}
+	return size;
 }
 
 int devfs_write(char *buf, int len, file_t *file) {
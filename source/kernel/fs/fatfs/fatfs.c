@@ -250,8 +250,15 @@ static int expand_file(file_t *file, int inc_size) {
 }
 
 static int move_file_pos(file_t *file, fat_t *fat, int offset, int expand) {
-	uint32_t cur_offset = file->pos % fat->cluster_byte_size;
-	if (cur_offset + offset >= fat->cluster_byte_size) {
+	// 一次读写可能跨过多个簇, 逐簇前进
+	while (offset > 0) {
+		uint32_t cur_offset = file->pos % fat->cluster_byte_size;
+		uint32_t cur_move = fat->cluster_byte_size - cur_offset;
+		if (cur_move > offset) {
+			file->pos += offset;
+			break;
+		}
+
 		cluster_t next = cluster_get_next(fat, file->cblk);
 		if (next == FAT_CLUSTER_INVALID && expand) {
 			int err = expand_file(file, fat->cluster_byte_size);
@@ -262,12 +269,43 @@ static int move_file_pos(file_t *file, fat_t *fat, int offset, int expand) {
 			next = cluster_get_next(fat, file->cblk);
 		}
 		file->cblk = next;
+		file->pos += cur_move;
+		offset -= cur_move;
 	}
-
-	file->pos += offset;
 	return 0;
 }
 
+/**
+ * 从当前簇开始, 把在磁盘上相邻的若干整簇用一个 bio 直接在设备和 buf 之间传输, 不经过 fat_buffer
+ * 返回传输的字节数, 设备不支持 bio 或传输不完整时返回 -1, 由调用者逐簇处理
+ */
+static int move_clusters(fat_t *fat, file_t *file, char *buf, uint32_t nbytes, int is_write) {
+	uint32_t max_size = (BIO_VEC_NR - 1) * MEM_PAGE_SIZE;      // buf 不按页对齐时多占一段
+	uint32_t size = fat->cluster_byte_size;
+	cluster_t cluster = file->cblk;
+	while ((size + fat->cluster_byte_size <= nbytes) && (size + fat->cluster_byte_size <= max_size)) {
+		cluster_t next = cluster_get_next(fat, cluster);
+		if (next != cluster + 1) {
+			break;
+		}
+		cluster = next;
+		size += fat->cluster_byte_size;
+	}
+
+	bio_t bio;
+	bio_vec_t vec[BIO_VEC_NR];
+	bio_init(&bio, is_write, fat->data_start + (file->cblk - 2) * fat->sec_per_cluster, vec, BIO_VEC_NR);
+	if (bio_add_buf(&bio, buf, size) != (int) size) {
+		return -1;
+	}
+
+	int cnt = dev_submit(fat->fs->dev_id, &bio);
+	if (cnt != (int) (size / fat->bytes_per_sec)) {
+		return -1;
+	}
+	return size;
+}
+
 static int diritem_init(diritem_t *item, uint8_t attr, const char *name) {
 	to_sfn((char *) item->DIR_Name, name);
 	item->DIR_FstClusHI = (uint16_t) (FAT_CLUSTER_INVALID >> 16);
@@ -432,12 +470,16 @@ int fatfs_read(void *buf, int len, file_t *file) {
 		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
 		uint32_t start_sector = fat->data_start + (file->cblk - 2) * fat->sec_per_cluster;
 
-		if (cluster_offset == 0 && nbytes == fat->cluster_byte_size) {
-			int err = dev_read(fat->fs->dev_id, start_sector, (char *) buf, fat->sec_per_cluster);
-			if (err < 0) {
-				return total_read;
+		if (cluster_offset == 0 && nbytes >= fat->cluster_byte_size) {
+			int size = move_clusters(fat, file, (char *) buf, nbytes, 0);
+			if (size < 0) {
+				int err = dev_read(fat->fs->dev_id, start_sector, (char *) buf, fat->sec_per_cluster);
+				if (err < 0) {
+					return total_read;
+				}
+				size = fat->cluster_byte_size;
 			}
-			cur_read = fat->cluster_byte_size;
+			cur_read = size;
 		} else {
 			if (cluster_offset + cur_read > fat->cluster_byte_size) {
 				cur_read = fat->cluster_byte_size - cluster_offset;
@@ -480,12 +522,16 @@ int fatfs_write(char *buf, int len, file_t *file) {
 		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
 		uint32_t start_sector = fat->data_start + (file->cblk - 2) * fat->sec_per_cluster;
 
-		if (cluster_offset == 0 && nbytes == fat->cluster_byte_size) {
-			int err = dev_write(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
-			if (err < 0) {
-				return total_write;
+		if (cluster_offset == 0 && nbytes >= fat->cluster_byte_size) {
+			int size = move_clusters(fat, file, buf, nbytes, 1);
+			if (size < 0) {
+				int err = dev_write(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
+				if (err < 0) {
+					return total_write;
+				}
+				size = fat->cluster_byte_size;
 			}
-			cur_write = fat->cluster_byte_size;
+			cur_write = size;
 		} else {
 			if (cluster_offset + cur_write > fat->cluster_byte_size) {
 				cur_write = fat->cluster_byte_size - cluster_offset;
@@ -0,0 +1,144 @@
+/**
+ * 进程打开的文件表
+ * 文件表只由所属进程访问, 不需要加锁. 分配和回收文件表本身时才访问共享的池
+ */
+#include "fs/fdtable.h"
+#include "core/memory.h"
+#include "ipc/spinlock.h"
+#include "tools/klib.h"
+
+static fdtable_t fdtable_pool[FDTABLE_POOL_SIZE];
+static list_t free_list;
+static spinlock_t pool_lock = SPINLOCK_INIT("fdtable");
+
+void fdtable_pool_init(void) {
+	list_init(&free_list);
+	for (int i = 0; i < FDTABLE_POOL_SIZE; i++) {
+		list_push_back(&free_list, &fdtable_pool[i].node);
+	}
+}
+
+fdtable_t *fdtable_alloc(void) {
+	spin_lock(&pool_lock);
+	list_node_t *node = list_pop_front(&free_list);
+	spin_unlock(&pool_lock);
+	if (node == (list_node_t *) 0) {
+		return (fdtable_t *) 0;
+	}
+
+	fdtable_t *fdt = list_node_parent(node, fdtable_t, node);
+	kernel_memset(fdt, 0, sizeof(fdtable_t));
+	fdt->max_fds = FDTABLE_NR_DEFAULT;
+	fdt->fd = fdt->fd_array;
+	return fdt;
+}
+
+/**
+ * 回收文件表. 正常退出时文件已全部关闭, 创建进程失败时只需撤销复制时加的引用
+ */
+void fdtable_free(fdtable_t *fdt) {
+	for (int i = 0; i < fdt->max_fds; i++) {
+		if (fdt->fd[i] && (file_dec_ref(fdt->fd[i]) == 0)) {
+			file_free(fdt->fd[i]);
+		}
+	}
+
+	if (fdt->fd != fdt->fd_array) {
+		memory_free_page((uint32_t) fdt->fd);
+	}
+
+	spin_lock(&pool_lock);
+	list_push_back(&free_list, &fdt->node);
+	spin_unlock(&pool_lock);
+}
+
+/**
+ * 内嵌数组用完后换成一整页
+ */
+static int fdtable_expand(fdtable_t *fdt) {
+	if (fdt->max_fds >= FDTABLE_NR_MAX) {
+		return -1;
+	}
+
+	file_t **fd = (file_t **) memory_alloc_page();
+	if (fd == (file_t **) 0) {
+		return -1;
+	}
+
+	kernel_memset(fd, 0, MEM_PAGE_SIZE);
+	kernel_memcpy(fd, fdt->fd_array, sizeof(fdt->fd_array));
+	fdt->fd = fd;
+	fdt->max_fds = FDTABLE_NR_MAX;
+	return 0;
+}
+
+static void fd_set_used(fdtable_t *fdt, int fd) {
+	int word = fd / FDTABLE_WORD_BITS;
+	fdt->open_fds[word] |= 1u << (fd % FDTABLE_WORD_BITS);
+	if (fdt->open_fds[word] == 0xFFFFFFFF) {
+		fdt->full_words |= 1u << word;
+	}
+}
+
+static void fd_set_free(fdtable_t *fdt, int fd) {
+	int word = fd / FDTABLE_WORD_BITS;
+	fdt->open_fds[word] &= ~(1u << (fd % FDTABLE_WORD_BITS));
+	fdt->full_words &= ~(1u << word);
+}
+
+file_t *fdtable_get(fdtable_t *fdt, int fd) {
+	if (fd < 0 || fd >= fdt->max_fds) {
+		return (file_t *) 0;
+	}
+	return fdt->fd[fd];
+}
+
+/**
+ * 分配最小的空闲 fd: 先在一级位图中找到未满的字, 再在字内找空闲位
+ */
+int fdtable_alloc_fd(fdtable_t *fdt, file_t *file) {
+	uint32_t free_words = ~fdt->full_words;
+	if (free_words == 0) {
+		return -1;
+	}
+
+	int word = __builtin_ctz(free_words);
+	int fd = word * FDTABLE_WORD_BITS + __builtin_ctz(~fdt->open_fds[word]);
+	if ((fd >= fdt->max_fds) && (fdtable_expand(fdt) < 0)) {
+		return -1;
+	}
+
+	fdt->fd[fd] = file;
+	fd_set_used(fdt, fd);
+	return fd;
+}
+
+/**
+ * 在指定位置放入文件, 该位置须为空
+ */
+int fdtable_install(fdtable_t *fdt, int fd, file_t *file) {
+	if (fd < 0 || fd >= FDTABLE_NR_MAX) {
+		return -1;
+	}
+
+	if ((fd >= fdt->max_fds) && (fdtable_expand(fdt) < 0)) {
+		return -1;
+	}
+
+	if (fdt->fd[fd]) {
+		return -1;
+	}
+
+	fdt->fd[fd] = file;
+	fd_set_used(fdt, fd);
+	return fd;
+}
+
+void fdtable_free_fd(fdtable_t *fdt, int fd) {
+	if (fd < 0 || fd >= fdt->max_fds) {
+		return;
+	}
+
+	fdt->fd[fd] = (file_t *) 0;
+	fd_set_free(fdt, fd);
+}
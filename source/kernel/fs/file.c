@@ -1,39 +1,55 @@
+/**
+ * 系统打开文件表
+ * 空闲的文件对象挂在链表中, 分配和释放都是 O(1). 引用计数用原子操作维护, 不需要加锁
+ */
 #include "fs/file.h"
-#include "ipc/mutex.h"
+#include "ipc/spinlock.h"
 #include "tools/klib.h"
+#include "comm/cpu_instr.h"
 
 static file_t file_table[FILE_TABLE_SIZE];
-static mutex_t file_table_mutex;
+static list_t free_list;
+static spinlock_t free_lock = SPINLOCK_INIT("file");    // 只保护空闲链表
 
 file_t *file_alloc() {
-	mutex_lock(&file_table_mutex);
-	for (int i = 0; i < FILE_TABLE_SIZE; ++i) {
-		if (file_table[i].ref == 0) {
-			kernel_memset(&file_table[i], 0, sizeof(file_t));
-			file_table[i].ref = 1;
-			mutex_unlock(&file_table_mutex);
-			return file_table + i;
-		}
+	spin_lock(&free_lock);
+	list_node_t *node = list_pop_front(&free_list);
+	spin_unlock(&free_lock);
+	if (node == (list_node_t *) 0) {
+		return (file_t *) 0;
 	}
-	mutex_unlock(&file_table_mutex);
-	return (file_t *) 0;
+
+	file_t *file = list_node_parent(node, file_t, free_node);
+	kernel_memset(file, 0, sizeof(file_t));
+	file->ref = 1;
+	return file;
 }
 
+/**
+ * 归还文件对象, 调用者须确认已没有引用
+ */
 void file_free(file_t *file) {
-	mutex_lock(&file_table_mutex);
-	if (file->ref) {
-		--file->ref;
-	}
-	mutex_unlock(&file_table_mutex);
+	file->ref = 0;
+	spin_lock(&free_lock);
+	list_push_front(&free_list, &file->free_node);
+	spin_unlock(&free_lock);
 }
 
 void file_table_init() {
-	mutex_init(&file_table_mutex);
 	kernel_memset(file_table, 0, sizeof(file_table));
+	list_init(&free_list);
+	for (int i = 0; i < FILE_TABLE_SIZE; ++i) {
+		list_push_back(&free_list, &file_table[i].free_node);
+	}
 }
 
 void file_inc_ref(file_t *file) {
-	mutex_lock(&file_table_mutex);
-	++file->ref;
-	mutex_unlock(&file_table_mutex);
-}
\ No newline at end of file
+	atomic_xadd((volatile uint32_t *) &file->ref, 1);
+}
+
+/**
+ * 减少一次引用, 返回剩余的引用数. 为 0 时由调用者关闭并归还文件
+ */
+int file_dec_ref(file_t *file) {
+	return (int) atomic_xadd((volatile uint32_t *) &file->ref, (uint32_t) -1) - 1;
+}
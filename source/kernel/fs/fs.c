@@ -9,6 +9,8 @@
 #include "core/task.h"
 #include "fs/devfs/devfs.h"
 #include "dev/disk.h"
+#include "dev/ahci.h"
+#include "dev/virtio_blk.h"
 #include "os_cfg.h"
 #include <sys/file.h>
 
@@ -89,8 +91,11 @@ static void mount_list_init() {
 void fs_init() {
 	mount_list_init();
 	file_table_init();
+	fdtable_pool_init();
 
 	disk_init();
+	ahci_init();
+	virtio_blk_init();
 
 	fs_t *fs = mount(FS_TYPE_DEV, "/dev", 0, 0);
 	ASSERT(fs != (fs_t *) 0);
@@ -130,7 +135,7 @@ static void read_disk(uint32_t sector, uint32_t sector_count, uint8_t *buf) {
 #endif
 
 static int is_fd_bad(int fd) {
-	return fd < 0 || fd >= TASK_OFILE_NR;
+	return fd < 0 || fd >= FDTABLE_NR_MAX;
 }
 
 static int is_path_valid(const char *path) {
@@ -222,7 +227,7 @@ int sys_open(const char *path, int flags, ...) {
 	if (err < 0) {
 		fs_unprotect(fs);
 		// log_printf("sys_open: open %s failed.\n", path);
-		return -1;
+		goto sys_open_failed;
 	}
 	fs_unprotect(fs);
 
@@ -316,7 +321,7 @@ int sys_close(int fd) {
 
 	ASSERT(file->ref > 0);
 
-	if (file->ref-- == 1) {
+	if (file_dec_ref(file) == 0) {
 		fs_t *fs = file->fs;
 		fs_protect(fs);
 		fs->op->close(file);
@@ -0,0 +1,28 @@
+/**
+ * 进程凭证
+ * 凭证创建后不再修改, 父子进程共享同一份, 用引用计数回收
+ */
+#ifndef OS_CRED_H
+#define OS_CRED_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+#include "os_cfg.h"
+
+#define CRED_POOL_SIZE          32
+#define CRED_ROOT_ID            0
+
+typedef struct _cred_t {
+	int ref;
+	int uid, gid;               // 实际用户、组
+	int euid, egid;             // 有效用户、组, 用于权限检查
+	list_node_t node;           // 空闲链表结点
+} cred_t;
+
+void cred_init(void);
+cred_t *cred_root(void);
+cred_t *cred_alloc(int uid, int gid);
+cred_t *cred_get(cred_t *cred);
+void cred_put(cred_t *cred);
+
+#endif //OS_CRED_H
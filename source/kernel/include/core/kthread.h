@@ -0,0 +1,17 @@
+/**
+ * 内核线程: 运行在内核态、共享内核页表的后台任务
+ */
+#ifndef OS_KTHREAD_H
+#define OS_KTHREAD_H
+
+#include "core/task.h"
+
+typedef int (*kthread_fn_t)(void *arg);
+
+task_t *kthread_create(kthread_fn_t fn, void *arg, const char *name);
+task_t *kthread_create_on(kthread_fn_t fn, void *arg, const char *name, int cpu);
+void kthread_park(void);
+void kthread_wakeup(task_t *task);
+void kthread_exit(int status);
+
+#endif //OS_KTHREAD_H
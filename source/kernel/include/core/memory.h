@@ -7,12 +7,19 @@
 #include "tools/bitmap.h"
 #include "comm/boot_info.h"
 #include "ipc/mutex.h"
+#include "cpu/mmu.h"
 
 #define MEM_EBDA_START              0x00080000
+#define MEM_EBDA_END                0x000A0000
 #define MEM_EXT_START               (1024*1024)
 #define MEM_EXT_END                 (128*1024*1024 - 1)
 #define MEM_PAGE_SIZE               4096                    // 和页表大小一致
 
+#define MEM_BIOS_START              0x000E0000              // BIOS ROM 区, 用于查找 MP/ACPI 表
+#define MEM_BIOS_END                0x00100000
+#define MEM_MMIO_START              (0x7F000000)            // 设备寄存器映射窗口, 位于内核空间的顶部
+#define MEM_MMIO_END                (0x80000000)
+
 #define MEMORY_TASK_BASE            (0x80000000)            // 进程起始地址空间
 
 #define MEM_TASK_STACK_TOP            (0xE0000000)            // 任务栈顶
@@ -41,14 +48,20 @@ typedef struct _memory_map_t {
 } memory_map_t;
 
 void memory_init(boot_info_t *boot_info);
+pte_t *find_pte(pde_t *page_dir, uint32_t vaddr, int alloc);
+int memory_create_map(pde_t *page_dir, uint32_t vaddr, uint32_t paddr, int count, uint32_t perm);
 uint32_t memory_create_uvm(void);
+uint32_t memory_kernel_page_dir(void);
+uint32_t memory_map_mmio(uint32_t paddr, uint32_t size);
 int memory_alloc_page_for(uint32_t addr, uint32_t size, uint32_t perm);
 int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size, uint32_t perm);
 uint32_t memory_alloc_page();
+uint32_t memory_alloc_pages(int count);
 void memory_free_page(uint32_t addr);
-int memory_copy_uvm(uint32_t page_dir);
+uint32_t memory_copy_uvm(uint32_t page_dir);
 void memory_destroy_uvm(uint32_t page_dir);
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr);
+uint32_t memory_buf_paddr(uint32_t vaddr);
 int memory_copy_uvm_data(uint32_t to, uint32_t page_dir, uint32_t from, uint32_t size);
 
 char *sys_sbrk(int incr);
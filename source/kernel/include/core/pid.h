@@ -0,0 +1,22 @@
+/**
+ * 进程号分配与查找
+ */
+#ifndef OS_PID_H
+#define OS_PID_H
+
+#include "comm/types.h"
+#include "core/task.h"
+
+#define PID_MAX                     32768       // 进程号上限, 超过后回绕
+#define PID_FIRST                   1           // 第一个可分配的进程号, 0 保留
+#define PID_HASH_SIZE               256         // 哈希桶数量, 须为 2 的幂
+
+void pid_init(void);
+int pid_alloc(void);
+void pid_free(int pid);
+
+void pid_hash_add(task_t *task);
+void pid_hash_del(task_t *task);
+task_t *pid_find_task(int pid);
+
+#endif //OS_PID_H
@@ -0,0 +1,46 @@
+/**
+ * 公平调度类: 按加权虚拟运行时间排序就绪任务
+ */
+#ifndef OS_SCHED_H
+#define OS_SCHED_H
+
+#include "comm/types.h"
+#include "tools/rbtree.h"
+#include "ipc/spinlock.h"
+#include "os_cfg.h"
+
+#define SCHED_LATENCY_MS            60              // 调度周期: 所有就绪任务在该时间内至少运行一次
+#define SCHED_MIN_GRANULARITY_MS    OS_TICKS_MS     // 单次运行的最短时间
+#define SCHED_WAKEUP_GRANULARITY_US (OS_TICKS_MS * 1000)  // 虚拟时间领先超过该值才抢占当前任务
+#define SCHED_NICE_0_WEIGHT         1024            // nice 为 0 时的权重
+#define SCHED_NICE_MIN              (-20)
+#define SCHED_NICE_MAX              19
+
+struct _task_t;
+
+/**
+ * 就绪队列, 当前运行的任务同样留在树中
+ */
+typedef struct _sched_rq_t {
+	spinlock_t lock;            // 中断中也会访问, 须用 irqsave 方式加锁
+	rb_tree_t tree;             // 按 vruntime 排序的就绪任务
+	uint32_t min_vruntime;      // 队列中最小的虚拟运行时间, 单调递增 (微秒)
+	uint32_t load_weight;       // 队列中所有任务的权重之和
+} sched_rq_t;
+
+void sched_rq_init(sched_rq_t *rq);
+void sched_fair_enqueue(sched_rq_t *rq, struct _task_t *task);
+void sched_fair_dequeue(sched_rq_t *rq, struct _task_t *task);
+struct _task_t *sched_fair_pick_next(sched_rq_t *rq);
+void sched_fair_task_new(sched_rq_t *rq, struct _task_t *task);
+int sched_fair_task_tick(sched_rq_t *rq, struct _task_t *task);
+void sched_fair_yield(sched_rq_t *rq, struct _task_t *task);
+int sched_fair_wakeup_preempt(sched_rq_t *rq, struct _task_t *curr, struct _task_t *task);
+int sched_fair_slice(sched_rq_t *rq, struct _task_t *task);
+void sched_set_nice(struct _task_t *task, int nice);
+
+static inline int sched_rq_count(sched_rq_t *rq) {
+	return rb_count(&rq->tree);
+}
+
+#endif //OS_SCHED_H
@@ -0,0 +1,40 @@
+/**
+ * 中断下半部: 软中断和小任务
+ * 硬件中断只做应答设备、取走数据等必须立即完成的工作, 其余的登记为软中断,
+ * 在中断返回前或放开最后一把锁时开着中断执行, 过多时交给 ksoftirqd 线程
+ */
+#ifndef OS_SOFTIRQ_H
+#define OS_SOFTIRQ_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+
+// 软中断号, 越小越先执行
+#define SOFTIRQ_TIMER           0           // 全局时钟节拍: 睡眠及超时处理
+#define SOFTIRQ_TASKLET         1           // 小任务
+#define SOFTIRQ_NR              2
+
+#define SOFTIRQ_RESTART_MAX     10          // 一次最多处理的轮数, 超过后交给 ksoftirqd
+
+typedef void (*softirq_handler_t)(void);
+
+/**
+ * 小任务: 同一个小任务在执行前多次调度只执行一次
+ */
+typedef struct _tasklet_t {
+	list_node_t node;
+	void (*func)(void *data);
+	void *data;
+	volatile int scheduled;
+} tasklet_t;
+
+void softirq_init(void);
+void softirq_cpu_init(int cpu);
+void softirq_register(int nr, softirq_handler_t handler);
+void softirq_raise(int nr);
+void softirq_do_pending(void);
+
+void tasklet_init(tasklet_t *tasklet, void (*func)(void *data), void *data);
+void tasklet_schedule(tasklet_t *tasklet);
+
+#endif //OS_SOFTIRQ_H
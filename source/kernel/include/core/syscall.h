@@ -1,8 +1,6 @@
 #ifndef OS_SYSCALL_H
 #define OS_SYSCALL_H
 
-#include "comm/types.h"
-
 #define SYS_sleep               0
 #define SYS_getpid              1
 #define SYS_fork                2
@@ -10,6 +8,11 @@
 #define SYS_yield               4
 #define SYS_exit                5
 #define SYS_wait                6
+#define SYS_waitpid             7
+#define SYS_vfork               8
+#define SYS_spawn               9
+#define SYS_clock_gettime       10
+#define SYS_nanosleep           11
 
 #define SYS_open                50
 #define SYS_read                51
@@ -31,6 +34,27 @@
 
 #define SYSCALL_PARAM_COUNT     5
 
+// sysenter 返回前弹出通用寄存器后, 栈顶为 syscall_frame_t 的 eip, 之后依次为 cs、参数、esp
+#define SYSCALL_FRAME_EIP       0
+#define SYSCALL_FRAME_ESP       (4 * (2 + SYSCALL_PARAM_COUNT))
+#define SPAWN_FD_MAP_NR         3           // spawn 可指定的文件: 标准输入、输出、错误
+
+// 汇编文件也会用到上面的系统调用号
+#ifndef __ASSEMBLER__
+
+#include "comm/types.h"
+#include <time.h>
+
+// newlib 只在开启相应特性时定义这些时钟
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC             ((clockid_t) 4)
+#endif
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW         ((clockid_t) 5)
+#define CLOCK_MONOTONIC_COARSE      ((clockid_t) 6)
+#define CLOCK_BOOTTIME              ((clockid_t) 7)
+#endif
+
 typedef struct _syscall_frame_t {
 	uint32_t eflags;
 	uint32_t gs, fs, es, ds;
@@ -40,6 +64,12 @@ typedef struct _syscall_frame_t {
 	uint32_t esp, ss;
 } syscall_frame_t;
 
+_Static_assert(__builtin_offsetof(syscall_frame_t, esp) - __builtin_offsetof(syscall_frame_t, eip) == SYSCALL_FRAME_ESP,
+               "SYSCALL_FRAME_ESP doesn't match syscall_frame_t");
+
 void exception_handler_syscall();
+void exception_handler_sysenter();
+
+#endif //__ASSEMBLER__
 
 #endif //OS_SYSCALL_H
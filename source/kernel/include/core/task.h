@@ -5,11 +5,15 @@
 #include "cpu/cpu.h"
 #include "tools/list.h"
 #include "fs/file.h"
+#include "fs/fdtable.h"
+#include "core/cred.h"
+#include "core/sched.h"
+#include "ipc/spinlock.h"
+#include "ipc/wait.h"
 
 #define TASK_NAME_SIZE              32
-#define TASK_TIME_SLICE_DEFAULT     10
-#define TASK_OFILE_NR               128
 #define TASK_FLAG_SYSTEM            (1 << 0)
+#define TASK_FLAG_IDLE              (1 << 1)
 
 typedef struct _task_args_t {
 	uint32_t return_addr;
@@ -18,6 +22,7 @@ typedef struct _task_args_t {
 } task_args_t;
 
 typedef struct _task_t {
+	// 调度器频繁访问的字段集中放在前面, 让调度时只涉及开头少数几个缓存行
 	// uint32_t *stack;
 	enum {
 		TASK_CREATED,
@@ -25,32 +30,58 @@ typedef struct _task_t {
 		TASK_SLEEP,
 		TASK_READY,
 		TASK_WAITTING,
-		TASK_ZOMBIE
+		TASK_ZOMBIE,
+		TASK_PARKED
 	} state;
 
+	int flags;
+	int cpu;                    // 所在就绪队列对应的 CPU
+	int on_rq;                  // 是否在就绪队列中
+	int slice_ticks;            // 本次被调度后剩余的时钟节拍
+	uint32_t vruntime;          // 加权后的虚拟运行时间 (微秒)
+	uint32_t weight;            // 调度权重, 由 nice 值决定
+	rb_node_t sched_node;       // 就绪队列结点
+	int tss_selector;
+	int sleep_ticks;
+	list_node_t run_node;
+
+	struct _wait_queue_t *wait_queue;   // 正在等待的队列
+	int wait_flags;
+	int wait_result;            // 等待结束的原因: WAIT_OK 或 WAIT_TIMEOUT
+	int wait_ticks;             // 限时等待剩余的时钟节拍
+	list_node_t wait_node;
+	list_node_t timeout_node;   // 限时等待时挂在超时队列中
+
+	// 以下字段只在创建、退出及系统调用中访问
 	int pid;
 	struct _task_t *parent;
+	fdtable_t *files;           // 打开的文件, 内核任务没有
+	cred_t *cred;               // 凭证, 与父进程共享
 	uint32_t heap_start;
 	uint32_t heap_end;
-
-	int sleep_ticks;
-	int time_ticks;
-	int slice_ticks;
 	int status;
+	int wakeup_pending;         // 内核线程在休眠前已收到唤醒
 
-	file_t *file_table[TASK_OFILE_NR];
-	char name[TASK_NAME_SIZE];
-	list_node_t run_node;
-	list_node_t wait_node;
 	list_node_t all_node;
+	list_node_t pid_node;       // 进程号哈希表结点
+	list_t child_list;          // 仍在运行的子进程
+	list_t zombie_list;         // 已退出、等待回收的子进程
+	list_node_t child_node;     // 挂在父进程 child_list 或 zombie_list 中的结点
+	struct _task_t *vfork_parent;   // vfork 出的子进程借用该进程的地址空间, execve 或退出时归还
+	wait_queue_t vfork_wait;    // vfork 时父进程在此等待子进程归还地址空间
+	char name[TASK_NAME_SIZE];
 	tss_t tss;
-	int tss_selector;
 } task_t;
 
-int task_init(task_t *task, const char *name, int flag, uint32_t entry, uint32_t esp);
+int task_init(task_t *task, const char *name, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir);
 void task_switch_from_to(task_t *from, task_t *to);
 // 定义在汇编文件中
 void simple_switch(uint32_t *from, uint32_t *to);
+void task_start(task_t *task);
+void task_start_on(task_t *task, int cpu);
+void task_uninit(task_t *task);
+task_t *alloc_task();
+void free_task(task_t *task);
 
 file_t *task_file(int fd);
 int task_alloc_fd(file_t *file);
@@ -58,35 +89,41 @@ void task_free_fd(int fd);
 
 // 任务管理器
 typedef struct _task_manager_t {
-	task_t *current;        // 当前任务
-	list_t ready_list;      // 就绪任务
+	spinlock_t lock;        // 保护 task_list 及各任务的父子关系
 	list_t task_list;       // 所有任务
+	spinlock_t sleep_lock;  // 保护 sleep_list, 时钟软中断中使用
 	list_t sleep_list;      // 睡眠任务
 	task_t first_task;       // 初始化任务
-	task_t idle_task;       // 空闲任务
-
-	int app_code_selector;
-	int app_data_selector;
+	task_t idle_task;       // BSP 的空闲任务
+	list_t free_list;       // task_table 中的空闲任务
 } task_manager_t;
 
 void task_manager_init();
 void first_task_init();
 task_t *task_first_task();
+task_t *task_create_idle(int cpu);
 void task_set_ready(task_t *task);
 void task_set_block(task_t *task);
+void task_wakeup(task_t *task);
+void task_add_child(task_t *parent, task_t *child);
 task_t *task_current();
 int sys_yield();
 void sys_exit(int status);
 int sys_wait(int *status);
+int sys_waitpid(int pid, int *status, int options);
 
 void task_dispatch();
+void task_sleep_tick();
 void task_time_tick();
 
 void task_set_sleep(task_t *task, uint32_t ticks);
 void task_set_wakeup(task_t *task);
+void task_sleep_ticks(uint32_t ticks);
 void sys_sleep(uint32_t ms);
 int sys_getpid();
 int sys_fork();
+int sys_vfork();
+int sys_spawn(char *name, char **argv, int *fd_map);
 int sys_execve(char *name, char **argv, char **env);
 
 #endif //OS_TASK_H
@@ -0,0 +1,56 @@
+/**
+ * 映射到每个进程中的共享页
+ * 内核负责更新数据, 应用直接读取或调用其中的代码, 不必陷入内核
+ * 本文件同时供应用使用, 不要包含内核专用的头文件
+ */
+#ifndef OS_VDSO_H
+#define OS_VDSO_H
+
+#include "comm/types.h"
+
+#define VDSO_BASE               0xF0000000          // 独占一个页目录项, 复制和销毁地址空间时单独处理
+#define VDSO_DATA_ADDR          (VDSO_BASE)         // 全局数据页, 所有进程共享
+#define VDSO_TASK_ADDR          (VDSO_BASE + 0x1000)    // 进程私有数据页
+#define VDSO_TEXT_ADDR          (VDSO_BASE + 0x2000)    // 代码页
+
+// 代码页中的入口, 运行时从数据页中查找
+#define VDSO_FN_getpid          0
+#define VDSO_FN_ticks           1
+#define VDSO_FN_clock           2
+#define VDSO_FN_NR              3
+
+/**
+ * 全局数据, 时钟中断中更新
+ * seq 为奇数时表示正在更新, 读取前后 seq 不一致时须重读
+ */
+typedef struct _vdso_data_t {
+	volatile uint32_t seq;
+	volatile uint32_t ticks;            // 启动以来的时钟节拍数
+	volatile uint32_t clock_sec;        // 最近一个节拍时启动以来的时间
+	volatile uint32_t clock_nsec;
+	volatile uint32_t tsc_lo;           // 该节拍时的 TSC, 用于推算节拍之间的时间
+	volatile uint32_t tsc_hi;
+	volatile uint32_t tsc_khz;          // TSC 频率, 为 0 时时间只精确到节拍
+	uint32_t entry[VDSO_FN_NR];         // 各函数在进程中的地址
+} vdso_data_t;
+
+/**
+ * 进程私有数据
+ * vfork 的子进程与父进程共用该页, 子进程运行期间父进程挂起, 由内核切换其中的内容
+ */
+typedef struct _vdso_task_t {
+	volatile int pid;
+} vdso_task_t;
+
+typedef int (*vdso_getpid_t)(void);
+typedef uint32_t (*vdso_ticks_t)(void);
+typedef void (*vdso_clock_t)(uint32_t *sec, uint32_t *nsec);
+
+void vdso_init(void);
+int vdso_map(uint32_t page_dir);
+void vdso_unmap(uint32_t page_dir);
+void vdso_set_pid(uint32_t page_dir, int pid);
+void vdso_set_tsc(uint32_t khz);
+void vdso_time_tick(uint32_t ticks, uint64_t ns, uint64_t tsc);
+
+#endif //OS_VDSO_H
@@ -32,6 +32,13 @@
 #define GATE_DPL0               (0 << 13)           // 特权级0，最高特权级
 #define GATE_DPL3               (3 << 13)           // 特权级3，最低权限
 
+#define MSR_SYSENTER_CS         0x174               // sysenter 进入的代码段, 栈段为其后一项
+#define MSR_SYSENTER_ESP        0x175               // sysenter 进入时的栈
+#define MSR_SYSENTER_EIP        0x176               // sysenter 进入的地址
+
+#define CPUID_FEAT_EDX_TSC      (1 << 4)            // 支持 rdtsc
+#define CPUID_FEAT_EDX_SEP      (1 << 11)           // 支持 sysenter/sysexit
+
 #define EFLAGS_IF               (1 << 9)
 #define EFLAGS_DEFAULT          (1 << 1)
 
@@ -73,12 +80,15 @@ typedef struct _tss_t {
 #pragma pack()
 
 void cpu_init(void);
+void cpu_ap_init(void);
 void segment_desc_set(int selector, uint32_t base, uint32_t limit, uint16_t attr);
 void gate_desc_set(gate_desc_t *desc, uint16_t selector, uint32_t offset, uint16_t attr);
 int gdt_alloc_desc(void);
 void gdt_free_sel(int sel);
 
 void switch_to_tss(uint32_t tss_selector);
+void cpu_sysenter_init(void);
+void cpu_set_sysenter_stack(uint32_t esp0);
 
 #endif
 
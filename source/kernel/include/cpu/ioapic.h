@@ -0,0 +1,28 @@
+/**
+ * IOAPIC: 将外部中断按重定向表投递给各 CPU 的本地 APIC
+ * 参考资料: Intel 82093AA I/O APIC 手册, https://wiki.osdev.org/IOAPIC
+ */
+#ifndef OS_IOAPIC_H
+#define OS_IOAPIC_H
+
+#include "comm/types.h"
+
+// 寄存器通过索引 + 数据窗口间接访问
+#define IOAPIC_REGSEL               0x00
+#define IOAPIC_WIN                  0x10
+
+#define IOAPIC_REG_ID               0x00
+#define IOAPIC_REG_VER              0x01
+#define IOAPIC_REG_REDTBL           0x10            // 每个引脚占两个寄存器
+
+// 重定向表项低 32 位
+#define IOAPIC_RED_ACTIVE_LOW       (1 << 13)
+#define IOAPIC_RED_LEVEL            (1 << 15)
+#define IOAPIC_RED_MASKED           (1 << 16)
+
+int ioapic_init(uint32_t paddr, uint32_t gsi_base);
+void ioapic_route(uint32_t gsi, int vector, uint32_t flags, int apic_id);
+void ioapic_mask(uint32_t gsi);
+void ioapic_unmask(uint32_t gsi);
+
+#endif //OS_IOAPIC_H
@@ -5,6 +5,7 @@
 #define OS_IRQ_H
 
 #include "comm/types.h"
+#include "cpu/mp.h"
 
 // 中断号码
 #define IRQ0_DE             0
@@ -30,6 +31,7 @@
 #define IRQ0_TIMER                  0x20
 #define IRQ1_KEYBOARD               0x21
 #define IRQ14_HARDDISK_PRIMARY		0x2E		// 主总线上的ATA磁盘中断
+#define IRQ15_HARDDISK_SECONDARY	0x2F		// 从总线上的ATA磁盘中断
 
 #define ERR_PAGE_P          (1 << 0)        // 存在
 #define ERR_PAGE_WR         (1 << 1)        // 可写
@@ -54,6 +56,7 @@ typedef struct _exception_frame_t {
 typedef void(*irq_handler_t)(void);
 
 void irq_init(void);
+void irq_ap_init(void);
 int irq_install(int irq_num, irq_handler_t handler);
 
 void exception_handler_unknown(void);
@@ -98,16 +101,37 @@ void exception_handler_virtual_exception(void);
 
 #define PIC_OCW2_EOI         (1 << 5)        // 1 - 非特殊结束中断EOI命令
 
+// IMCR: 部分主板开机时将外部中断直接接到 BSP, 须切换后才能由 IOAPIC 投递
+#define IMCR_ADDR_PORT       0x22
+#define IMCR_DATA_PORT       0x23
+#define IMCR_SELECT          0x70
+#define IMCR_APIC_MODE       0x01
+
 #define IRQ_PIC_START        0x20            // PIC中断起始号
 
+// APIC 模式下外部中断按优先级重新分配向量: 高 4 位为优先级, 低 4 位为 ISA 中断号
+#define IRQ_APIC_PRIO_TIMER  0xD
+#define IRQ_APIC_PRIO_DISK   0x6
+#define IRQ_APIC_PRIO_INPUT  0x5
+#define IRQ_APIC_PRIO_OTHER  0x4
+
+// PCI 设备的 MSI 向量, 优先级与磁盘中断相同, 不与 ISA 中断的向量重叠
+#define IRQ_MSI_AHCI         0x60
+#define IRQ_MSI_VIRTIO_BLK   0x61
+
 void irq_enable(int irq_num);
 void irq_disable(int irq_num);
 void irq_disable_global(void);
 void irq_enable_global(void);
 
 void pic_send_eoi(int irq);
+void irq_send_eoi(int irq);
+int irq_apic_init(mp_info_t *info);
+int irq_apic_enabled(void);
 
 typedef uint32_t irq_state_t;
+void irq_exit(exception_frame_t *frame);
+
 irq_state_t irq_enter_protection();
 void irq_leave_protection(irq_state_t state);
 
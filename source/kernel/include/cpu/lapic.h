@@ -0,0 +1,59 @@
+/**
+ * 本地 APIC
+ * 参考资料: Intel SDM Vol.3 第 10 章, https://wiki.osdev.org/APIC
+ */
+#ifndef OS_LAPIC_H
+#define OS_LAPIC_H
+
+#include "comm/types.h"
+
+#define LAPIC_DEFAULT_BASE          0xFEE00000
+
+// 寄存器偏移
+#define LAPIC_ID                    0x020
+#define LAPIC_VER                   0x030
+#define LAPIC_TPR                   0x080
+#define LAPIC_EOI                   0x0B0
+#define LAPIC_SVR                   0x0F0
+#define LAPIC_ESR                   0x280
+#define LAPIC_ICR_LO                0x300
+#define LAPIC_ICR_HI                0x310
+#define LAPIC_LVT_TIMER             0x320
+#define LAPIC_LVT_LINT0             0x350
+#define LAPIC_LVT_LINT1             0x360
+#define LAPIC_LVT_ERROR             0x370
+#define LAPIC_TIMER_INIT            0x380
+#define LAPIC_TIMER_CURR            0x390
+#define LAPIC_TIMER_DIV             0x3E0
+
+#define LAPIC_SVR_ENABLE            (1 << 8)
+#define LAPIC_LVT_MASKED            (1 << 16)
+#define LAPIC_LVT_PERIODIC          (1 << 17)
+#define LAPIC_TIMER_DIV_16          0x3
+#define LAPIC_TIMER_CALIBRATE_MS    10              // 校准定时器时测量的时长
+
+// ICR 各位配置
+#define LAPIC_ICR_INIT              (5 << 8)
+#define LAPIC_ICR_STARTUP           (6 << 8)
+#define LAPIC_ICR_DELIVS            (1 << 12)        // 发送中
+#define LAPIC_ICR_ASSERT            (1 << 14)
+#define LAPIC_ICR_LEVEL             (1 << 15)
+
+#define IRQ_LAPIC_TIMER             0xE0             // 本地定时器, 优先级高于所有外部中断
+#define IRQ_LAPIC_RESCHED           0xE1             // 处理器间中断: 通知目标 CPU 重新调度
+#define IRQ_LAPIC_SPURIOUS          0xFF             // 伪中断向量, 不需要 EOI
+
+void lapic_init(uint32_t paddr);
+void lapic_enable(void);
+int lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_init(int apic_id);
+void lapic_send_startup(int apic_id, uint32_t entry);
+void lapic_send_ipi(int apic_id, int vector);
+int lapic_timer_calibrate(void);
+int lapic_timer_start(void);
+void exception_handler_lapic_timer(void);
+void exception_handler_lapic_resched(void);
+void exception_handler_lapic_spurious(void);
+
+#endif //OS_LAPIC_H
@@ -15,6 +15,8 @@
 #define PDE_W               (1 << 1)
 #define PTE_U               (1 << 2)
 #define PDE_U               (1 << 2)
+#define PTE_PWT             (1 << 3)
+#define PTE_PCD             (1 << 4)
 
 #pragma pack(1)
 /**
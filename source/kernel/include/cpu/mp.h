@@ -0,0 +1,180 @@
+/**
+ * 多处理器配置信息: 解析 ACPI MADT 表, 找不到时退回 MP 规范表
+ * 参考资料: https://wiki.osdev.org/MADT, Intel MultiProcessor Specification 1.4
+ */
+#ifndef OS_MP_H
+#define OS_MP_H
+
+#include "comm/types.h"
+#include "os_cfg.h"
+
+#pragma pack(1)
+
+/**
+ * ACPI 根系统描述指针
+ */
+typedef struct _acpi_rsdp_t {
+	char signature[8];          // "RSD PTR "
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_addr;
+} acpi_rsdp_t;
+
+/**
+ * ACPI 各表的公共表头
+ */
+typedef struct _acpi_sdt_header_t {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+typedef struct _acpi_madt_t {
+	acpi_sdt_header_t header;   // "APIC"
+	uint32_t lapic_addr;
+	uint32_t flags;
+} acpi_madt_t;
+
+typedef struct _madt_entry_t {
+	uint8_t type;
+	uint8_t length;
+} madt_entry_t;
+
+#define MADT_TYPE_LAPIC             0
+#define MADT_TYPE_IOAPIC            1
+#define MADT_TYPE_OVERRIDE          2
+#define MADT_LAPIC_ENABLED          (1 << 0)
+
+typedef struct _madt_lapic_t {
+	madt_entry_t entry;
+	uint8_t acpi_id;
+	uint8_t apic_id;
+	uint32_t flags;
+} madt_lapic_t;
+
+typedef struct _madt_ioapic_t {
+	madt_entry_t entry;
+	uint8_t ioapic_id;
+	uint8_t reserved;
+	uint32_t addr;
+	uint32_t gsi_base;
+} madt_ioapic_t;
+
+/**
+ * ISA 中断与 IOAPIC 输入引脚的对应关系, 未列出的按相同编号直连
+ */
+typedef struct _madt_override_t {
+	madt_entry_t entry;
+	uint8_t bus;                // 总是 0, 即 ISA
+	uint8_t source;             // ISA 中断号
+	uint32_t gsi;               // 全局中断号
+	uint16_t flags;             // 极性及触发方式, 同 MP_INTR_*
+} madt_override_t;
+
+/**
+ * MP 规范浮动指针结构
+ */
+typedef struct _mp_float_t {
+	char signature[4];          // "_MP_"
+	uint32_t config_addr;
+	uint8_t length;             // 以 16 字节为单位
+	uint8_t spec_rev;
+	uint8_t checksum;
+	uint8_t features[5];
+} mp_float_t;
+
+/**
+ * MP 规范配置表表头
+ */
+typedef struct _mp_config_t {
+	char signature[4];          // "PCMP"
+	uint16_t length;
+	uint8_t version;
+	uint8_t checksum;
+	char oem_id[8];
+	char product_id[12];
+	uint32_t oem_table;
+	uint16_t oem_table_size;
+	uint16_t entry_count;
+	uint32_t lapic_addr;
+	uint16_t ext_length;
+	uint8_t ext_checksum;
+	uint8_t reserved;
+} mp_config_t;
+
+#define MP_ENTRY_PROCESSOR          0
+#define MP_ENTRY_BUS                1
+#define MP_ENTRY_IOAPIC             2
+#define MP_ENTRY_IOINTR             3
+#define MP_PROC_ENABLED             (1 << 0)
+#define MP_FEATURE_IMCR             (1 << 7)        // features[1]: 存在 IMCR, 开机时处于 PIC 模式
+
+// 中断的极性及触发方式, MADT 与 MP 表的编码相同
+#define MP_INTR_POLARITY_MASK       (3 << 0)
+#define MP_INTR_POLARITY_LOW        (3 << 0)
+#define MP_INTR_TRIGGER_MASK        (3 << 2)
+#define MP_INTR_TRIGGER_LEVEL       (3 << 2)
+
+#define ISA_IRQ_NR                  16
+
+typedef struct _mp_proc_t {
+	uint8_t type;
+	uint8_t apic_id;
+	uint8_t apic_version;
+	uint8_t flags;
+	uint32_t signature;
+	uint32_t features;
+	uint8_t reserved[8];
+} mp_proc_t;
+
+typedef struct _mp_ioapic_t {
+	uint8_t type;
+	uint8_t ioapic_id;
+	uint8_t version;
+	uint8_t flags;
+	uint32_t addr;
+} mp_ioapic_t;
+
+typedef struct _mp_bus_t {
+	uint8_t type;
+	uint8_t bus_id;
+	char bus_type[6];           // "ISA   ", "PCI   " 等
+} mp_bus_t;
+
+typedef struct _mp_iointr_t {
+	uint8_t type;
+	uint8_t intr_type;          // 0 为普通中断
+	uint16_t flags;
+	uint8_t src_bus;
+	uint8_t src_irq;
+	uint8_t dst_ioapic;
+	uint8_t dst_pin;
+} mp_iointr_t;
+
+#pragma pack()
+
+/**
+ * 解析得到的多处理器配置
+ */
+typedef struct _mp_info_t {
+	int cpu_count;
+	uint8_t apic_id[SMP_CPU_MAX];
+	uint32_t lapic_addr;
+	int ioapic_id;
+	uint32_t ioapic_addr;
+	uint32_t ioapic_gsi_base;   // IOAPIC 第一个引脚对应的全局中断号
+	uint32_t isa_gsi[ISA_IRQ_NR];       // 各 ISA 中断对应的全局中断号
+	uint16_t isa_flags[ISA_IRQ_NR];     // 各 ISA 中断的极性及触发方式
+	int imcr;                   // 需要通过 IMCR 切换到 APIC 模式
+} mp_info_t;
+
+int mp_init(mp_info_t *info);
+
+#endif //OS_MP_H
@@ -0,0 +1,38 @@
+/**
+ * 多处理器支持: 每个 CPU 拥有自己的当前任务、空闲任务和就绪队列
+ */
+#ifndef OS_SMP_H
+#define OS_SMP_H
+
+#include "comm/types.h"
+#include "core/sched.h"
+#include "tools/list.h"
+#include "os_cfg.h"
+
+struct _task_t;
+
+typedef struct _cpu_t {
+	int id;                         // 逻辑编号, BSP 为 0
+	int apic_id;                    // 本地 APIC ID
+	volatile int started;           // 是否已完成启动
+	volatile int online;            // 是否参与调度: 已启动且本地时钟可用
+	volatile uint32_t ipi_count;    // 已响应的调度处理器间中断次数
+	struct _task_t *current;        // 当前运行的任务
+	struct _task_t *idle_task;      // 空闲任务
+	sched_rq_t rq;                  // 就绪队列
+	int preempt_count;              // 大于 0 时禁止抢占, 持有自旋锁时递增
+	int need_resched;               // 禁止抢占期间有调度请求, 恢复后补做
+	uint32_t softirq_pending;       // 待执行的软中断, 每位对应一个软中断号
+	list_t tasklet_list;            // 待执行的小任务
+	struct _task_t *ksoftirqd;      // 执行积压软中断的线程, 固定在本 CPU 上
+} cpu_t;
+
+void smp_init(void);
+int smp_cpu_count(void);
+cpu_t *cpu_this(void);
+cpu_t *cpu_get(int id);
+void smp_bind_tss(int tss_selector, int cpu_id);
+void smp_send_resched(cpu_t *cpu);
+void smp_sync(cpu_t *cpu);
+
+#endif //OS_SMP_H
@@ -0,0 +1,172 @@
+/**
+ * AHCI SATA 控制器
+ * 每个端口有 32 个命令槽, 支持 NCQ 的磁盘可以同时执行多条读写命令, 完成顺序由磁盘决定
+ * 参考资料: Serial ATA AHCI 1.3.1 规范, https://wiki.osdev.org/AHCI
+ */
+#ifndef OS_AHCI_H
+#define OS_AHCI_H
+
+#include "comm/types.h"
+#include "dev/blk.h"
+#include "dev/disk.h"
+#include "dev/pci.h"
+#include "core/softirq.h"
+
+#define AHCI_ABAR                   5           // 寄存器位于 PCI BAR5
+#define AHCI_PORT_MAX               32
+#define AHCI_DISK_MAX               4           // 最多使用的端口数
+#define AHCI_SLOT_MAX               32          // 每个端口的命令槽数量
+#define AHCI_PRDT_NR                248         // 每条命令的描述符数量, 使命令表正好占一页
+#define AHCI_PRD_MAX_SIZE           (4 * 1024 * 1024)   // 一个描述符最多 4MB
+#define AHCI_XFER_MAX_SECTORS       124         // 一条命令最多传输的扇区数, 每个扇区最多占两项描述符
+#define AHCI_SPIN_MAX               1000000     // 查询寄存器的最多次数
+
+// HBA 寄存器
+#define AHCI_CAP                    0x00
+#define AHCI_GHC                    0x04
+#define AHCI_IS                     0x08
+#define AHCI_PI                     0x0C
+
+#define AHCI_CAP_NCS(cap)           ((((cap) >> 8) & 0x1F) + 1)    // 命令槽数量
+#define AHCI_CAP_SNCQ               (1 << 30)                      // 支持 NCQ
+
+#define AHCI_GHC_IE                 (1 << 1)
+#define AHCI_GHC_AE                 (1 << 31)
+
+// 端口寄存器
+#define AHCI_PORT_BASE              0x100
+#define AHCI_PORT_SIZE              0x80
+#define AHCI_PxCLB                  0x00
+#define AHCI_PxCLBU                 0x04
+#define AHCI_PxFB                   0x08
+#define AHCI_PxFBU                  0x0C
+#define AHCI_PxIS                   0x10
+#define AHCI_PxIE                   0x14
+#define AHCI_PxCMD                  0x18
+#define AHCI_PxTFD                  0x20
+#define AHCI_PxSIG                  0x24
+#define AHCI_PxSSTS                 0x28
+#define AHCI_PxSERR                 0x30
+#define AHCI_PxSACT                 0x34
+#define AHCI_PxCI                   0x38
+
+#define AHCI_PxCMD_ST               (1 << 0)
+#define AHCI_PxCMD_FRE              (1 << 4)
+#define AHCI_PxCMD_FR               (1 << 14)
+#define AHCI_PxCMD_CR               (1 << 15)
+
+#define AHCI_PxIS_DHRS              (1 << 0)    // 收到寄存器 FIS, 非 NCQ 命令完成
+#define AHCI_PxIS_SDBS              (1 << 3)    // 收到 Set Device Bits FIS, NCQ 命令完成
+#define AHCI_PxIS_TFES              (1 << 30)   // 磁盘报告错误
+#define AHCI_PxIE_DEFAULT           (AHCI_PxIS_DHRS | AHCI_PxIS_SDBS | AHCI_PxIS_TFES)
+
+#define AHCI_PxTFD_ERR              (1 << 0)
+#define AHCI_PxTFD_DRQ              (1 << 3)
+#define AHCI_PxTFD_BSY              (1 << 7)
+
+#define AHCI_SSTS_DET_PRESENT       0x3         // 检测到磁盘且已建立通信
+#define AHCI_SIG_ATA                0x00000101
+
+// 命令头
+#define AHCI_CMD_CFL(fis_size)      ((fis_size) / 4)
+#define AHCI_CMD_WRITE              (1 << 6)
+
+// ATA 命令
+#define FIS_TYPE_REG_H2D            0x27
+#define FIS_H2D_CMD                 (1 << 7)
+#define ATA_DEVICE_LBA              (1 << 6)
+#define ATA_CMD_IDENTIFY            0xEC
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_READ_FPDMA          0x60        // NCQ 读
+#define ATA_CMD_WRITE_FPDMA         0x61        // NCQ 写
+
+#define ATA_IDENT_QUEUE_DEPTH       75          // 低 5 位为队列深度减 1
+#define ATA_IDENT_SATA_CAPS         76
+#define ATA_IDENT_SATA_NCQ          (1 << 8)
+#define ATA_IDENT_LBA48_SECTORS     100
+
+#pragma pack(1)
+
+typedef struct _ahci_cmd_header_t {
+	uint16_t flags;                 // FIS 长度、读写方向等
+	uint16_t prdtl;                 // 描述符数量
+	volatile uint32_t prdbc;        // 已传输的字节数
+	uint32_t ctba;                  // 命令表物理地址, 128 字节对齐
+	uint32_t ctbau;
+	uint32_t reserved[4];
+} ahci_cmd_header_t;
+
+typedef struct _ahci_prd_t {
+	uint32_t dba;                   // 数据物理地址, 2 字节对齐
+	uint32_t dbau;
+	uint32_t reserved;
+	uint32_t dbc;                   // 字节数减 1
+} ahci_prd_t;
+
+typedef struct _fis_reg_h2d_t {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t command;
+	uint8_t feature_lo;
+	uint8_t lba0;
+	uint8_t lba1;
+	uint8_t lba2;
+	uint8_t device;
+	uint8_t lba3;
+	uint8_t lba4;
+	uint8_t lba5;
+	uint8_t feature_hi;
+	uint8_t count_lo;
+	uint8_t count_hi;
+	uint8_t icc;
+	uint8_t control;
+	uint8_t reserved[4];
+} fis_reg_h2d_t;
+
+typedef struct _ahci_cmd_table_t {
+	uint8_t cfis[64];
+	uint8_t acmd[16];
+	uint8_t reserved[48];
+	ahci_prd_t prdt[AHCI_PRDT_NR];
+} ahci_cmd_table_t;
+
+#pragma pack()
+
+struct _ahci_port_t;
+
+typedef struct _ahci_part_t {
+	struct _ahci_port_t *port;
+	uint32_t start_sector;
+	uint32_t total_sectors;
+} ahci_part_t;
+
+typedef struct _ahci_port_t {
+	char name[DISK_NAME_SIZE];
+	int index;                      // 端口号
+	volatile uint32_t *regs;
+
+	ahci_cmd_header_t *cmd_list;
+	uint8_t *fis;                   // 接收磁盘发来的 FIS
+	ahci_cmd_table_t *cmd_table[AHCI_SLOT_MAX];
+	int slot_count;
+	int ncq;                        // NCQ 队列深度, 0 表示不使用 NCQ
+
+	uint32_t sector_size;
+	uint32_t sector_count;
+	ahci_part_t part[DISK_PRIMARY_PART_CNT];
+
+	spinlock_t lock;                // 保护以下字段
+	uint32_t reserved;              // 已分配的命令槽, 含正在准备、尚未发出的
+	uint32_t issued;                // 已写入 CI 未完成的命令槽
+	uint32_t irq_status;            // 中断中读到的端口状态, 由小任务处理
+	blk_request_t *slot_req[AHCI_SLOT_MAX];
+
+	blk_queue_t queue;
+	tasklet_t tasklet;
+} ahci_port_t;
+
+void ahci_init(void);
+void exception_handler_ahci();
+
+#endif //OS_AHCI_H
@@ -0,0 +1,46 @@
+/**
+ * 块设备读写描述
+ * 一次读写的扇区范围, 以及对应的一组内存段. 每段物理连续, 各段之间不要求连续,
+ * 驱动可以用一条命令把数据直接传到分散的页中, 不必先经过连续的内核缓冲区
+ */
+#ifndef OS_BIO_H
+#define OS_BIO_H
+
+#include "comm/types.h"
+
+#define BIO_VEC_NR                  32          // 栈上临时 bio 的段数
+
+typedef struct _bio_vec_t {
+	uint32_t page;                  // 起始物理页, 低于 128MB 的物理内存在内核中一一映射, 可以直接访问
+	uint32_t offset;                // 在起始页中的偏移
+	uint32_t len;
+} bio_vec_t;
+
+typedef struct _bio_t {
+	int is_write;
+	uint32_t sector;                // 设备或分区内的起始扇区
+	uint32_t size;                  // 各段的总字节数
+	bio_vec_t *vec;
+	int vcnt;
+	int vec_max;
+} bio_t;
+
+/**
+ * 按顺序取出 bio 中一段字节范围对应的物理地址
+ */
+typedef struct _bio_iter_t {
+	bio_t *bio;
+	int idx;                        // 当前段
+	uint32_t offset;                // 在当前段中的偏移
+	uint32_t left;                  // 范围内剩余的字节数
+} bio_iter_t;
+
+void bio_init(bio_t *bio, int is_write, uint32_t sector, bio_vec_t *vec, int vec_max);
+int bio_add_page(bio_t *bio, uint32_t page, uint32_t offset, uint32_t len);
+int bio_add_buf(bio_t *bio, void *buf, uint32_t size);
+
+void bio_iter_init(bio_iter_t *iter, bio_t *bio, uint32_t start, uint32_t size);
+uint32_t bio_iter_next(bio_iter_t *iter, uint32_t *paddr, uint32_t max);
+void bio_iter_copy(bio_iter_t *iter, void *buf, uint32_t size, int to_bio);
+
+#endif //OS_BIO_H
@@ -0,0 +1,110 @@
+/**
+ * 块设备请求队列
+ * 请求先进入队列, 相邻扇区的请求合并成一组, 由队列线程按电梯顺序交给驱动执行,
+ * 完成后通过回调通知提交者. 队列对整个磁盘及各分区记录读写统计和延迟分布
+ */
+#ifndef OS_BLK_H
+#define OS_BLK_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+#include "ipc/spinlock.h"
+#include "core/task.h"
+#include "dev/bio.h"
+
+#define BLK_QUEUE_NR                8           // 最多注册的队列数量
+#define BLK_READ_EXPIRE_MS          500         // 读请求最长等待时间, 超时后优先处理
+#define BLK_WRITE_EXPIRE_MS         5000        // 写请求最长等待时间
+#define BLK_BIO_REQ_NR              4           // 拆分 bio 时一次提交的请求数
+#define BLK_PART_NR                 4           // 每个队列记录统计的分区数, 与 MBR 主分区对应
+#define BLK_NAME_SIZE               16
+#define BLK_LAT_HIST_NR             24          // 延迟直方图的桶数, 第 i 个为 [2^i, 2^(i+1)) 微秒, 首尾两个桶包含以外的部分
+
+struct _blk_queue_t;
+
+/**
+ * 读写统计, 下标 0 为读, 1 为写
+ */
+typedef struct _blk_stats_t {
+	uint32_t ios[2];                // 完成的请求数
+	uint32_t merges[2];             // 合并进已有组的请求数
+	uint32_t sectors[2];            // 成功传输的扇区数
+	uint64_t ticks[2];              // 各请求从提交到完成的时间总和, 纳秒
+	int in_flight;                  // 已提交尚未完成的请求数
+	uint64_t io_ticks;              // 有请求未完成的总时间
+	uint64_t time_in_queue;         // in_flight 对时间的积分, 除以 io_ticks 为平均队列深度
+	uint64_t stamp;                 // 上次更新以上两项的时间
+	uint32_t lat_hist[2][BLK_LAT_HIST_NR];
+} blk_stats_t;
+
+typedef struct _blk_part_t {
+	char name[BLK_NAME_SIZE];
+	uint32_t start_sector;
+	uint32_t total_sectors;         // 为 0 表示分区不存在
+	blk_stats_t stats;
+} blk_part_t;
+
+typedef struct _blk_request_t {
+	list_node_t node;               // 在排序队列中, 或在组首的合并链中
+	list_node_t fifo_node;          // 在提交顺序队列中, 只有组首使用
+	list_t merged;                  // 合并进来的请求, 按扇区排列, 只有组首使用
+	int sectors;                    // 整组的扇区数, 只有组首使用
+
+	int is_write;
+	uint32_t sector;                // 设备上的起始扇区
+	int count;                      // 扇区数
+	bio_t *bio;                     // 数据所在的内存段
+	uint32_t bio_offset;            // 数据在 bio 中的起始字节
+	uint64_t expire;                // 超时时间, 纳秒
+	int done;                       // 成功传输的扇区数
+	uint64_t start;                 // 提交时间, 纳秒
+	blk_part_t *part;               // 所在分区, 用于统计
+
+	void (*complete)(struct _blk_request_t *req);
+	void *data;
+} blk_request_t;
+
+/**
+ * 驱动开始执行一组请求, 完成后调用 blk_end_request, 可以在中断下半部中调用
+ * 队列线程创建之前请求同步执行, 驱动须在返回前完成
+ */
+typedef void (*blk_transfer_t)(struct _blk_queue_t *queue, blk_request_t *req);
+
+typedef struct _blk_queue_t {
+	const char *name;
+	spinlock_t lock;
+	list_t sort_list;               // 按起始扇区排序
+	list_t fifo_list;               // 按超时时间排序
+	uint32_t head_pos;              // 上一组结束的扇区, 下一组从这里向上扫描
+
+	uint32_t sector_size;
+	int max_sectors;                // 一组最多的扇区数
+	int depth;                      // 驱动能同时执行的组数
+	int inflight;                   // 已交给驱动尚未完成的组数
+	blk_transfer_t transfer;
+	void *data;                     // 驱动私有数据
+
+	task_t *thread;                 // 任务管理器初始化之前为空, 此时请求同步执行
+
+	blk_stats_t stats;              // 整个磁盘的统计, 与分区统计一起由 lock 保护
+	blk_part_t part[BLK_PART_NR];
+} blk_queue_t;
+
+void blk_init(void);
+void blk_queue_init(blk_queue_t *queue, const char *name, uint32_t sector_size, int max_sectors,
+                    blk_transfer_t transfer, void *data);
+
+void blk_request_init(blk_request_t *req, bio_t *bio, uint32_t bio_offset, uint32_t sector, int count,
+                      void (*complete)(blk_request_t *req), void *data);
+blk_request_t *blk_request_next(blk_request_t *req, blk_request_t *part);
+void blk_end_request(blk_queue_t *queue, blk_request_t *req, int done);
+void blk_queue_set_depth(blk_queue_t *queue, int depth);
+void blk_queue_add_part(blk_queue_t *queue, int index, uint32_t start_sector, uint32_t total_sectors);
+blk_queue_t *blk_queue_get(int index);
+int blk_queue_stats(blk_queue_t *queue, int part, blk_stats_t *stats);
+
+void blk_submit(blk_queue_t *queue, blk_request_t *req);
+int blk_submit_bio(blk_queue_t *queue, bio_t *bio, uint32_t base_sector);
+int blk_rw(blk_queue_t *queue, int is_write, uint32_t sector, char *buf, int count);
+
+#endif //OS_BLK_H
@@ -1,12 +1,18 @@
 #ifndef OS_DEV_H
 #define OS_DEV_H
 
+#include "dev/bio.h"
+
 #define DEV_NAME_SIZE 32
 
 enum {
 	DEV_TYPE_UNKNOWN = 0,
 	DEV_TYPE_TTY,
 	DEV_TYPE_DISK,
+	DEV_TYPE_AHCI,
+	DEV_TYPE_VIRTIO_BLK,
+	DEV_TYPE_RAMDISK,
+	DEV_TYPE_DISKSTATS,
 };
 
 struct _dev_desc_t;
@@ -26,11 +32,14 @@ typedef struct _dev_desc_t {
 	int (*write)(device_t *dev, int addr, const char *buf, int size);
 	int (*control)(device_t *dev, int cmd, int arg0, int arg1);
 	void (*close)(device_t *dev);
+	int (*submit)(device_t *dev, bio_t *bio);      // 块设备按 bio 读写, 返回成功传输的扇区数
 } dev_desc_t;
 
+void dev_init(void);
 int dev_open(int major, int minor, void *data);
 int dev_read(int dev_id, int addr, char *buf, int size);
 int dev_write(int dev_id, int addr, char *buf, int size);
+int dev_submit(int dev_id, bio_t *bio);
 int dev_control(int dev_id, int cmd, int arg0, int arg1);
 void dev_close(int dev_id);
 
@@ -3,17 +3,30 @@
 
 #include "comm/types.h"
 #include "ipc/mutex.h"
-#include "ipc/sem.h"
+#include "ipc/wait.h"
+#include "dev/blk.h"
 
 #define PART_NAME_SIZE              32      // 分区名称
 #define DISK_NAME_SIZE              32      // 磁盘名称大小
-#define DISK_CNT                    2       // 磁盘的数量
+#define DISK_CNT                    4       // 磁盘的数量
+#define DISK_CHANNEL_CNT            2       // 通道数量
 #define DISK_PRIMARY_PART_CNT       (4 + 1) // 主分区数量最多 4 个
 #define DISK_PER_CHANNEL            2       // 每个通道最多 2 个磁盘
+#define DISK_IRQ_TIMEOUT_MS         1000    // 等待磁盘中断的最长时间
+#define DISK_SPIN_MAX               1000000 // 查询总线主控状态的最多次数
+#define DISK_XFER_MAX_SECTORS       256     // 一条命令最多传输的扇区数
+#define DISK_MULTIPLE_MAX           16      // READ/WRITE MULTIPLE 每个数据块最多的扇区数
+#define DISK_POLL_MAX_SECTORS       8       // 不超过该扇区数的传输查询状态, 不等待中断
+#define DISK_PIO_BENCH_SECTORS      256     // PIO 测试读取的扇区数
+
+// 已知数据端口支持 32 位访问的 IDE 控制器
+#define PCI_VENDOR_INTEL            0x8086
+#define PCI_DEVICE_PIIX3_IDE        0x7010
+#define PCI_DEVICE_PIIX4_IDE        0x7111
 
 // https://wiki.osdev.org/ATA_PIO_Mode#IDENTIFY_command
-// 只考虑支持主总结primary bus
 #define IOBASE_PRIMARY              0x1F0
+#define IOBASE_SECONDARY            0x170
 #define	DISK_DATA(disk)				(disk->port_base + 0)		// 数据寄存器
 #define	DISK_ERROR(disk)			(disk->port_base + 1)		// 错误寄存器
 #define	DISK_SECTOR_COUNT(disk)		(disk->port_base + 2)		// 扇区数量寄存器
@@ -23,11 +36,17 @@
 #define	DISK_DRIVE(disk)			(disk->port_base + 6)		// 磁盘或磁头？
 #define	DISK_STATUS(disk)			(disk->port_base + 7)		// 状态寄存器
 #define	DISK_CMD(disk)				(disk->port_base + 7)		// 命令寄存器
+#define	DISK_ALT_STATUS(disk)		(disk->port_base + 0x206)	// 备用状态寄存器, 读取时不清除中断
 
 // ATA命令
 #define	DISK_CMD_IDENTIFY	        0xEC	    // IDENTIFY命令
 #define	DISK_CMD_READ				0x24	    // 读命令
 #define	DISK_CMD_WRITE				0x34	    // 写命令
+#define	DISK_CMD_READ_DMA			0x25	    // DMA 读命令
+#define	DISK_CMD_WRITE_DMA			0x35	    // DMA 写命令
+#define	DISK_CMD_READ_MULTIPLE		0x29	    // 每个中断读一个数据块
+#define	DISK_CMD_WRITE_MULTIPLE		0x39	    // 每个中断写一个数据块
+#define	DISK_CMD_SET_MULTIPLE		0xC6	    // 设置数据块的扇区数
 
 // 状态寄存器
 #define DISK_STATUS_ERR             (1 << 0)    // 发生了错误
@@ -37,6 +56,30 @@
 
 #define	DISK_DRIVE_BASE		        0xE0		// 驱动器号基础值:0xA0 + LBA
 
+// IDENTIFY 返回的能力字
+#define DISK_IDENT_MULTIPLE_MAX     47          // 低 8 位为数据块最多的扇区数
+#define DISK_IDENT_CAPS             49
+#define DISK_IDENT_CAPS_DMA         (1 << 8)
+
+// 总线主控 IDE, 寄存器位于 PCI BAR4, 每个通道 8 个端口
+// https://wiki.osdev.org/ATA/ATAPI_using_DMA
+#define DISK_BM_BAR                 4
+#define DISK_BM_CHANNEL_SIZE        8
+#define	DISK_BM_CMD(disk)			(disk->bm_base + 0)			// 命令寄存器
+#define	DISK_BM_STATUS(disk)		(disk->bm_base + 2)			// 状态寄存器
+#define	DISK_BM_PRDT(disk)			(disk->bm_base + 4)			// 描述符表物理地址
+
+#define DISK_BM_CMD_START           (1 << 0)    // 开始传输
+#define DISK_BM_CMD_READ            (1 << 3)    // 方向: 从磁盘写入内存
+
+#define DISK_BM_STATUS_ACTIVE       (1 << 0)    // 正在传输
+#define DISK_BM_STATUS_ERR          (1 << 1)    // 传输出错, 写 1 清除
+#define DISK_BM_STATUS_IRQ          (1 << 2)    // 磁盘已发出中断, 写 1 清除
+
+#define DISK_PRD_NR                 512         // 描述符表占一页
+#define DISK_PRD_EOT                (1 << 15)   // 最后一项
+#define DISK_PRD_BOUNDARY           0x10000     // 每一项不能跨越 64KB 边界
+
 #pragma pack(1)
 
 typedef struct _part_item_t {
@@ -60,10 +103,34 @@ typedef struct _mbr_t {
 	uint8_t boot_sign[2];                       // 引导标志
 } mbr_t;
 
+/**
+ * 物理区域描述符, 描述一段物理连续的内存, 大小为 0 表示 64KB
+ */
+typedef struct _prd_t {
+	uint32_t paddr;
+	uint16_t size;
+	uint16_t flags;
+} prd_t;
+
 #pragma pack()
 
 struct _disk_t;
 
+/**
+ * ATA 通道, 通道上的主从两个磁盘共用寄存器和中断, 同一时刻只能有一个在传输
+ */
+typedef struct _disk_channel_t {
+	uint16_t port_base;
+	uint16_t bm_base;           // 总线主控寄存器, 为 0 时只能使用 PIO
+	prd_t *prd_table;
+	int irq;
+	void (*handler)(void);
+
+	mutex_t mutex;              // 传输期间持有
+	wait_queue_t op_wait;       // 等待磁盘中断
+	int op_done;                // 磁盘中断已到达, 由 op_wait 的锁保护
+} disk_channel_t;
+
 typedef struct _partinfo_t {
 	char name[PART_NAME_SIZE];
 	struct _disk_t *disk;
@@ -87,16 +154,21 @@ typedef struct _disk_t {
 	} drive;
 
 	uint16_t port_base;
+	uint16_t bm_base;           // 取自所在通道, 磁盘不支持 DMA 时为 0
+	prd_t *prd_table;
 	uint32_t sector_size;
 	uint32_t sector_count;
+	int multiple;               // PIO 每个数据块的扇区数, 为 1 时使用普通读写命令
+	int pio32;                  // 数据端口支持 32 位访问
 	partinfo_t partinfo[DISK_PRIMARY_PART_CNT];
 
-	mutex_t *mutex;
-	sem_t *op_sem;
+	disk_channel_t *channel;
+	blk_queue_t queue;
 } disk_t;
 
 void disk_init();
 
 void exception_handler_ide_primary();
+void exception_handler_ide_secondary();
 
 #endif //OS_DISK_H
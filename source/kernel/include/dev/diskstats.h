@@ -0,0 +1,14 @@
+/**
+ * 磁盘读写统计, 通过 /dev/diskstats 读取
+ * 每个磁盘及分区一行, 各列与 Linux 的 /proc/diskstats 相同, 但没有主次设备号:
+ *   名称 读次数 读合并 读扇区 读耗时 写次数 写合并 写扇区 写耗时 未完成请求 有请求的时间 加权等待时间
+ * 时间以毫秒为单位. 之后是各磁盘读写延迟的对数分布, 每项为 "桶下限(微秒):请求数", 只列出非空的桶
+ */
+#ifndef OS_DISKSTATS_H
+#define OS_DISKSTATS_H
+
+#include "comm/types.h"
+
+#define DISKSTATS_LINE_SIZE         256
+
+#endif //OS_DISKSTATS_H
@@ -10,6 +10,8 @@
 #define KEYBOARD_STATUS_RECV_READY   0x01
 #define KEYBOARD_STATUS_SEND_FULL    0x02
 
+#define KEYBOARD_SCAN_BUF_SIZE       32         // 等待解码的扫描码, 须为 2 的幂
+
 // https://wiki.osdev.org/PS/2_Keyboard
 #define KBD_CMD_RW_LED            0xED        // 写按键
 
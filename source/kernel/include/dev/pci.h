@@ -0,0 +1,112 @@
+/**
+ * PCI 总线
+ * 通过 0xCF8/0xCFC 端口访问配置空间, 启动时扫描一遍总线并记录找到的设备
+ * 参考资料: https://wiki.osdev.org/PCI
+ */
+#ifndef OS_PCI_H
+#define OS_PCI_H
+
+#include "comm/types.h"
+#include "cpu/irq.h"
+
+#define PCI_CONFIG_ADDR             0xCF8
+#define PCI_CONFIG_DATA             0xCFC
+#define PCI_CONFIG_ENABLE           (1 << 31)
+
+#define PCI_BUS_NR                  256
+#define PCI_SLOT_NR                 32
+#define PCI_FUNC_NR                 8
+#define PCI_DEV_MAX                 32          // 最多记录的设备数量
+#define PCI_IRQ_MAX                 8           // 最多登记的设备中断数量
+#define PCI_BAR_NR                  6
+
+// 配置空间寄存器
+#define PCI_VENDOR_ID               0x00
+#define PCI_DEVICE_ID               0x02
+#define PCI_COMMAND                 0x04
+#define PCI_STATUS                  0x06
+#define PCI_CLASS_REV               0x08        // 版本号、编程接口、子类、类别
+#define PCI_HEADER_TYPE             0x0E
+#define PCI_BAR0                    0x10
+#define PCI_CAP_PTR                 0x34
+#define PCI_INTERRUPT_LINE          0x3C
+
+#define PCI_VENDOR_NONE             0xFFFF      // 设备不存在
+#define PCI_HEADER_MULTI_FUNC       (1 << 7)
+
+#define PCI_COMMAND_IO              (1 << 0)
+#define PCI_COMMAND_MEMORY          (1 << 1)
+#define PCI_COMMAND_MASTER          (1 << 2)    // 允许设备作为总线主控发起 DMA
+#define PCI_COMMAND_INTX_DISABLE    (1 << 10)   // 禁止传统的 INTx 中断
+
+#define PCI_STATUS_CAP_LIST         (1 << 4)    // 有扩展能力链表
+
+// MSI: 设备向本地 APIC 的地址写入向量号来发出中断, 不经过 IOAPIC
+#define PCI_CAP_ID_MSI              0x05
+#define PCI_MSI_CTRL_ENABLE         (1 << 0)
+#define PCI_MSI_CTRL_64BIT          (1 << 7)
+#define PCI_MSI_ADDR_BASE           0xFEE00000
+
+// MSI-X: 地址和数据放在设备内存中的表里, 每个向量一项
+#define PCI_CAP_ID_MSIX             0x11
+#define PCI_MSIX_CTRL_MASK          (1 << 14)   // 屏蔽所有向量
+#define PCI_MSIX_CTRL_ENABLE        (1 << 15)
+#define PCI_MSIX_BIR_MASK           0x7         // 表所在的基址寄存器
+#define PCI_MSIX_ENTRY_SIZE         16
+#define PCI_MSIX_ENTRY_ADDR_LO      0
+#define PCI_MSIX_ENTRY_ADDR_HI      1
+#define PCI_MSIX_ENTRY_DATA         2
+#define PCI_MSIX_ENTRY_CTRL         3           // 最低位为屏蔽位
+
+#define PCI_BAR_IO                  (1 << 0)
+#define PCI_BAR_IO_MASK             (~0x3)
+#define PCI_BAR_MEM_MASK            (~0xF)
+
+// 设备类别
+#define PCI_CLASS_STORAGE           0x01
+#define PCI_SUBCLASS_IDE            0x01
+#define PCI_IDE_PROG_MASTER         (1 << 7)    // 支持总线主控 DMA
+#define PCI_SUBCLASS_SATA           0x06
+#define PCI_SATA_PROG_AHCI          0x01
+
+/**
+ * 设备中断: 开始时使用 INTx, 切换到 APIC 模式后, 设备支持 MSI 或 MSI-X 时改用消息中断
+ * 驱动可在安装前设置 msi_setup, 改用消息中断后调用, 用于设置设备自己的向量寄存器
+ */
+typedef struct _pci_irq_t {
+	struct _pci_dev_t *dev;
+	irq_handler_t handler;
+	int msi_vector;             // 使用 MSI 时的向量号
+	int vector;                 // 当前使用的向量号, 用于发送 EOI
+	int msix;                   // 正在使用 MSI-X 的第 0 项
+	void (*msi_setup)(struct _pci_irq_t *irq);
+	void *data;
+} pci_irq_t;
+
+typedef struct _pci_dev_t {
+	uint8_t bus;
+	uint8_t slot;
+	uint8_t func;
+	uint16_t vendor;
+	uint16_t device;
+	uint8_t class_code;
+	uint8_t subclass;
+	uint8_t prog_if;
+	uint8_t irq;                // BIOS 分配的 ISA 中断号
+	uint32_t bar[PCI_BAR_NR];
+} pci_dev_t;
+
+void pci_init(void);
+pci_dev_t *pci_find_class(int class_code, int subclass, pci_dev_t *from);
+pci_dev_t *pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *from);
+
+uint32_t pci_read_config(pci_dev_t *dev, int reg);
+void pci_write_config(pci_dev_t *dev, int reg, uint32_t value);
+uint32_t pci_bar_addr(pci_dev_t *dev, int bar);
+void pci_enable(pci_dev_t *dev, uint32_t command);
+int pci_find_cap(pci_dev_t *dev, int cap_id);
+
+int pci_irq_install(pci_irq_t *irq, pci_dev_t *dev, irq_handler_t handler, int msi_vector);
+void pci_irq_apic_init(void);
+
+#endif //OS_PCI_H
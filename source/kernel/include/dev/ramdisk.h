@@ -0,0 +1,29 @@
+/**
+ * 内存盘
+ * 用一段物理连续的内存模拟磁盘, 读写直接复制内存, 不经过请求队列
+ */
+#ifndef OS_RAMDISK_H
+#define OS_RAMDISK_H
+
+#include "comm/types.h"
+#include "comm/boot_info.h"
+#include "dev/disk.h"
+
+struct _ramdisk_t;
+
+typedef struct _ramdisk_part_t {
+	struct _ramdisk_t *disk;
+	uint32_t start_sector;
+	uint32_t total_sectors;
+} ramdisk_part_t;
+
+typedef struct _ramdisk_t {
+	char name[DISK_NAME_SIZE];
+	uint8_t *start;
+	uint32_t sector_count;
+	ramdisk_part_t part[DISK_PRIMARY_PART_CNT];
+} ramdisk_t;
+
+void ramdisk_init(boot_info_t *boot_info);
+
+#endif //OS_RAMDISK_H
@@ -9,18 +9,37 @@
 #include "comm/cpu_instr.h"
 #include "os_cfg.h"
 #include "core/task.h"
+#include "core/syscall.h"
 
 #define PIT_OSC_FREQ                1193182                // 定时器时钟
+#define TSC_CALIBRATE_MS            50                     // 校准 TSC 时测量的时长
+
+#define NSEC_PER_SEC                1000000000
+#define NSEC_PER_MSEC               1000000
+#define NSEC_PER_USEC               1000
 
 // 定时器的寄存器和各项位配置
 #define PIT_CHANNEL0_DATA_PORT       0x40
+#define PIT_CHANNEL2_DATA_PORT       0x42
 #define PIT_COMMAND_MODE_PORT        0x43
+#define PIT_CHANNEL2_GATE_PORT       0x61           // bit0: 通道2门控, bit1: 扬声器, bit5: 通道2输出
 
 #define PIT_CHANNLE0                (0 << 6)
+#define PIT_CHANNLE2                (2 << 6)
 #define PIT_LOAD_LOHI               (3 << 4)
+#define PIT_MODE0                   (0 << 1)
 #define PIT_MODE3                   (3 << 1)
 
+#define PIT_GATE_ENABLE             (1 << 0)
+#define PIT_SPEAKER_ENABLE          (1 << 1)
+#define PIT_CHANNEL2_OUT            (1 << 5)
+
 void time_init(void);
+void time_udelay(uint32_t us);
+void time_lapic_init(void);
+uint64_t time_ns(void);
+int sys_clock_gettime(clockid_t clock_id, struct timespec *ts);
+int sys_nanosleep(const struct timespec *req, struct timespec *rem);
 void exception_handler_timer(void);
 
 #endif //OS_TIMER_H
@@ -2,6 +2,7 @@
 #define OS_TTY_H
 
 #include "ipc/sem.h"
+#include "ipc/wait.h"
 #include "dev.h"
 
 #define TTY_NR                       8          // 最大支持的tty设备数量
@@ -11,6 +12,7 @@
 #define TTY_CMD_ECHO				 1          // 回显
 
 typedef struct _tty_fifo_t {
+	spinlock_t lock;            // 键盘中断中写入, 须用 irqsave 方式加锁
 	char *buf;
 	int size;                // 最大字节数
 	int read, write;        // 当前读写位置
@@ -30,7 +32,7 @@ typedef struct _tty_t {
 	int oflags;                        // 输出标志
 	char ibuf[TTY_IBUF_SIZE];
 	tty_fifo_t ififo;                // 输入处理后的队列
-	sem_t isem;                        // 输入信号量
+	wait_queue_t iwait;                // 等待输入
 	int iflags;                        // 输入标志
 	int console;                    // 控制台
 } tty_t;
@@ -0,0 +1,123 @@
+/**
+ * virtio 设备: 传统 PCI 接口及分离式虚拟队列
+ * 驱动把描述符链的头放入可用环并通知设备, 设备处理完后把链头放入已用环并发出中断
+ * 参考资料: Virtual I/O Device (VIRTIO) Version 1.0, 4.1.4.8 Legacy Interfaces; https://wiki.osdev.org/Virtio
+ */
+#ifndef OS_VIRTIO_H
+#define OS_VIRTIO_H
+
+#include "comm/types.h"
+#include "dev/pci.h"
+
+#define VIRTIO_VENDOR_ID            0x1AF4
+#define VIRTIO_DEV_ID_BLK           0x1001      // 过渡设备, 同时支持传统接口
+
+// 传统接口的寄存器, 位于 IO 空间的 BAR0
+#define VIRTIO_PCI_HOST_FEATURES    0x00
+#define VIRTIO_PCI_GUEST_FEATURES   0x04
+#define VIRTIO_PCI_QUEUE_PFN        0x08        // 队列的物理页号
+#define VIRTIO_PCI_QUEUE_NUM        0x0C        // 队列大小, 由设备决定
+#define VIRTIO_PCI_QUEUE_SEL        0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY     0x10
+#define VIRTIO_PCI_STATUS           0x12
+#define VIRTIO_PCI_ISR              0x13        // 读取后清零
+#define VIRTIO_MSI_CONFIG_VECTOR    0x14        // 以下两项只在启用 MSI-X 后存在
+#define VIRTIO_MSI_QUEUE_VECTOR     0x16
+#define VIRTIO_PCI_CONFIG(msix)     ((msix) ? 0x18 : 0x14)     // 设备配置的位置随 MSI-X 变化
+#define VIRTIO_MSI_NO_VECTOR        0xFFFF
+
+#define VIRTIO_PCI_QUEUE_ALIGN      4096
+#define VIRTIO_PCI_ISR_QUEUE        (1 << 0)
+
+#define VIRTIO_STATUS_ACK           (1 << 0)
+#define VIRTIO_STATUS_DRIVER        (1 << 1)
+#define VIRTIO_STATUS_DRIVER_OK     (1 << 2)
+#define VIRTIO_STATUS_FAILED        (1 << 7)
+
+#define VIRTIO_RING_F_INDIRECT_DESC (1 << 28)   // 描述符可以指向另一张描述符表
+#define VIRTIO_RING_F_EVENT_IDX     (1 << 29)   // 用环中的索引抑制通知和中断
+
+#define VIRTQ_SIZE_MAX              1024
+
+#define VRING_DESC_F_NEXT           (1 << 0)
+#define VRING_DESC_F_WRITE          (1 << 1)    // 设备写入该缓冲区
+#define VRING_DESC_F_INDIRECT       (1 << 2)
+#define VRING_AVAIL_F_NO_INTERRUPT  (1 << 0)
+#define VRING_USED_F_NO_NOTIFY      (1 << 0)
+
+#pragma pack(1)
+
+typedef struct _vring_desc_t {
+	uint64_t addr;                  // 物理地址
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} vring_desc_t;
+
+typedef struct _vring_avail_t {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];                // 之后是 used_event
+} vring_avail_t;
+
+typedef struct _vring_used_elem_t {
+	uint32_t id;                    // 链头的描述符号
+	uint32_t len;                   // 设备写入的字节数
+} vring_used_elem_t;
+
+typedef struct _vring_used_t {
+	uint16_t flags;
+	uint16_t idx;
+	vring_used_elem_t ring[];       // 之后是 avail_event
+} vring_used_t;
+
+#pragma pack()
+
+struct _virtio_dev_t;
+
+/**
+ * 虚拟队列, 调用者负责加锁
+ */
+typedef struct _virtq_t {
+	struct _virtio_dev_t *dev;
+	int index;
+	uint16_t size;
+	int indirect;                   // 多个缓冲区放在间接描述符表中, 只占用一个描述符
+	int event_idx;
+
+	vring_desc_t *desc;
+	vring_avail_t *avail;
+	vring_used_t *used;
+
+	uint16_t free_head;             // 空闲描述符通过 next 串成链表
+	int free_count;
+	uint16_t avail_idx;             // 下一个放入可用环的位置
+	uint16_t kicked_idx;            // 上次通知设备时的 avail_idx
+	uint16_t last_used;             // 下一个要处理的已用环位置
+	void *token[VIRTQ_SIZE_MAX];    // 每条链的提交者数据, 以链头为下标
+} virtq_t;
+
+typedef struct _virtio_dev_t {
+	pci_dev_t *pci;
+	uint16_t io_base;
+	uint32_t features;              // 协商后的特性
+	virtq_t *queue[1];              // 目前的设备只用一个队列
+	int queue_count;
+	pci_irq_t irq;
+} virtio_dev_t;
+
+int virtio_dev_init(virtio_dev_t *dev, pci_dev_t *pci, uint32_t features);
+void virtio_dev_ready(virtio_dev_t *dev);
+void virtio_dev_failed(virtio_dev_t *dev);
+uint32_t virtio_config_read32(virtio_dev_t *dev, int offset);
+int virtio_irq_install(virtio_dev_t *dev, irq_handler_t handler, int msi_vector);
+int virtio_irq_ack(virtio_dev_t *dev);
+
+int virtq_init(virtq_t *vq, virtio_dev_t *dev, int index);
+int virtq_add(virtq_t *vq, vring_desc_t *table, int count, void *token);
+void virtq_kick(virtq_t *vq);
+void *virtq_get_used(virtq_t *vq, uint32_t *len);
+void virtq_disable_cb(virtq_t *vq);
+int virtq_enable_cb(virtq_t *vq);
+
+#endif //OS_VIRTIO_H
@@ -0,0 +1,78 @@
+/**
+ * virtio 块设备
+ * 每个请求组成一条链: 请求头, 数据缓冲区, 状态字节. 设备按链执行, 不需要模拟磁盘控制器的寄存器
+ */
+#ifndef OS_VIRTIO_BLK_H
+#define OS_VIRTIO_BLK_H
+
+#include "comm/types.h"
+#include "dev/virtio.h"
+#include "dev/blk.h"
+#include "dev/disk.h"
+#include "core/softirq.h"
+
+#define VIRTIO_BLK_F_SEG_MAX        (1 << 2)    // 配置中给出一个请求最多的数据段数
+#define VIRTIO_BLK_F_RO             (1 << 5)
+
+#define VIRTIO_BLK_CFG_CAPACITY     0           // 64 位, 以 512 字节为单位
+#define VIRTIO_BLK_CFG_SEG_MAX      12
+
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_S_OK             0
+
+#define VIRTIO_BLK_DEPTH            32          // 同时交给设备的请求数
+#define VIRTIO_BLK_XFER_MAX_SECTORS 124         // 一个请求最多的扇区数
+#define VIRTIO_BLK_SEG_NR           (VIRTIO_BLK_XFER_MAX_SECTORS * 2)  // 每个扇区最多分成两段
+
+#pragma pack(1)
+
+typedef struct _virtio_blk_hdr_t {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t sector;
+} virtio_blk_hdr_t;
+
+#pragma pack()
+
+/**
+ * 一个进行中的请求, 占一页: 描述符表放在页首, 作为间接描述符表时满足 16 字节对齐
+ */
+typedef struct _virtio_blk_cmd_t {
+	vring_desc_t table[VIRTIO_BLK_SEG_NR + 2];
+	virtio_blk_hdr_t hdr;
+	volatile uint8_t status;        // 由设备写入
+	int index;
+	blk_request_t *req;
+} virtio_blk_cmd_t;
+
+struct _virtio_blk_t;
+
+typedef struct _virtio_blk_part_t {
+	struct _virtio_blk_t *blk;
+	uint32_t start_sector;
+	uint32_t total_sectors;
+} virtio_blk_part_t;
+
+typedef struct _virtio_blk_t {
+	char name[DISK_NAME_SIZE];
+	virtio_dev_t dev;
+	virtq_t vq;
+	int read_only;
+	int seg_max;                    // 一个请求最多的数据段数
+	uint32_t sector_count;
+	virtio_blk_part_t part[DISK_PRIMARY_PART_CNT];
+
+	spinlock_t lock;                // 保护队列及以下字段
+	virtio_blk_cmd_t *cmd[VIRTIO_BLK_DEPTH];
+	int cmd_count;
+	uint32_t busy;                  // 正在使用的 cmd
+
+	blk_queue_t queue;
+	tasklet_t tasklet;
+} virtio_blk_t;
+
+void virtio_blk_init(void);
+void exception_handler_virtio_blk();
+
+#endif //OS_VIRTIO_BLK_H
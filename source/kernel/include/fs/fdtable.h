@@ -0,0 +1,37 @@
+/**
+ * 进程打开的文件表
+ * 少量文件直接放在内嵌数组中, 不够时扩展到一整页
+ * 用两级位图记录已用的 fd, 分配时 O(1) 找到最小的空闲 fd
+ */
+#ifndef OS_FDTABLE_H
+#define OS_FDTABLE_H
+
+#include "comm/types.h"
+#include "fs/file.h"
+#include "tools/list.h"
+#include "os_cfg.h"
+
+#define FDTABLE_NR_DEFAULT      16          // 内嵌的 fd 数量, 多数进程够用
+#define FDTABLE_NR_MAX          1024        // 扩展后的 fd 数组正好占一页
+#define FDTABLE_WORD_BITS       32
+#define FDTABLE_WORDS           (FDTABLE_NR_MAX / FDTABLE_WORD_BITS)
+#define FDTABLE_POOL_SIZE       (TASK_NR_MAX + 1)   // 另加 first_task
+
+typedef struct _fdtable_t {
+	int max_fds;                            // 当前 fd 数组的容量
+	file_t **fd;                            // 指向 fd_array 或扩展出的页
+	uint32_t full_words;                    // 第 i 位为 1 表示 open_fds[i] 已全部占用
+	uint32_t open_fds[FDTABLE_WORDS];       // 已用 fd 的位图
+	file_t *fd_array[FDTABLE_NR_DEFAULT];
+	list_node_t node;                       // 空闲链表结点
+} fdtable_t;
+
+void fdtable_pool_init(void);
+fdtable_t *fdtable_alloc(void);
+void fdtable_free(fdtable_t *fdt);
+file_t *fdtable_get(fdtable_t *fdt, int fd);
+int fdtable_alloc_fd(fdtable_t *fdt, file_t *file);
+int fdtable_install(fdtable_t *fdt, int fd, file_t *file);
+void fdtable_free_fd(fdtable_t *fdt, int fd);
+
+#endif //OS_FDTABLE_H
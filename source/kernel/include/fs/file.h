@@ -2,6 +2,7 @@
 #define OS_FILE_H
 
 #include "comm/types.h"
+#include "tools/list.h"
 
 #define FILE_TABLE_SIZE     2048
 #define FILE_NAME_SIZE      32
@@ -18,7 +19,7 @@ typedef struct _file_t {
 	char name[FILE_NAME_SIZE];
 	file_type_t type;
 	uint32_t size;
-	int ref;                    // 引用计数
+	volatile int ref;           // 引用计数, 用原子操作修改
 	int dev_id;                 // 文件所属设备 id
 	int pos;                    // 当前位置
 	int mode;                   // 读写模式
@@ -26,11 +27,13 @@ typedef struct _file_t {
 	int cblk;                   // 当前块
 	int index;                  // 在父目录表项的文件索引
 	struct _fs_t *fs;
+	list_node_t free_node;      // 空闲时挂在空闲链表中
 } file_t;
 
 file_t *file_alloc();
 void file_free(file_t *file);
 void file_table_init();
 void file_inc_ref(file_t *file);
+int file_dec_ref(file_t *file);
 
 #endif //OS_FILE_H
@@ -3,11 +3,12 @@
 
 #include "tools/list.h"
 #include "core/task.h"
+#include "ipc/wait.h"
 
 typedef struct _mutex_t {
+	wait_queue_t wait;      // 等待队列的锁同时保护下面的字段
 	task_t *owner;
 	int locked_count;       // 锁定次数
-	list_t wait_list;
 } mutex_t;
 
 void mutex_init(mutex_t *mutex);
@@ -2,14 +2,16 @@
 #define OS_SEM_H
 
 #include "tools/list.h"
+#include "ipc/wait.h"
 
 typedef struct _sem_t {
+	wait_queue_t wait;          // 可能在中断中释放信号量, 其锁须用 irqsave 方式加
 	int count;
-	list_t wait_list;
 } sem_t;
 
 void sem_init(sem_t *sem, int init_count);
 void sem_p(sem_t *sem);
+int sem_p_timeout(sem_t *sem, uint32_t ms);
 void sem_v(sem_t *sem);
 int sem_count(sem_t *sem);
 
@@ -0,0 +1,49 @@
+/**
+ * 排队自旋锁
+ * 按取号顺序获得锁, 避免多个 CPU 竞争时某个 CPU 长期拿不到锁
+ */
+#ifndef OS_SPINLOCK_H
+#define OS_SPINLOCK_H
+
+#include "comm/types.h"
+#include "cpu/irq.h"
+#include "os_cfg.h"
+
+typedef struct _spinlock_t {
+	volatile uint32_t next;         // 下一个可取的号
+	volatile uint32_t owner;        // 当前持有锁的号
+
+#if SPINLOCK_DEBUG
+	const char *name;
+	int cpu;                        // 持有者所在的 CPU, -1 表示未持有
+	void *pc;                       // 加锁的调用位置
+
+	// 持有时间统计, 以 TSC 周期计
+	uint32_t acquire_count;         // 加锁次数
+	uint32_t contend_count;         // 需要等待的次数
+	uint64_t hold_start;
+	uint64_t hold_total;
+	uint32_t hold_max;
+#endif
+} spinlock_t;
+
+// 静态定义的锁可以用该宏初始化
+#if SPINLOCK_DEBUG
+#define SPINLOCK_INIT(lock_name)    {.name = (lock_name), .cpu = -1}
+#else
+#define SPINLOCK_INIT(lock_name)    {0}
+#endif
+
+void spinlock_init(spinlock_t *lock, const char *name);
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+irq_state_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, irq_state_t state);
+int spin_is_locked(spinlock_t *lock);
+void spinlock_dump(spinlock_t *lock);
+
+void preempt_disable(void);
+void preempt_enable(void);
+int preempt_count(void);
+
+#endif //OS_SPINLOCK_H
@@ -0,0 +1,40 @@
+/**
+ * 等待队列
+ * 独占等待者每次只唤醒一个, 非独占等待者全部唤醒, 可设置超时
+ * 唤醒时只把任务放回就绪队列并记录调度请求, 不立即切换
+ */
+#ifndef OS_WAIT_H
+#define OS_WAIT_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+#include "ipc/spinlock.h"
+
+#define WAIT_EXCLUSIVE          (1 << 0)    // 独占等待, 每次唤醒只选中一个
+#define WAIT_TIMED              (1 << 1)    // 内部使用: 在超时队列中
+
+#define WAIT_FOREVER            0           // 不限时等待
+
+#define WAIT_OK                 0           // 被唤醒
+#define WAIT_TIMEOUT            (-1)        // 等待超时
+
+struct _task_t;
+
+typedef struct _wait_queue_t {
+	spinlock_t lock;            // 同时保护使用者的等待条件, 可能在中断中唤醒, 须用 irqsave 方式加锁
+	list_t task_list;           // 非独占等待者在前, 独占等待者在后
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t *wq, const char *name);
+int wait_queue_sleep_locked(wait_queue_t *wq, int flags, uint32_t ms, irq_state_t state);
+int wait_queue_sleep(wait_queue_t *wq, int flags, uint32_t ms);
+int wake_up_locked(wait_queue_t *wq, int nr_exclusive);
+int wake_up(wait_queue_t *wq);
+int wake_up_all(wait_queue_t *wq);
+void wait_time_tick(void);
+
+static inline int wait_queue_active(wait_queue_t *wq) {
+	return !list_is_empty(&wq->task_list);
+}
+
+#endif //OS_WAIT_H
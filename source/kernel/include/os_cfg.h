@@ -7,7 +7,9 @@
 #define GDT_TABLE_SIZE              256               // GDT表项数量
 #define KERNEL_SELECTOR_CS          (1 * 8)           // 内核代码段描述符
 #define KERNEL_SELECTOR_DS          (2 * 8)           // 内核数据段描述符
-#define SELECTOR_SYSCALL            (3 * 8)
+#define APP_SELECTOR_CS             (3 * 8)           // 应用代码段, sysexit 要求紧跟在内核段之后
+#define APP_SELECTOR_DS             (4 * 8)           // 应用数据段
+#define SELECTOR_SYSCALL            (5 * 8)           // 系统调用门
 #define KERNEL_STACK_SIZE           (8 * 1024)        // 内核栈
 
 #define OS_TICKS_MS                 10                // 每毫秒的时钟数
@@ -18,6 +20,14 @@
 
 #define TASK_NR_MAX                 128               // 最大任务数量
 
-#define ROOT_DEV                    DEV_TYPE_DISK, 0xb1	  // 根文件系统设备号
+#define SMP_CPU_MAX                 8                 // 支持的最大CPU数量
+#define SPINLOCK_DEBUG              0                 // 自旋锁检查持有者并统计持有时间
+#define DISK_PIO_BENCH              0                 // 启动时测试各种 PIO 读取方式的速度
+#define DISK_PIO32                  0                 // 对未知的 IDE 控制器也使用 32 位 PIO, 数据端口按规范只有 16 位
+#define RAMDISK_SIZE                0                 // 引导程序没有加载映像时, 启动时分配的内存盘大小
+#define AP_BOOT_ADDR                0x6000            // AP启动代码的复制位置, 须4KB对齐且低于1MB
+
+// 根文件系统设备号, 放在 virtio 磁盘上时为 DEV_TYPE_VIRTIO_BLK, 0xa1, 放在内存盘上时为 DEV_TYPE_RAMDISK, 0xa0 或 0xa1
+#define ROOT_DEV                    DEV_TYPE_DISK, 0xb1
 
 #endif //OS_OS_CFG_H
@@ -14,5 +14,6 @@ int bitmap_get_bit(bitmap_t *bitmap, int index);
 void bitmap_set_bit(bitmap_t *bitmap, int index, int count, int bit);
 int bitmap_is_set(bitmap_t *bitmap, int index);
 int bitmap_alloc_nbits(bitmap_t *bitmap, int bit, int count);
+int bitmap_find_next(bitmap_t *bitmap, int bit, int start);
 
 #endif //OS_BITMAP_H
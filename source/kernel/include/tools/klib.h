@@ -12,6 +12,27 @@ static inline uint32_t up2(uint32_t n, uint32_t align) {
 	return (n + align - 1) & ~(align - 1);
 }
 
+/**
+ * 64 位数除以 32 位数. 内核不链接 libgcc, 不能直接对 64 位数做除法
+ */
+static inline uint64_t div64_32(uint64_t n, uint32_t base, uint32_t *rem) {
+	uint32_t high = (uint32_t) (n >> 32);
+	uint32_t low = (uint32_t) n;
+	uint32_t q_high = 0, q_low, r;
+
+	// 先处理高 32 位, 保证 divl 的商不溢出
+	if (high >= base) {
+		q_high = high / base;
+		high = high % base;
+	}
+	__asm__ __volatile__("divl %[b]" : "=a"(q_low), "=d"(r) : [b]"rm"(base), "0"(low), "1"(high));
+
+	if (rem) {
+		*rem = r;
+	}
+	return ((uint64_t) q_high << 32) | q_low;
+}
+
 void kernel_strcpy(char *dest, const char *src);
 void kernel_strncpy(char *dest, const char *src, int size);
 int kernel_strncmp(const char *s1, const char *s2, int size);
@@ -47,6 +47,7 @@ static inline list_node_t *list_last(list_t *list) {
 
 void list_push_front(list_t *list, list_node_t *node);
 void list_push_back(list_t *list, list_node_t *node);
+void list_insert_after(list_t *list, list_node_t *pre, list_node_t *node);
 list_node_t *list_pop_front(list_t *list);
 list_node_t *list_ease(list_t *list, list_node_t *node);
 
@@ -54,6 +55,6 @@ list_node_t *list_ease(list_t *list, list_node_t *node);
     ((parent_type *)((uint32_t)member_ptr - (uint32_t)&((parent_type *)0)->member))
 
 #define list_node_parent(node, parent_type, member) \
-    (parent_type *) (node ? parent_addr(node, parent_type, member) : 0)
+    ((parent_type *) ((node) ? parent_addr(node, parent_type, member) : 0))
 
 #endif //OS_LIST_H
@@ -0,0 +1,50 @@
+/**
+ * 红黑树, 结点嵌入在宿主结构中使用, 与 list_node_t 的用法一致
+ */
+#ifndef OS_RBTREE_H
+#define OS_RBTREE_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+
+#define RB_RED                      0
+#define RB_BLACK                    1
+
+typedef struct _rb_node_t {
+	struct _rb_node_t *parent;
+	struct _rb_node_t *left;
+	struct _rb_node_t *right;
+	int color;
+} rb_node_t;
+
+typedef struct _rb_tree_t {
+	rb_node_t *root;
+	rb_node_t *leftmost;        // 缓存最小结点, 取最小值为 O(1)
+	int count;
+} rb_tree_t;
+
+// a 排在 b 之前时返回非 0
+typedef int (*rb_less_t)(rb_node_t *a, rb_node_t *b);
+
+void rb_tree_init(rb_tree_t *tree);
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_less_t less);
+void rb_erase(rb_tree_t *tree, rb_node_t *node);
+rb_node_t *rb_next(rb_node_t *node);
+rb_node_t *rb_last(rb_tree_t *tree);
+
+static inline rb_node_t *rb_first(rb_tree_t *tree) {
+	return tree->leftmost;
+}
+
+static inline int rb_count(rb_tree_t *tree) {
+	return tree->count;
+}
+
+static inline int rb_is_empty(rb_tree_t *tree) {
+	return tree->count == 0;
+}
+
+#define rb_node_parent(node, parent_type, member) \
+    ((parent_type *) ((node) ? parent_addr(node, parent_type, member) : 0))
+
+#endif //OS_RBTREE_H
@@ -25,18 +25,13 @@ int first_task_main() {
 #endif
 
 	for (int i = 0; i < TTY_NR; ++i) {
-		int pid = fork();
+		char tty_num[] = "/dev/tty?";
+		tty_num[sizeof(tty_num) - 2] = '0' + i;
+		char *argv[] = {tty_num, (char *) 0};
+		int pid = spawn("shell.elf", argv, (int *) 0);
 		if (pid < 0) {
-			print_msg("fork failed\n", 0);
+			print_msg("spawn failed\n", 0);
 			break;
-		} else if (pid == 0) {
-			char tty_num[] = "/dev/tty?";
-			tty_num[sizeof(tty_num) - 2] = '0' + i;
-			char *argv[] = {tty_num, (char *) 0};
-			execve("shell.elf", argv, (char **) 0);
-			while (1) {
-				msleep(10000);
-			}
 		}
 	}
 
@@ -12,10 +12,17 @@
 #include "tools/list.h"
 #include "ipc/sem.h"
 #include "core/memory.h"
+#include "core/vdso.h"
+#include "core/softirq.h"
 #include "tools/klib.h"
 #include "dev/console.h"
+#include "dev/dev.h"
 #include "dev/keyboard.h"
+#include "dev/pci.h"
+#include "dev/blk.h"
+#include "dev/ramdisk.h"
 #include "fs/fs.h"
+#include "cpu/smp.h"
 
 /**
  * 内核入口
@@ -25,11 +32,18 @@ void kernel_init(boot_info_t *boot_info) {
 	cpu_init();
 	irq_init();
 
+	dev_init();
 	log_init();
 	memory_init(boot_info);
+	pci_init();
+	ramdisk_init(boot_info);
 	fs_init();
+	vdso_init();
 	time_init();
 	task_manager_init();
+	softirq_init();
+	blk_init();
+	smp_init();
 }
 
 void move_to_first_task(void) {
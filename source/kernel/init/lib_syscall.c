@@ -1,6 +1,8 @@
 #include "applib/lib_syscall.h"
 #include "malloc.h"
 
+int syscall_mode = SYSCALL_MODE_UNKNOWN;      // 各进程第一次系统调用时检测
+
 void msleep(int ms) {
 	if (ms <= 0) {
 		return;
@@ -9,9 +11,12 @@ void msleep(int ms) {
 	sys_call(&args);
 }
 
+/**
+ * 进程号由内核写在共享页中, 直接读取即可
+ */
 int getpid() {
-	syscall_args_t args = {SYS_getpid, 0, 0, 0, 0};
-	return sys_call(&args);
+	vdso_data_t *vdso = (vdso_data_t *) VDSO_DATA_ADDR;
+	return ((vdso_getpid_t) vdso->entry[VDSO_FN_getpid])();
 }
 
 void print_msg(const char *fmt, int arg) {
@@ -24,6 +29,15 @@ int fork() {
 	return sys_call(&args);
 }
 
+/**
+ * 直接从 ELF 文件创建子进程, 相当于 fork 后马上 execve
+ * fd_map 为空时继承所有打开的文件, 否则依次指定子进程的标准输入、输出、错误
+ */
+int spawn(const char *path, char *const argv[], const int *fd_map) {
+	syscall_args_t args = {SYS_spawn, (uint32_t) path, (uint32_t) argv, (uint32_t) fd_map, 0};
+	return sys_call(&args);
+}
+
 int execve(const char *path, char *const argv[], char *const envp[]) {
 	syscall_args_t args = {SYS_execve, (uint32_t) path, (uint32_t) argv, (uint32_t) envp, 0};
 	return sys_call(&args);
@@ -1,59 +1,54 @@
 #include "ipc/mutex.h"
-#include "cpu/irq.h"
 
 /**
  * 初始化互斥锁
  */
 void mutex_init(mutex_t *mutex) {
+	wait_queue_init(&mutex->wait, "mutex");
 	mutex->owner = (task_t *) 0;
 	mutex->locked_count = 0;
-	list_init(&mutex->wait_list);
 }
 
 /**
  * 互斥锁加锁
  */
 void mutex_lock(mutex_t *mutex) {
-	irq_state_t state = irq_enter_protection();
-
 	task_t *current = task_current();
-	if (mutex->locked_count == 0) {
-		mutex->locked_count++;
-		mutex->owner = current;
-	} else if (mutex->owner == current) {
+
+	irq_state_t state = spin_lock_irqsave(&mutex->wait.lock);
+	if (mutex->owner == current) {
 		mutex->locked_count++;
-	} else {
-		task_set_block(current);
-		list_push_back(&mutex->wait_list, &current->wait_node);
-		task_dispatch();
+		spin_unlock_irqrestore(&mutex->wait.lock, state);
+		return;
 	}
 
-	irq_leave_protection(state);
+	// 被唤醒后锁可能又被别的任务抢先拿走, 需要重新检查
+	while (mutex->locked_count != 0) {
+		wait_queue_sleep_locked(&mutex->wait, WAIT_EXCLUSIVE, WAIT_FOREVER, state);
+		state = spin_lock_irqsave(&mutex->wait.lock);
+	}
+
+	mutex->locked_count = 1;
+	mutex->owner = current;
+	spin_unlock_irqrestore(&mutex->wait.lock, state);
 }
 
 /**
  * 互斥锁解锁
  */
 void mutex_unlock(mutex_t *mutex) {
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&mutex->wait.lock);
 
 	task_t *current = task_current();
 	if (mutex->owner != current) {
-		irq_leave_protection(state);
+		spin_unlock_irqrestore(&mutex->wait.lock, state);
 		return;
 	}
 
 	if (--mutex->locked_count == 0) {
 		mutex->owner = (task_t *) 0;
-		if (!list_is_empty(&mutex->wait_list)) {
-			list_node_t *node = list_pop_front(&mutex->wait_list);
-			task_t *task = list_node_parent(node, task_t, wait_node);
-			mutex->locked_count++;
-			mutex->owner = task;
-			task_set_ready(task);
-			task_dispatch();
-		}
+		wake_up_locked(&mutex->wait, 1);
 	}
 
-	irq_leave_protection(state);
-}
\ No newline at end of file
+	spin_unlock_irqrestore(&mutex->wait.lock, state);
+}
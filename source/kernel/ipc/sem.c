@@ -1,58 +1,57 @@
 #include "ipc/sem.h"
 #include "core/task.h"
-#include "cpu/irq.h"
 
 /**
  * 初始化信号量
  */
 void sem_init(sem_t *sem, int init_count) {
+	wait_queue_init(&sem->wait, "sem");
 	sem->count = init_count;
-	list_init(&sem->wait_list);
 }
 
 /**
  * 信号量 P 操作
  */
 void sem_p(sem_t *sem) {
-	irq_state_t state = irq_enter_protection();
-
-	if (sem->count > 0) {
-		sem->count--;
-	} else {
-		task_t *current = task_current();
-		task_set_block(current);
-		list_push_back(&sem->wait_list, &current->wait_node);
-		task_dispatch();
+	sem_p_timeout(sem, WAIT_FOREVER);
+}
+
+/**
+ * 限时的 P 操作, 超时返回 -1
+ */
+int sem_p_timeout(sem_t *sem, uint32_t ms) {
+	irq_state_t state = spin_lock_irqsave(&sem->wait.lock);
+
+	// 被唤醒后计数可能已被别的任务取走, 需要重新检查
+	while (sem->count == 0) {
+		if (wait_queue_sleep_locked(&sem->wait, WAIT_EXCLUSIVE, ms, state) == WAIT_TIMEOUT) {
+			return -1;
+		}
+		state = spin_lock_irqsave(&sem->wait.lock);
 	}
 
-	irq_leave_protection(state);
+	sem->count--;
+	spin_unlock_irqrestore(&sem->wait.lock, state);
+	return 0;
 }
 
 /**
  * 信号量 V 操作
  */
 void sem_v(sem_t *sem) {
-	irq_state_t state = irq_enter_protection();
-
-	if (list_is_empty(&sem->wait_list)) {
-		sem->count++;
-	} else {
-		list_node_t *node = list_pop_front(&sem->wait_list);
-		task_t *task = list_node_parent(node, task_t, wait_node);
-		task_set_ready(task);
-		task_dispatch();
-	}
-
-	irq_leave_protection(state);
+	irq_state_t state = spin_lock_irqsave(&sem->wait.lock);
+	sem->count++;
+	wake_up_locked(&sem->wait, 1);
+	spin_unlock_irqrestore(&sem->wait.lock, state);
 }
 
 /**
  * 获取信号量计数
  */
 int sem_count(sem_t *sem) {
-	irq_state_t state = irq_enter_protection();
+	irq_state_t state = spin_lock_irqsave(&sem->wait.lock);
 	int count = sem->count;
-	irq_leave_protection(state);
+	spin_unlock_irqrestore(&sem->wait.lock, state);
 
 	return count;
-}
\ No newline at end of file
+}
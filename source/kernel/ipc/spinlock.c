@@ -0,0 +1,151 @@
+/**
+ * 排队自旋锁
+ *
+ * 持有自旋锁期间禁止抢占: 时钟中断只记录调度请求, 到最外层锁释放时再切换任务,
+ * 因此持有锁时不能调用会阻塞的函数. 需要在中断中使用的锁, 要用 irqsave 版本加锁
+ */
+#include "ipc/spinlock.h"
+#include "cpu/cpu.h"
+#include "cpu/smp.h"
+#include "core/task.h"
+#include "core/softirq.h"
+#include "comm/cpu_instr.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+void preempt_disable(void) {
+	cpu_this()->preempt_count++;
+	barrier();
+}
+
+/**
+ * 恢复抢占, 如果期间错过了软中断或调度且中断已开, 立即补做
+ */
+void preempt_enable(void) {
+	barrier();
+	cpu_t *cpu = cpu_this();
+	if ((--cpu->preempt_count == 0) && (read_eflags() & EFLAGS_IF)) {
+		if (cpu->softirq_pending) {
+			softirq_do_pending();
+		}
+		if (cpu->need_resched) {
+			task_dispatch();
+		}
+	}
+}
+
+int preempt_count(void) {
+	return cpu_this()->preempt_count;
+}
+
+void spinlock_init(spinlock_t *lock, const char *name) {
+	kernel_memset(lock, 0, sizeof(spinlock_t));
+#if SPINLOCK_DEBUG
+	lock->name = name;
+	lock->cpu = -1;
+#endif
+}
+
+int spin_is_locked(spinlock_t *lock) {
+	return lock->next != lock->owner;
+}
+
+#if SPINLOCK_DEBUG
+/**
+ * 统计持有时间用的时钟周期, 没有 TSC 时为 0, 只统计次数
+ */
+static uint64_t spinlock_cycles(void) {
+	static int has_tsc = -1;
+	if (has_tsc < 0) {
+		uint32_t eax, ebx, ecx, edx;
+		cpuid(1, &eax, &ebx, &ecx, &edx);
+		has_tsc = (edx & CPUID_FEAT_EDX_TSC) != 0;
+	}
+	return has_tsc ? rdtsc() : 0;
+}
+#endif
+
+static void do_lock(spinlock_t *lock, void *pc) {
+#if SPINLOCK_DEBUG
+	// 同一 CPU 重复加锁必然死锁
+	int cpu = cpu_this()->id;
+	if (spin_is_locked(lock) && (lock->cpu == cpu)) {
+		log_printf("spinlock %s: recursive lock at 0x%x, held at 0x%x", lock->name, pc, lock->pc);
+		ASSERT(0);
+	}
+#endif
+
+	uint32_t ticket = atomic_xadd(&lock->next, 1);
+#if SPINLOCK_DEBUG
+	int contended = lock->owner != ticket;
+#endif
+	while (lock->owner != ticket) {
+		cpu_pause();
+	}
+	barrier();
+
+#if SPINLOCK_DEBUG
+	lock->cpu = cpu;
+	lock->pc = pc;
+	lock->acquire_count++;
+	lock->contend_count += contended;
+	lock->hold_start = spinlock_cycles();
+#endif
+}
+
+static void do_unlock(spinlock_t *lock) {
+#if SPINLOCK_DEBUG
+	if (!spin_is_locked(lock) || (lock->cpu != cpu_this()->id)) {
+		log_printf("spinlock %s: unlock by non-owner", lock->name);
+		ASSERT(0);
+	}
+
+	uint32_t hold = (uint32_t) (spinlock_cycles() - lock->hold_start);
+	lock->hold_total += hold;
+	if (hold > lock->hold_max) {
+		lock->hold_max = hold;
+	}
+	lock->cpu = -1;
+	lock->pc = (void *) 0;
+#endif
+
+	barrier();
+	lock->owner++;
+}
+
+void spin_lock(spinlock_t *lock) {
+	preempt_disable();
+	do_lock(lock, __builtin_return_address(0));
+}
+
+void spin_unlock(spinlock_t *lock) {
+	do_unlock(lock);
+	preempt_enable();
+}
+
+/**
+ * 关中断后加锁, 用于会在中断处理中使用的锁
+ */
+irq_state_t spin_lock_irqsave(spinlock_t *lock) {
+	irq_state_t state = irq_enter_protection();
+	preempt_disable();
+	do_lock(lock, __builtin_return_address(0));
+	return state;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, irq_state_t state) {
+	do_unlock(lock);
+	irq_leave_protection(state);
+	preempt_enable();
+}
+
+/**
+ * 输出锁的统计信息
+ */
+void spinlock_dump(spinlock_t *lock) {
+#if SPINLOCK_DEBUG
+	uint32_t avg = lock->acquire_count ? (uint32_t) div64_32(lock->hold_total, lock->acquire_count, (uint32_t *) 0) : 0;
+	log_printf("spinlock %s: acquire %d, contend %d, hold avg %d max %d cycles",
+	           lock->name, lock->acquire_count, lock->contend_count, avg, lock->hold_max);
+#endif
+}
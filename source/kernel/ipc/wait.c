@@ -0,0 +1,161 @@
+/**
+ * 等待队列
+ *
+ * 加锁顺序: 等待队列 -> 超时队列 -> 就绪队列
+ * 时钟中断持有超时队列的锁时不能再去拿等待队列的锁, 所以先找出到期的任务,
+ * 放开超时队列后重新按顺序加锁, 再确认任务仍在原来的队列中等待
+ */
+#include "ipc/wait.h"
+#include "core/task.h"
+#include "os_cfg.h"
+
+static spinlock_t timeout_lock = SPINLOCK_INIT("wait_timeout");
+static list_t timeout_list;         // 限时等待的任务
+
+void wait_queue_init(wait_queue_t *wq, const char *name) {
+	spinlock_init(&wq->lock, name);
+	list_init(&wq->task_list);
+}
+
+/**
+ * 将任务移出等待队列并唤醒, 调用者持有 wq->lock
+ */
+static void wait_remove(wait_queue_t *wq, task_t *task, int result) {
+	list_ease(&wq->task_list, &task->wait_node);
+	if (task->wait_flags & WAIT_TIMED) {
+		spin_lock(&timeout_lock);
+		list_ease(&timeout_list, &task->timeout_node);
+		spin_unlock(&timeout_lock);
+	}
+
+	task->wait_queue = (wait_queue_t *) 0;
+	task->wait_flags = 0;
+	task->wait_result = result;
+	task_wakeup(task);
+}
+
+/**
+ * 在等待队列上睡眠
+ * 调用者已用 spin_lock_irqsave 锁住 wq->lock 并检查过等待条件, state 为加锁时的返回值.
+ * 返回时锁已释放、中断状态已恢复, 被唤醒返回 WAIT_OK, 超时返回 WAIT_TIMEOUT
+ */
+int wait_queue_sleep_locked(wait_queue_t *wq, int flags, uint32_t ms, irq_state_t state) {
+	task_t *current = task_current();
+
+	current->wait_queue = wq;
+	current->wait_flags = flags & WAIT_EXCLUSIVE;
+	current->wait_result = WAIT_OK;
+	if (flags & WAIT_EXCLUSIVE) {
+		list_push_back(&wq->task_list, &current->wait_node);
+	} else {
+		list_push_front(&wq->task_list, &current->wait_node);
+	}
+
+	if (ms != WAIT_FOREVER) {
+		spin_lock(&timeout_lock);
+		current->wait_flags |= WAIT_TIMED;
+		current->wait_ticks = (ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS;
+		list_push_back(&timeout_list, &current->timeout_node);
+		spin_unlock(&timeout_lock);
+	}
+
+	task_set_block(current);
+	spin_unlock(&wq->lock);
+
+	task_dispatch();
+	irq_leave_protection(state);
+	return current->wait_result;
+}
+
+/**
+ * 无条件睡眠, 直到被唤醒或超时
+ */
+int wait_queue_sleep(wait_queue_t *wq, int flags, uint32_t ms) {
+	irq_state_t state = spin_lock_irqsave(&wq->lock);
+	return wait_queue_sleep_locked(wq, flags, ms, state);
+}
+
+/**
+ * 唤醒所有非独占等待者及最多 nr_exclusive 个独占等待者, 调用者持有 wq->lock
+ * nr_exclusive 为 0 时全部唤醒. 返回唤醒的任务数
+ */
+int wake_up_locked(wait_queue_t *wq, int nr_exclusive) {
+	int count = 0;
+
+	list_node_t *node = list_first(&wq->task_list);
+	while (node) {
+		list_node_t *next = list_node_next(node);
+		task_t *task = list_node_parent(node, task_t, wait_node);
+		int exclusive = task->wait_flags & WAIT_EXCLUSIVE;
+
+		wait_remove(wq, task, WAIT_OK);
+		count++;
+		if (exclusive && (--nr_exclusive == 0)) {
+			break;
+		}
+		node = next;
+	}
+
+	return count;
+}
+
+int wake_up(wait_queue_t *wq) {
+	irq_state_t state = spin_lock_irqsave(&wq->lock);
+	int count = wake_up_locked(wq, 1);
+	spin_unlock_irqrestore(&wq->lock, state);
+	return count;
+}
+
+int wake_up_all(wait_queue_t *wq) {
+	irq_state_t state = spin_lock_irqsave(&wq->lock);
+	int count = wake_up_locked(wq, 0);
+	spin_unlock_irqrestore(&wq->lock, state);
+	return count;
+}
+
+/**
+ * 查找已到期的任务, 调用者持有 timeout_lock
+ */
+static task_t *find_expired(void) {
+	list_node_t *node = list_first(&timeout_list);
+	while (node) {
+		task_t *task = list_node_parent(node, task_t, timeout_node);
+		if (task->wait_ticks <= 0) {
+			return task;
+		}
+		node = list_node_next(node);
+	}
+	return (task_t *) 0;
+}
+
+/**
+ * 时钟软中断中调用
+ * 超时队列和等待队列都会在硬件中断中访问, 须关中断加锁
+ */
+void wait_time_tick(void) {
+	irq_state_t state = spin_lock_irqsave(&timeout_lock);
+	list_node_t *node = list_first(&timeout_list);
+	while (node) {
+		task_t *task = list_node_parent(node, task_t, timeout_node);
+		if (task->wait_ticks > 0) {
+			task->wait_ticks--;
+		}
+		node = list_node_next(node);
+	}
+
+	task_t *task;
+	while ((task = find_expired()) != (task_t *) 0) {
+		wait_queue_t *wq = task->wait_queue;
+		spin_unlock(&timeout_lock);
+
+		// 放锁期间任务可能已被唤醒, 甚至又在别处开始了新的等待
+		spin_lock(&wq->lock);
+		if ((task->wait_queue == wq) && (task->wait_flags & WAIT_TIMED) && (task->wait_ticks <= 0)) {
+			wait_remove(wq, task, WAIT_TIMEOUT);
+		}
+		spin_unlock(&wq->lock);
+
+		spin_lock(&timeout_lock);
+	}
+	spin_unlock_irqrestore(&timeout_lock, state);
+}
@@ -54,4 +54,25 @@ int bitmap_alloc_nbits(bitmap_t *bitmap, int bit, int count) {
 		}
 	}
 	return -1;
+}
+
+/**
+ * 从 start 开始查找第一个值为 bit 的位，找不到返回 -1
+ * 整字节都不满足时直接跳过
+ */
+int bitmap_find_next(bitmap_t *bitmap, int bit, int start) {
+	uint8_t skip = bit ? 0x00 : 0xFF;
+	int index = start;
+	while (index < bitmap->bit_count) {
+		if ((index % 8 == 0) && (bitmap->bits[index / 8] == skip)) {
+			index += 8;
+			continue;
+		}
+
+		if (bitmap_get_bit(bitmap, index) == bit) {
+			return index;
+		}
+		index++;
+	}
+	return -1;
 }
\ No newline at end of file
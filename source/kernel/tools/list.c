@@ -30,6 +30,26 @@ void list_push_back(list_t *list, list_node_t *node) {
 	list->count++;
 }
 
+/**
+ * 将 node 插入到 pre 之后, pre 为空时插入到表头
+ */
+void list_insert_after(list_t *list, list_node_t *pre, list_node_t *node) {
+	if (pre == (list_node_t *) 0) {
+		list_push_front(list, node);
+		return;
+	}
+
+	node->prev = pre;
+	node->next = pre->next;
+	if (pre->next == (list_node_t *) 0) {
+		list->last = node;
+	} else {
+		pre->next->prev = node;
+	}
+	pre->next = node;
+	list->count++;
+}
+
 list_node_t *list_pop_front(list_t *list) {
 	if (list_is_empty(list)) {
 		return (list_node_t *) 0;
@@ -0,0 +1,297 @@
+/**
+ * 红黑树
+ * 参考《算法导论》第13章, 叶子结点用空指针表示
+ */
+#include "tools/rbtree.h"
+
+static inline int is_black(rb_node_t *node) {
+	return node == (rb_node_t *) 0 || node->color == RB_BLACK;
+}
+
+static void rotate_left(rb_tree_t *tree, rb_node_t *x) {
+	rb_node_t *y = x->right;
+
+	x->right = y->left;
+	if (y->left) {
+		y->left->parent = x;
+	}
+
+	y->parent = x->parent;
+	if (x->parent == (rb_node_t *) 0) {
+		tree->root = y;
+	} else if (x == x->parent->left) {
+		x->parent->left = y;
+	} else {
+		x->parent->right = y;
+	}
+
+	y->left = x;
+	x->parent = y;
+}
+
+static void rotate_right(rb_tree_t *tree, rb_node_t *x) {
+	rb_node_t *y = x->left;
+
+	x->left = y->right;
+	if (y->right) {
+		y->right->parent = x;
+	}
+
+	y->parent = x->parent;
+	if (x->parent == (rb_node_t *) 0) {
+		tree->root = y;
+	} else if (x == x->parent->right) {
+		x->parent->right = y;
+	} else {
+		x->parent->left = y;
+	}
+
+	y->right = x;
+	x->parent = y;
+}
+
+/**
+ * 用 v 替换 u 在树中的位置
+ */
+static void transplant(rb_tree_t *tree, rb_node_t *u, rb_node_t *v) {
+	if (u->parent == (rb_node_t *) 0) {
+		tree->root = v;
+	} else if (u == u->parent->left) {
+		u->parent->left = v;
+	} else {
+		u->parent->right = v;
+	}
+
+	if (v) {
+		v->parent = u->parent;
+	}
+}
+
+static rb_node_t *subtree_min(rb_node_t *node) {
+	while (node->left) {
+		node = node->left;
+	}
+	return node;
+}
+
+void rb_tree_init(rb_tree_t *tree) {
+	tree->root = (rb_node_t *) 0;
+	tree->leftmost = (rb_node_t *) 0;
+	tree->count = 0;
+}
+
+static void insert_fixup(rb_tree_t *tree, rb_node_t *node) {
+	rb_node_t *parent;
+	while ((parent = node->parent) && parent->color == RB_RED) {
+		// 父结点为红色, 则一定不是根, 祖父结点必然存在
+		rb_node_t *gparent = parent->parent;
+		if (parent == gparent->left) {
+			rb_node_t *uncle = gparent->right;
+			if (!is_black(uncle)) {
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->right) {
+				node = parent;
+				rotate_left(tree, node);
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_right(tree, gparent);
+		} else {
+			rb_node_t *uncle = gparent->left;
+			if (!is_black(uncle)) {
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->left) {
+				node = parent;
+				rotate_right(tree, node);
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_left(tree, gparent);
+		}
+	}
+
+	tree->root->color = RB_BLACK;
+}
+
+/**
+ * 插入结点, 相等的键插入到已有结点之后
+ */
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_less_t less) {
+	rb_node_t *parent = (rb_node_t *) 0;
+	rb_node_t **link = &tree->root;
+	int leftmost = 1;
+
+	while (*link) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = (rb_node_t *) 0;
+	node->color = RB_RED;
+	*link = node;
+
+	if (leftmost) {
+		tree->leftmost = node;
+	}
+	tree->count++;
+
+	insert_fixup(tree, node);
+}
+
+static void erase_fixup(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent) {
+	while (node != tree->root && is_black(node)) {
+		if (node == parent->left) {
+			rb_node_t *sibling = parent->right;
+			if (!is_black(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_left(tree, parent);
+				sibling = parent->right;
+			}
+
+			if (is_black(sibling->left) && is_black(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (is_black(sibling->right)) {
+				sibling->left->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_right(tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->right->color = RB_BLACK;
+			rotate_left(tree, parent);
+			node = tree->root;
+		} else {
+			rb_node_t *sibling = parent->left;
+			if (!is_black(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_right(tree, parent);
+				sibling = parent->left;
+			}
+
+			if (is_black(sibling->left) && is_black(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (is_black(sibling->left)) {
+				sibling->right->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_left(tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->left->color = RB_BLACK;
+			rotate_right(tree, parent);
+			node = tree->root;
+		}
+	}
+
+	if (node) {
+		node->color = RB_BLACK;
+	}
+}
+
+/**
+ * 删除结点
+ */
+void rb_erase(rb_tree_t *tree, rb_node_t *node) {
+	if (tree->leftmost == node) {
+		tree->leftmost = rb_next(node);
+	}
+
+	rb_node_t *child, *parent;
+	int color = node->color;
+
+	if (node->left == (rb_node_t *) 0) {
+		child = node->right;
+		parent = node->parent;
+		transplant(tree, node, child);
+	} else if (node->right == (rb_node_t *) 0) {
+		child = node->left;
+		parent = node->parent;
+		transplant(tree, node, child);
+	} else {
+		// 有两个子结点, 用后继结点替换
+		rb_node_t *next = subtree_min(node->right);
+		color = next->color;
+		child = next->right;
+		if (next->parent == node) {
+			parent = next;
+		} else {
+			parent = next->parent;
+			transplant(tree, next, next->right);
+			next->right = node->right;
+			next->right->parent = next;
+		}
+
+		transplant(tree, node, next);
+		next->left = node->left;
+		next->left->parent = next;
+		next->color = node->color;
+	}
+
+	if (color == RB_BLACK) {
+		erase_fixup(tree, child, parent);
+	}
+
+	tree->count--;
+	node->parent = node->left = node->right = (rb_node_t *) 0;
+}
+
+/**
+ * 中序遍历的下一个结点
+ */
+rb_node_t *rb_next(rb_node_t *node) {
+	if (node->right) {
+		return subtree_min(node->right);
+	}
+
+	rb_node_t *parent = node->parent;
+	while (parent && node == parent->right) {
+		node = parent;
+		parent = parent->parent;
+	}
+	return parent;
+}
+
+/**
+ * 最大的结点
+ */
+rb_node_t *rb_last(rb_tree_t *tree) {
+	rb_node_t *node = tree->root;
+	while (node && node->right) {
+		node = node->right;
+	}
+	return node;
+}
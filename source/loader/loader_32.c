@@ -34,9 +34,8 @@ static void read_disk(uint32_t sector, uint32_t sector_count, uint8_t *buf) {
 		while ((inb(0x1F7) & 0x88) != 0x8) {}
 
 		// 读取并将数据写入到缓存中
-		for (int i = 0; i < SECTOR_SIZE / 2; i++) {
-			*data_buf++ = inw(0x1F0);
-		}
+		insw(0x1F0, data_buf, SECTOR_SIZE / 2);
+		data_buf += SECTOR_SIZE / 2;
 	}
 }
 
@@ -119,6 +118,24 @@ void enable_page_mode(void) {
 	write_cr0(read_cr0() | CR0_PG);
 
 }
+/**
+ * 加载内存盘映像, 每次最多读取 65535 个扇区
+ */
+static void load_ramdisk(void) {
+	boot_info.ramdisk_start = RAMDISK_LOAD_ADDR;
+	boot_info.ramdisk_size = RAMDISK_IMAGE_SECTORS * SECTOR_SIZE;
+
+	uint32_t sector = RAMDISK_IMAGE_SECTOR;
+	uint8_t *buf = (uint8_t *) RAMDISK_LOAD_ADDR;
+	for (uint32_t left = RAMDISK_IMAGE_SECTORS; left > 0;) {
+		uint32_t count = left > 0xFFFF ? 0xFFFF : left;
+		read_disk(sector, count, buf);
+		sector += count;
+		buf += count * SECTOR_SIZE;
+		left -= count;
+	}
+}
+
 /**
  * 从磁盘上加载内核
  */
@@ -126,6 +143,7 @@ void load_kernel(void) {
 	// 读取的扇区数一定要大一些，保不准kernel.elf大小会变得很大
 	// 我就吃过亏，只读了100个扇区，结果运行后发现kernel的一些初始化的变量值为空，程序也会跑飞
 	read_disk(100, 500, (uint8_t *) SYS_KERNEL_LOAD_ADDR);
+	load_ramdisk();
 
 	// 解析ELF文件，并通过调用的方式，进入到内核中去执行，同时传递boot参数
 	// 临时将elf文件先读到SYS_KERNEL_LOAD_ADDR处，再进行解析
@@ -307,21 +307,16 @@ static void run_builtin(const cli_cmd_t *cmd, int argc, char *argv[]) {
 }
 
 static void run_exec_file(const char *name, int argc, char *argv[]) {
-	int pid = fork();
+	// 子进程直接从文件创建, 不必先复制 shell 的地址空间
+	int pid = spawn(name, argv, NULL);
 	if (pid < 0) {
-		fprintf(stderr, ESC_COLOR_ERROR"fork failed\n"ESC_COLOR_DEFAULT);
+		fprintf(stderr, ESC_COLOR_ERROR"spawn: %s failed\n"ESC_COLOR_DEFAULT, name);
 		return;
-	} else if (pid == 0) {
-		int err = execve(name, argv, NULL);
-		if (err < 0) {
-			fprintf(stderr, ESC_COLOR_ERROR"execve: %s failed\n"ESC_COLOR_DEFAULT, name);
-		}
-		exit(-1);
-	} else {
-		int status;
-		int pid_wait = wait(&status);
-		fprintf(stderr, "cmd %s, pid = %d exit with status %d\n", name, pid_wait, status);
 	}
+
+	int status;
+	int pid_wait = waitpid(pid, &status, 0);
+	fprintf(stderr, "cmd %s, pid = %d exit with status %d\n", name, pid_wait, status);
 }
 
 static const char *find_exec_path(const char *name) {